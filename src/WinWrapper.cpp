@@ -29,6 +29,8 @@
 
 #include "asteroids_d3d11.h"
 #include "asteroids_d3d12.h"
+#include "benchmark.h"
+#include "job_system.h"
 #include "camera.h"
 #include "profile.h"
 #include "gui.h"
@@ -187,6 +189,50 @@ LRESULT CALLBACK WindowProc(
                 gSettings.executeIndirect = !gSettings.executeIndirect;
                 std::cout << "ExecuteIndirect Rendering: " << gSettings.executeIndirect << std::endl;
                 return 0;
+            case 'C':
+                gSettings.closedFormMotion = !gSettings.closedFormMotion;
+                std::cout << "Closed-form Motion: " << gSettings.closedFormMotion << std::endl;
+                return 0;
+            case 'F':
+                gSettings.cullAsteroids = !gSettings.cullAsteroids;
+                std::cout << "Frustum Culling: " << gSettings.cullAsteroids << std::endl;
+                return 0;
+            case 'G':
+                gSettings.gridCulling = !gSettings.gridCulling;
+                std::cout << "Grid Culling: " << gSettings.gridCulling << std::endl;
+                return 0;
+            case 'O':
+                gSettings.occlusionCulling = !gSettings.occlusionCulling;
+                std::cout << "Occlusion Culling: " << gSettings.occlusionCulling << std::endl;
+                return 0;
+            case 'B':
+                gSettings.bucketDrawList = !gSettings.bucketDrawList;
+                std::cout << "Bucketed Draw List: " << gSettings.bucketDrawList << std::endl;
+                return 0;
+            case 'Z':
+                gSettings.frontToBackDraws = !gSettings.frontToBackDraws;
+                std::cout << "Front-to-Back Draws: " << gSettings.frontToBackDraws << std::endl;
+                return 0;
+            case 'K':
+                gSettings.collisions = !gSettings.collisions;
+                std::cout << "Collisions: " << gSettings.collisions << std::endl;
+                return 0;
+            case 'N':
+                gSettings.gravity = !gSettings.gravity;
+                std::cout << "N-Body Gravity: " << gSettings.gravity << std::endl;
+                return 0;
+            case 'L':
+                gSettings.lodThresholdTable = !gSettings.lodThresholdTable;
+                std::cout << "LOD Threshold Table: " << gSettings.lodThresholdTable << std::endl;
+                return 0;
+            case 'A':
+                gSettings.asyncSimulation = !gSettings.asyncSimulation;
+                std::cout << "Async Simulation: " << gSettings.asyncSimulation << std::endl;
+                return 0;
+            case 'U':
+                gSettings.amortizeFarUpdates = !gSettings.amortizeFarUpdates;
+                std::cout << "Amortized Far Updates: " << gSettings.amortizeFarUpdates << std::endl;
+                return 0;
             case 'S':
                 gSettings.submitRendering = !gSettings.submitRendering;
                 std::cout << "Submit Rendering: " << gSettings.submitRendering << std::endl;
@@ -289,6 +335,7 @@ int main(int argc, char** argv)
     gSettings.windowHeight *= dpi / 96;
 
     char* perfOutputPath = nullptr;
+    char* benchmarkName = nullptr;
     for (int a = 1; a < argc; ++a) {
         if (_stricmp(argv[a], "-close_after") == 0 && a + 1 < argc) {
             gSettings.closeAfterSeconds = atof(argv[++a]);
@@ -327,6 +374,67 @@ int main(int argc, char** argv)
         } else if (_stricmp(argv[a], "-perf_output") == 0 && a + 1 < argc) {
             perfOutputPath = argv[++a];
             printf("Output frame performance to '%s'\n", perfOutputPath);
+        } else if (_stricmp(argv[a], "-closed_form") == 0) {
+            gSettings.closedFormMotion = true;
+            printf("Closed-form asteroid motion\n");
+        } else if (_stricmp(argv[a], "-nocull") == 0) {
+            gSettings.cullAsteroids = false;
+            printf("Frustum culling disabled\n");
+        } else if (_stricmp(argv[a], "-flat_cull") == 0) {
+            gSettings.gridCulling = false;
+            printf("Spatial grid culling disabled\n");
+        } else if (_stricmp(argv[a], "-occlusion") == 0) {
+            gSettings.occlusionCulling = true;
+            printf("Occlusion culling enabled\n");
+        } else if (_stricmp(argv[a], "-nobucket") == 0) {
+            gSettings.bucketDrawList = false;
+            printf("Draw list bucketing disabled\n");
+        } else if (_stricmp(argv[a], "-front_to_back") == 0) {
+            gSettings.frontToBackDraws = true;
+            printf("Draws ordered front to back\n");
+        } else if (_stricmp(argv[a], "-job_threads") == 0 && a + 1 < argc) {
+            gSettings.jobThreads = (unsigned int) std::max(1, atoi(argv[++a]));
+            printf("%u job threads\n", gSettings.jobThreads);
+        } else if (_stricmp(argv[a], "-async_sim") == 0) {
+            gSettings.asyncSimulation = true;
+            printf("Simulation runs a frame ahead on its own thread\n");
+        } else if (_stricmp(argv[a], "-lod_table") == 0) {
+            gSettings.lodThresholdTable = true;
+            printf("LOD from resolution-aware distance thresholds\n");
+        } else if (_stricmp(argv[a], "-lod_triangles") == 0 && a + 1 < argc) {
+            gSettings.lodTriangleBudget = (unsigned int) std::max(0, atoi(argv[++a]));
+            printf("LOD budget of %u asteroid triangles\n", gSettings.lodTriangleBudget);
+        } else if (_stricmp(argv[a], "-lod_frame_ms") == 0 && a + 1 < argc) {
+            gSettings.lodFrameTimeBudgetMs = (float) atof(argv[++a]);
+            printf("LOD budget of %.2f ms per frame\n", gSettings.lodFrameTimeBudgetMs);
+        } else if (_stricmp(argv[a], "-sim_hz") == 0 && a + 1 < argc) {
+            gSettings.simulationHz = (unsigned int) std::max(0, atoi(argv[++a]));
+            printf("Simulation stepped at %u Hz\n", gSettings.simulationHz);
+        } else if (_stricmp(argv[a], "-amortize") == 0 && a + 1 < argc) {
+            gSettings.amortizeFarUpdates = true;
+            gSettings.amortizeInterval = (unsigned int) std::max(1, atoi(argv[++a]));
+            printf("Far asteroids fully updated every %u steps\n", gSettings.amortizeInterval);
+        } else if (_stricmp(argv[a], "-amortize_subdiv") == 0 && a + 1 < argc) {
+            gSettings.amortizeMaxSubdiv = (unsigned int) std::max(0, atoi(argv[++a]));
+            printf("Asteroids up to subdiv %u count as far\n", gSettings.amortizeMaxSubdiv);
+        } else if (_stricmp(argv[a], "-resort") == 0 && a + 1 < argc) {
+            gSettings.resortFrames = (unsigned int) std::max(0, atoi(argv[++a]));
+            printf("Asteroids re-sorted by position every %u frames\n", gSettings.resortFrames);
+        } else if (_stricmp(argv[a], "-collisions") == 0) {
+            gSettings.collisions = true;
+            printf("Asteroid collisions enabled\n");
+        } else if (_stricmp(argv[a], "-gravity") == 0) {
+            gSettings.gravity = true;
+            printf("N-body gravity enabled\n");
+        } else if (_stricmp(argv[a], "-sim_simd") == 0 && a + 1 < argc) {
+            ++a;
+            if      (_stricmp(argv[a], "scalar") == 0) gSettings.simdLevel = SIMD_LEVEL_SCALAR;
+            else if (_stricmp(argv[a], "sse41")  == 0) gSettings.simdLevel = SIMD_LEVEL_SSE41;
+            else if (_stricmp(argv[a], "avx2")   == 0) gSettings.simdLevel = SIMD_LEVEL_AVX2;
+            printf("Simulation SIMD limited to %s\n", SimdLevelName(gSettings.simdLevel));
+        } else if (_stricmp(argv[a], "-benchmark") == 0 && a + 1 < argc) {
+            benchmarkName = argv[++a];
+            printf("Run benchmark '%s'\n", benchmarkName);
         } else {
             fprintf(stderr, "error: unrecognized argument '%s'\n", argv[a]);
             fprintf(stderr, "usage: asteroids_d3d12 [options]\n");
@@ -342,10 +450,35 @@ int main(int argc, char** argv)
             fprintf(stderr, "  -perf_output [path]\n");
             fprintf(stderr, "  -warp\n");
             fprintf(stderr, "  -num_asteroids [count]\n");
+            fprintf(stderr, "  -closed_form\n");
+            fprintf(stderr, "  -nocull\n");
+            fprintf(stderr, "  -flat_cull\n");
+            fprintf(stderr, "  -occlusion\n");
+            fprintf(stderr, "  -nobucket\n");
+            fprintf(stderr, "  -front_to_back\n");
+            fprintf(stderr, "  -job_threads [count]\n");
+            fprintf(stderr, "  -async_sim\n");
+            fprintf(stderr, "  -lod_table\n");
+            fprintf(stderr, "  -lod_triangles [count]\n");
+            fprintf(stderr, "  -lod_frame_ms [ms]\n");
+            fprintf(stderr, "  -sim_hz [hz]\n");
+            fprintf(stderr, "  -amortize [steps]\n");
+            fprintf(stderr, "  -amortize_subdiv [level]\n");
+            fprintf(stderr, "  -resort [frames]\n");
+            fprintf(stderr, "  -collisions\n");
+            fprintf(stderr, "  -gravity\n");
+            fprintf(stderr, "  -sim_simd [scalar|sse41|avx2]\n");
+            fprintf(stderr, "  -benchmark [name]\n");
             return -1;
         }
     }
 
+    JobSystem::SetDefaultThreadCount(gSettings.jobThreads);
+
+    if (benchmarkName != nullptr) {
+        return RunBenchmark(benchmarkName, gSettings);
+    }
+
     if (!d3d11Available && !d3d12Available) {
         fprintf(stderr, "error: neither D3D11 nor D3D12 available.\n");
         return -1;
@@ -368,10 +501,11 @@ int main(int argc, char** argv)
     // Camera projection set up in WM_SIZE
 
     AsteroidsSimulation asteroids(1337, gSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    SimulationThread simulation(&asteroids);
 
     // Create workloads
     if (d3d11Available) {
-        gWorkloadD3D11 = new AsteroidsD3D11::Asteroids(&asteroids, &gGUI, gSettings.warp);
+        gWorkloadD3D11 = new AsteroidsD3D11::Asteroids(&simulation, &gGUI, gSettings.warp);
     }
 
     if (d3d12Available) {
@@ -395,7 +529,7 @@ int main(int argc, char** argv)
             }
         }
 
-        gWorkloadD3D12 = new AsteroidsD3D12::Asteroids(&asteroids, &gGUI, NUM_SUBSETS, adapter, gSettings.numAsteroids);
+        gWorkloadD3D12 = new AsteroidsD3D12::Asteroids(&simulation, &gGUI, NUM_SUBSETS, adapter, gSettings.numAsteroids);
     }
     gSettings.d3d12 = (gWorkloadD3D12 != nullptr);
 
@@ -447,7 +581,11 @@ int main(int argc, char** argv)
         if (perfOutputFp == nullptr) {
             fprintf(stderr, "warning: failed to open performance output file '%s'\n", perfOutputPath);
         } else {
-            fprintf(perfOutputFp, "Frame time (ms),\n");
+            fprintf(perfOutputFp, "Frame time (ms),Triangles,LOD bias,LOD error,");
+            for (unsigned int subdiv = 0; subdiv <= MESH_MAX_SUBDIV_LEVELS; ++subdiv) {
+                fprintf(perfOutputFp, "Draws at subdiv %u,", subdiv);
+            }
+            fprintf(perfOutputFp, "\n");
         }
     }
 
@@ -517,7 +655,15 @@ int main(int argc, char** argv)
         // Update GUI
         {
             char buffer[256];
-            sprintf(buffer, "Asteroids D3D1%c - %4.1f ms", gSettings.d3d12 ? '2' : '1', 1000.f * frameTime);
+            auto stats = simulation.LastFrameStats();
+            auto length = sprintf(buffer, "Asteroids D3D1%c - %4.1f ms - %u drawn, %u culled", gSettings.d3d12 ? '2' : '1',
+                                  1000.f * frameTime, stats.visible, stats.culled);
+            if (gSettings.occlusionCulling) {
+                length += sprintf(buffer + length, " (%u occluded by %u, %.2f ms)", stats.occluded, stats.occluders, stats.occlusionMs);
+            }
+            if (stats.lodGovernor.active) {
+                sprintf(buffer + length, " - %.2fM tris, LOD bias %+.2f", stats.triangles * 1e-6f, stats.lodGovernor.bias);
+            }
             SetWindowText(hWnd, buffer);
 
             if (gSettings.lockFrameRate) {
@@ -531,14 +677,23 @@ int main(int argc, char** argv)
             gD3D11Control->Visible(!gSettings.d3d12);
         }
 
+        // A fixed-step simulation keeps its own time, so feed it the real elapsed time; smoothing
+        // would only make it drift behind
+        auto simulationTime = gSettings.simulationHz > 0 ? rawFrameTime : frameTime;
         if (gSettings.d3d12) {
-            gWorkloadD3D12->Render((float)frameTime, gCamera, gSettings);
+            gWorkloadD3D12->Render((float)simulationTime, gCamera, gSettings);
         } else {
-            gWorkloadD3D11->Render((float)frameTime, gCamera, gSettings);
+            gWorkloadD3D11->Render((float)simulationTime, gCamera, gSettings);
         }
 
         if (perfOutputFp != nullptr) {
-            fprintf(perfOutputFp, "%lf,\n", 1000.0 * frameTime);
+            auto stats = simulation.LastFrameStats();
+            fprintf(perfOutputFp, "%lf,%u,%f,%f,", 1000.0 * frameTime, stats.triangles,
+                    stats.lodGovernor.bias, stats.lodGovernor.error);
+            for (auto draws : stats.drawsPerSubdiv) {
+                fprintf(perfOutputFp, "%u,", draws);
+            }
+            fprintf(perfOutputFp, "\n");
         }
 
         if (gSettings.lockFrameRate) {
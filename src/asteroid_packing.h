@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <emmintrin.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include <cmath>
+
+// Compact encodings for the static asteroid streams. The simulation only ever sees the decoded
+// values, so the scalar path, the SIMD kernels and the renderers all agree exactly.
+
+// fp16 for values known to be finite and well inside half range. Magnitudes below the smallest
+// normal half are flushed to zero so decoding never produces float denormals.
+inline uint16_t PackHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude < 0x38800000) return (uint16_t)sign;           // < 2^-14
+    if (magnitude >= 0x477FF000) return (uint16_t)(sign | 0x7BFF); // Clamp to 65504
+    magnitude += 0x0FFF + ((magnitude >> 13) & 1);                 // Round to nearest even
+    return (uint16_t)(sign | ((magnitude - 0x38000000) >> 13));
+}
+
+// Shift the exponent and mantissa into place and rebias the exponent with a multiply by 2^112;
+// the SIMD kernels do the same
+inline float UnpackHalf(uint16_t half)
+{
+    uint32_t bits = (uint32_t)(half & 0x7FFF) << 13;
+    float magnitude;
+    memcpy(&magnitude, &bits, sizeof(magnitude));
+    return (half & 0x8000) ? -(magnitude * 5.192296858534828e33f) : magnitude * 5.192296858534828e33f;
+}
+
+// Four consecutive values, for the SSE culling path
+inline DirectX::XMVECTOR UnpackHalf4(const uint16_t* half)
+{
+    auto h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)half), _mm_setzero_si128());
+    auto magnitude = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 13));
+    auto sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+    return _mm_or_ps(_mm_mul_ps(magnitude, _mm_set1_ps(5.192296858534828e33f)), sign);
+}
+
+// Unit vector as two snorm16 octahedral coordinates, u in the low half and v in the high half
+inline uint32_t PackOctahedral(float x, float y, float z)
+{
+    float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+    float u = x / l1;
+    float v = y / l1;
+    if (z < 0.0f) {
+        float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    auto qu = (int16_t)std::lround(u * 32767.0f);
+    auto qv = (int16_t)std::lround(v * 32767.0f);
+    return (uint32_t)(uint16_t)qu | ((uint32_t)(uint16_t)qv << 16);
+}
+
+// Unfold the lower hemisphere by moving each coordinate toward zero by the overshoot, then
+// normalize; the SIMD kernels follow the same steps in the same order
+inline DirectX::XMVECTOR UnpackOctahedral(uint32_t packed)
+{
+    float x = (float)(int16_t)(packed & 0xFFFF) * (1.0f / 32767.0f);
+    float y = (float)(int16_t)(packed >> 16) * (1.0f / 32767.0f);
+    float z = 1.0f - std::abs(x) - std::abs(y);
+    float t = std::max(-z, 0.0f);
+    x -= std::copysign(t, x);
+    y -= std::copysign(t, y);
+    float length = std::sqrt(x * x + y * y + z * z);
+    return DirectX::XMVectorSet(x / length, y / length, z / length, 0.0f);
+}
+
+// Snorm8 pair (R8G8_SNORM, u in the low byte), clamped as the hardware does and unfolded like UnpackOctahedral
+inline DirectX::XMVECTOR UnpackOctahedral8(uint16_t packed)
+{
+    float x = std::max((float)(int8_t)(packed & 0xFF) * (1.0f / 127.0f), -1.0f);
+    float y = std::max((float)(int8_t)(packed >> 8) * (1.0f / 127.0f), -1.0f);
+    float z = 1.0f - std::abs(x) - std::abs(y);
+    float t = std::max(-z, 0.0f);
+    x -= std::copysign(t, x);
+    y -= std::copysign(t, y);
+    float length = std::sqrt(x * x + y * y + z * z);
+    return DirectX::XMVectorSet(x / length, y / length, z / length, 0.0f);
+}
+
+// Eight bits leave little margin, so each corner of the quantization cell is tried and the one
+// that decodes closest to the input kept
+inline uint16_t PackOctahedral8(float x, float y, float z)
+{
+    float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+    float u = x / l1;
+    float v = y / l1;
+    if (z < 0.0f) {
+        float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    auto input = DirectX::XMVectorSet(x, y, z, 0.0f);
+    float fu = std::floor(u * 127.0f);
+    float fv = std::floor(v * 127.0f);
+    uint16_t best = 0;
+    float bestDot = -FLT_MAX;
+    for (int corner = 0; corner < 4; ++corner) {
+        auto qu = (int8_t)std::min(fu + (float)(corner & 1), 127.0f);
+        auto qv = (int8_t)std::min(fv + (float)(corner >> 1), 127.0f);
+        auto packed = (uint16_t)((uint16_t)(uint8_t)qu | ((uint16_t)(uint8_t)qv << 8));
+        float dot = DirectX::XMVectorGetX(DirectX::XMVector3Dot(input, UnpackOctahedral8(packed)));
+        if (dot > bestDot) {
+            bestDot = dot;
+            best = packed;
+        }
+    }
+    return best;
+}
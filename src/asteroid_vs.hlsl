@@ -18,15 +18,18 @@ cbuffer DrawConstantBuffer : register(b0)
 {
     float4x4 mWorld;
     float4x4 mViewProjection;
-    float4 mSurfaceColor;
+    float3 mSurfaceColor;
+    float mRadiusScale; // Mesh instance's largest radius; vertex radii are fractions of it
     float4 mDeepColor;
     uint mTextureIndex;
 };
 
+// Directions are shared by every mesh instance; radius and normal come from the instance's stream
 struct VSIn
 {
-    float3 position : POSITION;
-    float3 normal   : NORMAL;
+    float3 direction : POSITION;
+    float  radius    : RADIUS;    // unorm16
+    float2 normalOct : NORMAL;    // Octahedral snorm8x2
 };
 
 struct VSOut
@@ -42,18 +45,30 @@ float linstep(float min, float max, float s)
     return saturate((s - min) / (max - min));
 }
 
+// Matches UnpackOctahedral8 in asteroid_packing.h; the snorm fetch already clamps -128 to -1
+float3 octahedral_decode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.xy -= float2(n.x >= 0.0f ? t : -t, n.y >= 0.0f ? t : -t);
+    return normalize(n);
+}
+
 
 VSOut asteroid_vs(VSIn input)
 {
     VSOut output;
 
-    float3 positionWorld = mul(mWorld, float4(input.position, 1.0f)).xyz;
+    float3 position = input.direction * (input.radius * mRadiusScale);
+    float3 normal = octahedral_decode(input.normalOct);
+
+    float3 positionWorld = mul(mWorld, float4(position, 1.0f)).xyz;
     output.position = mul(mViewProjection, float4(positionWorld, 1.0f));
 
-    output.positionModel = input.position;
-    output.normalWorld = mul(mWorld, float4(input.normal, 0.0f)).xyz; // No non-uniform scaling
+    output.positionModel = position;
+    output.normalWorld = mul(mWorld, float4(normal, 0.0f)).xyz; // No non-uniform scaling
 
-    float depth = linstep(0.5f, 0.7f, length(input.position.xyz));
+    float depth = linstep(0.5f, 0.7f, length(position));
     output.albedo = lerp(mDeepColor.xyz, mSurfaceColor.xyz, depth);
 
     return output;
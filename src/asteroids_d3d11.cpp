@@ -47,8 +47,9 @@ using namespace DirectX;
 
 namespace AsteroidsD3D11 {
 
-Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI* gui, bool warp)
-    : mAsteroids(asteroids)
+Asteroids::Asteroids(SimulationThread* simulation, GUI* gui, bool warp)
+    : mSimulation(simulation)
+    , mAsteroids(simulation->Asteroids())
     , mGUI(gui)
     , mSwapChain(nullptr)
     , mDevice(nullptr)
@@ -59,6 +60,7 @@ Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI* gui, bool warp)
     , mDepthStencilState(nullptr)
     , mInputLayout(nullptr)
     , mIndexBuffer(nullptr)
+    , mDirectionBuffer(nullptr)
     , mVertexBuffer(nullptr)
     , mVertexShader(nullptr)
     , mPixelShader(nullptr)
@@ -101,7 +103,8 @@ Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI* gui, bool warp)
     {
         D3D11_INPUT_ELEMENT_DESC inputDesc[] = {
             { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "NORMAL",   0, DXGI_FORMAT_R8G8_SNORM,      1,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "RADIUS",   0, DXGI_FORMAT_R16_UNORM,       1,  2, D3D11_INPUT_PER_VERTEX_DATA, 0 },
         };
 
         ThrowIfFailed(mDevice->CreateInputLayout(inputDesc, ARRAYSIZE(inputDesc),
@@ -205,6 +208,7 @@ Asteroids::~Asteroids()
     SafeRelease(&mDepthStencilState);
     SafeRelease(&mInputLayout);
     SafeRelease(&mIndexBuffer);
+    SafeRelease(&mDirectionBuffer);
     SafeRelease(&mVertexBuffer);
     SafeRelease(&mVertexShader);
     SafeRelease(&mPixelShader);
@@ -339,6 +343,19 @@ void Asteroids::CreateMeshes()
 {
     auto asteroidMeshes = mAsteroids->Meshes();
 
+    // create direction buffer
+    {
+        CD3D11_BUFFER_DESC desc(
+            (UINT)asteroidMeshes->directions.size() * sizeof(asteroidMeshes->directions[0]),
+            D3D11_BIND_VERTEX_BUFFER,
+            D3D11_USAGE_DEFAULT);
+
+        D3D11_SUBRESOURCE_DATA data = {};
+        data.pSysMem = asteroidMeshes->directions.data();
+
+        ThrowIfFailed(mDevice->CreateBuffer(&desc, &data, &mDirectionBuffer));
+    }
+
     // create vertex buffer
     {
         CD3D11_BUFFER_DESC desc(
@@ -405,7 +422,8 @@ void Asteroids::InitializeTextureData()
     textureDesc.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
 
     for (UINT t = 0; t < NUM_UNIQUE_TEXTURES; ++t) {
-        ThrowIfFailed(mDevice->CreateTexture2D(&textureDesc, mAsteroids->TextureData(t), &mTextures[t]));
+        auto initialData = D3D11SubresourceData(mAsteroids->TextureData(t), mAsteroids->TextureSubresourceCount());
+        ThrowIfFailed(mDevice->CreateTexture2D(&textureDesc, initialData.data(), &mTextures[t]));
         ThrowIfFailed(mDevice->CreateShaderResourceView(mTextures[t], nullptr, &mTextureSRVs[t]));
     }
 }
@@ -445,11 +463,7 @@ void Asteroids::Render(float frameTime, const OrbitCamera& camera, const Setting
     ProfileBeginRender();
 
     // Frame data
-    ProfileBeginSimUpdate();
-    mAsteroids->Update(frameTime, camera.Eye(), settings);
-    auto staticAsteroidData = mAsteroids->StaticData();
-    auto dynamicAsteroidData = mAsteroids->DynamicData();
-    ProfileEndSimUpdate();
+    auto const& simFrame = mSimulation->Simulate(frameTime, camera.Eye(), camera.ViewProjection(), settings, false);
     
     // Clear the render target
     float clearcol[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -457,12 +471,14 @@ void Asteroids::Render(float frameTime, const OrbitCamera& camera, const Setting
     mDeviceCtxt->ClearDepthStencilView(mDepthStencilView, D3D11_CLEAR_DEPTH, 0.0f, 0);
 
     {
-        ID3D11Buffer* ia_buffers[] = { mVertexBuffer };
-        UINT ia_strides[] = { sizeof(Vertex) };
-        UINT ia_offsets[] = { 0 };
+        // Base vertex would offset the shared directions too, so the per-instance stream is
+        // rebound at the instance's offset for each draw instead
+        ID3D11Buffer* ia_buffers[] = { mDirectionBuffer, mVertexBuffer };
+        UINT ia_strides[] = { sizeof(XMFLOAT3), sizeof(RadialVertex) };
+        UINT ia_offsets[] = { 0, 0 };
         mDeviceCtxt->IASetInputLayout(mInputLayout);
         mDeviceCtxt->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        mDeviceCtxt->IASetVertexBuffers(0, 1, ia_buffers, ia_strides, ia_offsets);
+        mDeviceCtxt->IASetVertexBuffers(0, 2, ia_buffers, ia_strides, ia_offsets);
         mDeviceCtxt->IASetIndexBuffer(mIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     }
 
@@ -481,26 +497,37 @@ void Asteroids::Render(float frameTime, const OrbitCamera& camera, const Setting
 
     ProfileBeginRenderSubset();
 
+    // With a bucketed draw list textures change at most once per bucket
     auto viewProjection = camera.ViewProjection();
-    for (UINT drawIdx = 0; drawIdx < settings.numAsteroids; ++drawIdx)
+    UINT boundTexture = UINT_MAX;
+    for (size_t i = 0; i < simFrame.drawList.indices.size(); ++i)
     {
-        auto staticData = &staticAsteroidData[drawIdx];
-        auto dynamicData = &dynamicAsteroidData[drawIdx];
+        UINT drawIdx = simFrame.drawList.indices[i];
+        UINT subdiv = simFrame.subdiv[i];
 
         D3D11_MAPPED_SUBRESOURCE mapped = {};
         ThrowIfFailed(mDeviceCtxt->Map(mDrawConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
 
         auto drawConstants = (DrawConstantBuffer*) mapped.pData;
-        XMStoreFloat4x4(&drawConstants->mWorld,          dynamicData->world);
+        XMStoreFloat4x4(&drawConstants->mWorld,          XMLoadFloat4x3(&simFrame.world[i]));
         XMStoreFloat4x4(&drawConstants->mViewProjection, viewProjection);
-        drawConstants->mSurfaceColor = staticData->surfaceColor;
-        drawConstants->mDeepColor    = staticData->deepColor;
+        drawConstants->mSurfaceColor = mAsteroids->SurfaceColor(drawIdx);
+        drawConstants->mRadiusScale  = mAsteroids->RadiusScale(drawIdx);
+        drawConstants->mDeepColor    = mAsteroids->DeepColor(drawIdx);
 
         mDeviceCtxt->Unmap(mDrawConstantBuffer, 0);
 
-        mDeviceCtxt->PSSetShaderResources(0, 1, &mTextureSRVs[staticData->textureIndex]);
+        auto textureIndex = mAsteroids->TextureIndex(drawIdx);
+        if (textureIndex != boundTexture) {
+            mDeviceCtxt->PSSetShaderResources(0, 1, &mTextureSRVs[textureIndex]);
+            boundTexture = textureIndex;
+        }
+
+        UINT vertexStride = sizeof(RadialVertex);
+        UINT vertexOffset = mAsteroids->VertexStart(drawIdx) * vertexStride;
+        mDeviceCtxt->IASetVertexBuffers(1, 1, &mVertexBuffer, &vertexStride, &vertexOffset);
 
-        mDeviceCtxt->DrawIndexedInstanced(dynamicData->indexCount, 1, dynamicData->indexStart, staticData->vertexStart, 0);
+        mDeviceCtxt->DrawIndexedInstanced(mAsteroids->SubdivIndexCount(subdiv), 1, mAsteroids->SubdivIndexStart(subdiv), 0, 0);
     }
 
     ProfileEndRenderSubset();
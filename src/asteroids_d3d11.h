@@ -25,6 +25,7 @@
 #include "camera.h"
 #include "settings.h"
 #include "simulation.h"
+#include "simulation_thread.h"
 #include "util.h"
 #include "gui.h"
 
@@ -34,7 +35,7 @@ struct DrawConstantBuffer {
     DirectX::XMFLOAT4X4 mWorld;
     DirectX::XMFLOAT4X4 mViewProjection;
     DirectX::XMFLOAT3 mSurfaceColor;
-    float unused0;
+    float mRadiusScale;
     DirectX::XMFLOAT3 mDeepColor;
     float unused1;
 };
@@ -45,7 +46,7 @@ struct SkyboxConstantBuffer {
 
 class Asteroids {
 public:
-    Asteroids(AsteroidsSimulation* asteroids, GUI* gui, bool warp);
+    Asteroids(SimulationThread* simulation, GUI* gui, bool warp);
     ~Asteroids();
 
     void Render(float frameTime, const OrbitCamera& camera, const Settings& settings);
@@ -58,6 +59,7 @@ private:
     void InitializeTextureData();
     void CreateGUIResources();
 
+    SimulationThread*           mSimulation = nullptr;
     AsteroidsSimulation*        mAsteroids = nullptr;
     GUI*                        mGUI = nullptr;
 
@@ -78,7 +80,8 @@ private:
 
     ID3D11InputLayout*          mInputLayout = nullptr;
     ID3D11Buffer*               mIndexBuffer = nullptr;
-    ID3D11Buffer*               mVertexBuffer = nullptr;
+    ID3D11Buffer*               mDirectionBuffer = nullptr; // Shared by all mesh instances
+    ID3D11Buffer*               mVertexBuffer = nullptr;    // Per-instance radius and normal
     ID3D11VertexShader*         mVertexShader = nullptr;
     ID3D11PixelShader*          mPixelShader = nullptr;
     ID3D11Buffer*               mDrawConstantBuffer = nullptr;
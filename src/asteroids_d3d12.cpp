@@ -25,9 +25,9 @@
 #include <limits>
 #include <random>
 #include <sstream>
-#include <ppl.h>
 
 #include "asteroids_d3d12.h"
+#include "job_system.h"
 #include "util.h"
 #include "mesh.h"
 #include "noise.h"
@@ -55,8 +55,9 @@ enum RootParameters
     RP_SMP,
 };
 
-Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI *gui, UINT minCmdLsts, IDXGIAdapter* adapter, UINT asteroidCount)
-    : mAsteroids(asteroids)
+Asteroids::Asteroids(SimulationThread* simulation, GUI *gui, UINT minCmdLsts, IDXGIAdapter* adapter, UINT asteroidCount)
+    : mSimulation(simulation)
+    , mAsteroids(simulation->Asteroids())
     , mGUI(gui)
     , mFenceEventHandle(CreateEvent(NULL, FALSE, FALSE, NULL))
 {
@@ -125,7 +126,8 @@ Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI *gui, UINT minCmdLsts,
             ));
             textureDesc = mAsteroidTextures[i]->GetDesc();
 
-            InitializeTexture2D(mDevice, mCommandQueue, mAsteroidTextures[i], &textureDesc, 4, mAsteroids->TextureData(i));
+            auto initialData = D3D11SubresourceData(mAsteroids->TextureData(i), mAsteroids->TextureSubresourceCount());
+            InitializeTexture2D(mDevice, mCommandQueue, mAsteroidTextures[i], &textureDesc, 4, initialData.data());
 
             // Append a descriptor to the heap
             mSRVDescs->AppendSRV(mAsteroidTextures[i]);
@@ -187,18 +189,18 @@ Asteroids::Asteroids(AsteroidsSimulation* asteroids, GUI *gui, UINT minCmdLsts,
         frame->mDrawConstantBuffersGPUVA = dynamicUploadGPUVA + DrawConstantBuffersOffset;
 
         // Set any static asteroid data now
-        auto staticData = mAsteroids->StaticData();
         for (unsigned int j = 0; j < asteroidCount; ++j) {
             auto constants = &frame->mDrawConstantBuffersWO[j];
-            constants->mSurfaceColor = staticData[j].surfaceColor;
-            constants->mDeepColor = staticData[j].deepColor;
-            constants->mTextureIndex = staticData[j].textureIndex;
+            constants->mSurfaceColor = mAsteroids->SurfaceColor(j);
+            constants->mRadiusScale = mAsteroids->RadiusScale(j);
+            constants->mDeepColor = mAsteroids->DeepColor(j);
+            constants->mTextureIndex = mAsteroids->TextureIndex(j);
 
             auto indirectDraw = &frame->mExecuteIndirectArgsWO[j];
             indirectDraw->mConstantBuffer = frame->mDrawConstantBuffersGPUVA + sizeof(DrawConstantBuffer) * j;
             indirectDraw->mDrawIndexed.InstanceCount = 1;
             indirectDraw->mDrawIndexed.StartInstanceLocation = 0;
-            indirectDraw->mDrawIndexed.BaseVertexLocation = staticData[j].vertexStart;
+            indirectDraw->mDrawIndexed.BaseVertexLocation = 0;
         }
 
         // Dynamic sprite vertices
@@ -479,10 +481,12 @@ void Asteroids::CreatePSOs()
 
     // Command signature
     {
-        D3D12_INDIRECT_ARGUMENT_DESC args[2] = {};
+        D3D12_INDIRECT_ARGUMENT_DESC args[3] = {};
         args[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
         args[0].ConstantBufferView.RootParameterIndex = RP_DRAW_CBV;
-        args[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+        args[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+        args[1].VertexBuffer.Slot = 1;
+        args[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
 
         D3D12_COMMAND_SIGNATURE_DESC desc;
         desc.ByteStride = sizeof(ExecuteIndirectArgs);
@@ -510,7 +514,8 @@ void Asteroids::CreatePSOs()
     // asteroid pipeline state
     D3D12_INPUT_ELEMENT_DESC asteroidInputDesc[] = {
             { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "NORMAL", 0, DXGI_FORMAT_R8G8_SNORM, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "RADIUS", 0, DXGI_FORMAT_R16_UNORM, 1, 2, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
     D3D12_GRAPHICS_PIPELINE_STATE_DESC asteroidDesc = defaultDesc;
     asteroidDesc.pRootSignature = mAsteroidsRootSignature;
@@ -548,7 +553,7 @@ void Asteroids::CreatePSOs()
     D3D12_GRAPHICS_PIPELINE_STATE_DESC fontDesc = spriteDesc;
     fontDesc.PS = { g_font_ps, sizeof(g_font_ps) };
 
-    concurrency::parallel_invoke(
+    jobs::parallel_invoke(
         [&] { ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&asteroidDesc, IID_PPV_ARGS(&mAsteroidPSO))); },
         [&] { ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&skyboxDesc,   IID_PPV_ARGS(&mSkyboxPSO)));   },
         [&] { ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&spriteDesc,   IID_PPV_ARGS(&mSpritePSO)));   },
@@ -565,7 +570,6 @@ void Asteroids::CreateSubsets(UINT numHeapsPerFrame, UINT asteroidCount)
     if (numHeapsPerFrame > 0) {
         std::cout << "Using " << numHeapsPerFrame << " subsets per frame." << std::endl;
 
-        mDrawsPerSubset = (asteroidCount + numHeapsPerFrame - 1) / numHeapsPerFrame;
         mSubsetCount = numHeapsPerFrame;
 
         for (UINT f = 0; f < NUM_FRAMES_TO_BUFFER; f++) {
@@ -595,7 +599,6 @@ void Asteroids::ReleaseSubsets()
     }
 
     mSubsetCount = 0;
-    mDrawsPerSubset = 0;
 }
 
 
@@ -606,11 +609,13 @@ void Asteroids::CreateMeshes()
     CreateSkyboxMesh(&skyboxVertices);
 
     // Simple linear allocate
+    UINT64 asteroidDBSize = asteroidMeshes->directions.size() * sizeof(asteroidMeshes->directions[0]);
     UINT64 asteroidVBSize = asteroidMeshes->vertices.size() * sizeof(asteroidMeshes->vertices[0]);
     UINT64 asteroidIBSize = asteroidMeshes->indices.size()  * sizeof(asteroidMeshes->indices[0]);
     UINT64 skyboxVBSize = skyboxVertices.size() * sizeof(SkyboxVertex);
 
-    UINT64 asteroidVBOffset = 0;
+    UINT64 asteroidDBOffset = 0;
+    UINT64 asteroidVBOffset = asteroidDBOffset + asteroidDBSize;
     UINT64 asteroidIBOffset = asteroidVBOffset + asteroidVBSize;
     UINT64 skyboxVBOffset   = asteroidIBOffset + asteroidIBSize;
     UINT64 totalSize = skyboxVBOffset + skyboxVBSize;
@@ -619,7 +624,16 @@ void Asteroids::CreateMeshes()
     auto bufferWO = (BYTE*)mMeshUpload->DataWO();
     auto gpuVA = mMeshUpload->Heap()->GetGPUVirtualAddress();
 
-    // Asteroid vertices
+    // Asteroid directions, shared by all mesh instances
+    {
+        memcpy(bufferWO + asteroidDBOffset, asteroidMeshes->directions.data(), asteroidDBSize);
+
+        mAsteroidDirectionBufferView.BufferLocation = gpuVA + asteroidDBOffset;
+        mAsteroidDirectionBufferView.SizeInBytes    = static_cast<UINT>(asteroidDBSize);
+        mAsteroidDirectionBufferView.StrideInBytes  = sizeof(asteroidMeshes->directions[0]);
+    }
+
+    // Asteroid vertices; draws bind a view of their own instance's slice
     {
         memcpy(bufferWO + asteroidVBOffset, asteroidMeshes->vertices.data(), asteroidVBSize);
 
@@ -648,6 +662,15 @@ void Asteroids::CreateMeshes()
 }
 
 
+D3D12_VERTEX_BUFFER_VIEW Asteroids::AsteroidVertexBufferView(UINT drawIdx) const
+{
+    D3D12_VERTEX_BUFFER_VIEW view = mAsteroidVertexBufferView;
+    view.BufferLocation += mAsteroids->VertexStart(drawIdx) * sizeof(RadialVertex);
+    view.SizeInBytes     = mAsteroids->VertexCountPerMesh() * sizeof(RadialVertex);
+    return view;
+}
+
+
 void Asteroids::CreateGUIResources()
 {
     auto font = mGUI->Font();
@@ -701,29 +724,24 @@ void Asteroids::WaitForReadyToRender()
 
 void Asteroids::RenderSubset(
     D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView,
-    size_t frameIndex, float frameTime,
+    size_t frameIndex,
     SubsetD3D12* subset, UINT subsetIdx,
-    XMVECTOR cameraEye, XMMATRIX viewProjection,
+    XMMATRIX viewProjection,
     const Settings& settings)
 {
     ProfileBeginRenderSubset();
 
-    UINT drawStart = mDrawsPerSubset * subsetIdx;
-    UINT drawEnd = std::min(drawStart + mDrawsPerSubset, settings.numAsteroids);
-    assert(drawStart < drawEnd);
+    // Each subset records an even share of the frame's draw list
+    auto const& drawList = mSimFrame->drawList;
+    UINT drawCount = (UINT)drawList.indices.size();
+    UINT drawStart = (UINT)((UINT64)drawCount * subsetIdx / mSubsetCount);
+    UINT drawEnd = (UINT)((UINT64)drawCount * (subsetIdx + 1) / mSubsetCount);
 
     // Frame data
     auto frame = &mFrame[frameIndex];
     auto drawConstantBuffers = frame->mDrawConstantBuffersWO;
     auto indirectArgs = frame->mExecuteIndirectArgsWO;
 
-    // Update asteroid simulation
-    ProfileBeginSimUpdate();
-    mAsteroids->Update(frameTime, cameraEye, settings, drawStart, drawEnd - drawStart);
-    auto staticAsteroidData = mAsteroids->StaticData();
-    auto dynamicAsteroidData = mAsteroids->DynamicData();
-    ProfileEndSimUpdate();
-
     auto cmdLst = subset->Begin(mAsteroidPSO);
 
     // Root signature and common bindings
@@ -733,7 +751,7 @@ void Asteroids::RenderSubset(
 
     // Common state
     cmdLst->IASetIndexBuffer(&mAsteroidIndexBufferView);
-    cmdLst->IASetVertexBuffers(0, 1, &mAsteroidVertexBufferView);
+    cmdLst->IASetVertexBuffers(0, 1, &mAsteroidDirectionBufferView);
     cmdLst->RSSetViewports(1, &mViewPort);
     cmdLst->RSSetScissorRects(1, &mScissorRect);
     cmdLst->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -743,21 +761,25 @@ void Asteroids::RenderSubset(
     cmdLst->SetGraphicsRootDescriptorTable(RP_TEX_SRV, mSRVDescs->GPU(0));
     cmdLst->SetGraphicsRootDescriptorTable(RP_SMP, mSampler);
 
+    // Constant buffers stay indexed by asteroid; only the visible ones are written and drawn
     if (settings.executeIndirect)
     {
         // ExecuteIndirect path
+        // Arguments are packed in draw list order so the visible draws are contiguous
         if (drawStart < drawEnd)
         {
-            for (UINT drawIdx = drawStart; drawIdx < drawEnd; ++drawIdx)
+            for (UINT i = drawStart; i < drawEnd; ++i)
             {
-                auto dynamicData = &dynamicAsteroidData[drawIdx];
-
-                XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mWorld, dynamicData->world);
+                UINT drawIdx = drawList.indices[i];
+                UINT subdiv = mSimFrame->subdiv[i];
+                XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mWorld, XMLoadFloat4x3(&mSimFrame->world[i]));
                 XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mViewProjection, viewProjection);
 
-                auto drawIndexed = &indirectArgs[drawIdx].mDrawIndexed;
-                drawIndexed->IndexCountPerInstance = dynamicData->indexCount;
-                drawIndexed->StartIndexLocation = dynamicData->indexStart;
+                auto indirectDraw = &indirectArgs[i];
+                indirectDraw->mConstantBuffer = frame->mDrawConstantBuffersGPUVA + sizeof(DrawConstantBuffer) * drawIdx;
+                indirectDraw->mVertexBuffer = AsteroidVertexBufferView(drawIdx);
+                indirectDraw->mDrawIndexed.IndexCountPerInstance = mAsteroids->SubdivIndexCount(subdiv);
+                indirectDraw->mDrawIndexed.StartIndexLocation = mAsteroids->SubdivIndexStart(subdiv);
             }
 
             UINT64 offset = (BYTE*)(&indirectArgs[drawStart]) - (BYTE*)frame->mDynamicUpload->DataWO();
@@ -769,20 +791,21 @@ void Asteroids::RenderSubset(
     else
     {
         // Standard draw path
-        auto constantsPointer = frame->mDrawConstantBuffersGPUVA + sizeof(DrawConstantBuffer) * drawStart;
-        for (UINT drawIdx = drawStart; drawIdx < drawEnd; ++drawIdx)
+        for (UINT i = drawStart; i < drawEnd; ++i)
         {
-            auto staticData = &staticAsteroidData[drawIdx];
-            auto dynamicData = &dynamicAsteroidData[drawIdx];
-
-            XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mWorld, dynamicData->world);
+            UINT drawIdx = drawList.indices[i];
+            UINT subdiv = mSimFrame->subdiv[i];
+            XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mWorld, XMLoadFloat4x3(&mSimFrame->world[i]));
             XMStoreFloat4x4(&drawConstantBuffers[drawIdx].mViewProjection, viewProjection);
 
             // Set root cbuffer
-            cmdLst->SetGraphicsRootConstantBufferView(RP_DRAW_CBV, constantsPointer);
-            constantsPointer += sizeof(DrawConstantBuffer);
+            cmdLst->SetGraphicsRootConstantBufferView(RP_DRAW_CBV,
+                frame->mDrawConstantBuffersGPUVA + sizeof(DrawConstantBuffer) * drawIdx);
+
+            auto vertexBuffer = AsteroidVertexBufferView(drawIdx);
+            cmdLst->IASetVertexBuffers(1, 1, &vertexBuffer);
 
-            cmdLst->DrawIndexedInstanced(dynamicData->indexCount, 1, dynamicData->indexStart, staticData->vertexStart, 0);
+            cmdLst->DrawIndexedInstanced(mAsteroids->SubdivIndexCount(subdiv), 1, mAsteroids->SubdivIndexStart(subdiv), 0, 0);
         }
     }
 
@@ -806,19 +829,23 @@ void Asteroids::Render(float frameTime, const OrbitCamera& camera, const Setting
 
     ProfileBeginRender();
 
+    // The simulated frame's draw list is split across the subsets for recording
+    mSimFrame = &mSimulation->Simulate(frameTime, camera.Eye(), camera.ViewProjection(), settings,
+                                       settings.multithreadedRendering);
+
     // Generate command lists
     if (settings.multithreadedRendering)
     {
-        concurrency::parallel_for<UINT>(0, mSubsetCount, [&](UINT subsetIdx) {
-            RenderSubset(swapChainBuffer->mRenderTargetView, mCurrentFrameIndex, frameTime,
-                frame->mSubsets[subsetIdx], subsetIdx, camera.Eye(), camera.ViewProjection(), settings);
+        jobs::parallel_for<UINT>(0, mSubsetCount, [&](UINT subsetIdx) {
+            RenderSubset(swapChainBuffer->mRenderTargetView, mCurrentFrameIndex,
+                frame->mSubsets[subsetIdx], subsetIdx, camera.ViewProjection(), settings);
         });
     }
     else
     {
         for (unsigned int subsetIdx = 0; subsetIdx < mSubsetCount; ++subsetIdx) {
-            RenderSubset(swapChainBuffer->mRenderTargetView, mCurrentFrameIndex, frameTime,
-                frame->mSubsets[subsetIdx], subsetIdx, camera.Eye(), camera.ViewProjection(), settings);
+            RenderSubset(swapChainBuffer->mRenderTargetView, mCurrentFrameIndex,
+                frame->mSubsets[subsetIdx], subsetIdx, camera.ViewProjection(), settings);
         }
     }
 
@@ -27,6 +27,7 @@
 #include "camera.h"
 #include "settings.h"
 #include "simulation.h"
+#include "simulation_thread.h"
 #include "subset_d3d12.h"
 #include "descriptor.h"
 #include "upload_heap.h"
@@ -39,7 +40,7 @@ CBUFFER_ALIGN struct DrawConstantBuffer {
     DirectX::XMFLOAT4X4 mWorld;
     DirectX::XMFLOAT4X4 mViewProjection;
     DirectX::XMFLOAT3 mSurfaceColor;
-    float unused0;
+    float mRadiusScale;
     DirectX::XMFLOAT3 mDeepColor;
     float unused1;
     UINT mTextureIndex;
@@ -51,12 +52,13 @@ CBUFFER_ALIGN struct SkyboxConstantBuffer {
 
 struct ExecuteIndirectArgs {
     D3D12_GPU_VIRTUAL_ADDRESS mConstantBuffer;
+    D3D12_VERTEX_BUFFER_VIEW mVertexBuffer; // Slot 1, the asteroid's slice of the per-instance stream
     D3D12_DRAW_INDEXED_ARGUMENTS mDrawIndexed;
 };
 
 class Asteroids {
 public:
-    Asteroids(AsteroidsSimulation* asteroids, GUI *gui, UINT minCmdLsts, IDXGIAdapter* adapter, UINT asteroidCount);
+    Asteroids(SimulationThread* simulation, GUI *gui, UINT minCmdLsts, IDXGIAdapter* adapter, UINT asteroidCount);
     ~Asteroids();
 
     void WaitForReadyToRender();
@@ -70,9 +72,9 @@ private:
 
     void RenderSubset(
         D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView,
-        size_t frameIndex, float frameTime,
+        size_t frameIndex,
         SubsetD3D12* subset, UINT subsetIdx,
-        DirectX::XMVECTOR cameraEye, DirectX::XMMATRIX viewProjection,
+        DirectX::XMMATRIX viewProjection,
         const Settings& settings);
 
     void CreatePSOs();
@@ -83,6 +85,10 @@ private:
     void CreateMeshes();
     void CreateGUIResources();
 
+    // Base vertex would offset the shared directions in slot 0 too, so each draw binds its
+    // asteroid's slice of the per-instance stream to slot 1 instead
+    D3D12_VERTEX_BUFFER_VIEW AsteroidVertexBufferView(UINT drawIdx) const;
+
     struct Frame {
         std::vector<SubsetD3D12*>   mSubsets;
         ID3D12CommandAllocator*     mCmdAlloc = nullptr;
@@ -139,6 +145,7 @@ private:
     D3D12_GPU_DESCRIPTOR_HANDLE mSampler;
     D3D12_VERTEX_BUFFER_VIEW    mSkyboxVertexBufferView;
     D3D12_INDEX_BUFFER_VIEW     mAsteroidIndexBufferView;
+    D3D12_VERTEX_BUFFER_VIEW    mAsteroidDirectionBufferView;
     D3D12_VERTEX_BUFFER_VIEW    mAsteroidVertexBufferView;
 
     // Command lists
@@ -148,6 +155,7 @@ private:
     DXGI_FORMAT                 mDSVFormat;
     ID3D12Resource*             mDepthStencil = nullptr;
 
+    SimulationThread*           mSimulation = nullptr;
     AsteroidsSimulation*        mAsteroids = nullptr;
     ID3D12Resource*             mAsteroidTextures[NUM_UNIQUE_TEXTURES];
 
@@ -173,7 +181,7 @@ private:
     std::vector<ID3D12GraphicsCommandList*> mCmdListsToSubmit;
 
     UINT                        mSubsetCount = 0;
-    UINT                        mDrawsPerSubset = 0;
+    const SimulationFrame*      mSimFrame = nullptr;
 };
 
 } // namespace AsteroidsD3D12
@@ -0,0 +1,1430 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "benchmark.h"
+#include "cpu_features.h"
+#include "job_system.h"
+#include "simulation.h"
+#include "vertex_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+enum { BENCHMARK_FRAMES = 100 };
+static const float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+
+struct BenchmarkView
+{
+    XMVECTOR eye;
+    XMMATRIX viewProjection;
+};
+
+// Matches the default view set up by ResetCameraView and the default window size
+BenchmarkView DefaultBenchmarkView()
+{
+    float radius = SIM_ORBIT_RADIUS + SIM_DISC_RADIUS + 10.f;
+    float longAngle = 4.50f;
+    float latAngle = 1.45f;
+    auto center = XMVectorSet(0.0f, -0.4f*SIM_DISC_RADIUS, 0.0f, 0.0f);
+
+    Settings settings;
+    float aspect = (float)settings.windowWidth / (float)settings.windowHeight;
+    float fov = XM_PIDIV2 * 0.8f * 3.0f / 2.0f;
+    float fovY = (aspect <= 1.0f ? fov : fov / aspect);
+
+    BenchmarkView view;
+    view.eye = XMVectorSet(
+        radius * std::sin(latAngle) * std::cos(longAngle),
+        radius * std::cos(latAngle),
+        radius * std::sin(latAngle) * std::sin(longAngle),
+        0.0f);
+    view.viewProjection = XMMatrixLookAtRH(view.eye, center, XMVectorSet(0, 1, 0, 0)) *
+                          XMMatrixPerspectiveFovRH(fovY, aspect, 10000.0f, 0.1f);
+    return view;
+}
+
+// From inside the belt, looking along the orbit, where near asteroids hide many far ones
+BenchmarkView InsideBeltBenchmarkView()
+{
+    Settings settings;
+    float aspect = (float)settings.windowWidth / (float)settings.windowHeight;
+    float fov = XM_PIDIV2 * 0.8f * 3.0f / 2.0f;
+    float fovY = (aspect <= 1.0f ? fov : fov / aspect);
+
+    BenchmarkView view;
+    view.eye = XMVectorSet(SIM_ORBIT_RADIUS, 0.0f, 0.0f, 0.0f);
+    auto target = XMVectorSet(SIM_ORBIT_RADIUS, 0.0f, -SIM_ORBIT_RADIUS, 0.0f);
+    view.viewProjection = XMMatrixLookAtRH(view.eye, target, XMVectorSet(0, 1, 0, 0)) *
+                          XMMatrixPerspectiveFovRH(fovY, aspect, 10000.0f, 0.1f);
+    return view;
+}
+
+void PrintResult(const char* label, double seconds, size_t asteroidCount, size_t bytesPerAsteroid)
+{
+    double nsPerAsteroid = 1e9 * seconds / (double(asteroidCount) * BENCHMARK_FRAMES);
+    std::cout
+        << "  " << std::left << std::setw(12) << label << std::right
+        << std::setw(6) << bytesPerAsteroid << " bytes/asteroid  "
+        << std::fixed << std::setprecision(2) << std::setw(8) << nsPerAsteroid << " ns/asteroid  "
+        << std::setw(8) << 1000.0 * seconds / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+}
+
+
+// The original array-of-structures asteroid layout, kept as the baseline for the layout benchmark
+struct AsteroidDynamicAoS
+{
+    XMMATRIX world;
+    unsigned int indexStart;
+    unsigned int indexCount;
+};
+
+struct AsteroidStaticAoS
+{
+    XMFLOAT3 surfaceColor;
+    XMFLOAT3 deepColor;
+    XMVECTOR spinAxis;
+    float scale;
+    float spinVelocity;
+    float orbitVelocity;
+    unsigned int vertexStart;
+    unsigned int textureIndex;
+};
+
+void UpdateAoS(const AsteroidStaticAoS* staticData, AsteroidDynamicAoS* dynamicData, size_t count,
+               const unsigned int* indexOffsets, unsigned int subdivCount,
+               float frameTime, XMVECTOR cameraEye, bool animate)
+{
+    static const float minSubdivSizeLog2 = std::log2f(0.0019f);
+
+    for (size_t i = 0; i < count; ++i) {
+        auto s = &staticData[i];
+        auto d = &dynamicData[i];
+
+        if (animate) {
+            auto orbit = XMMatrixRotationY(s->orbitVelocity * frameTime);
+            auto spin = XMMatrixRotationNormal(s->spinAxis, s->spinVelocity * frameTime);
+            d->world = spin * d->world * orbit;
+        }
+
+        auto distanceToEyeRcp = XMVectorGetX(XMVector3ReciprocalLengthEst(XMVectorSubtract(cameraEye, d->world.r[3])));
+        auto relativeScreenSizeLog2 = VeryApproxLog2f(s->scale * distanceToEyeRcp);
+        float subdivFloat = std::max(0.0f, relativeScreenSizeLog2 - minSubdivSizeLog2);
+        auto subdiv = std::min(subdivCount, (unsigned int)subdivFloat);
+
+        d->indexStart = indexOffsets[subdiv];
+        d->indexCount = indexOffsets[subdiv+1] - d->indexStart;
+    }
+}
+
+// Compares the per-frame Update sweep over the SoA/AoSoA simulation storage against the
+// original AoS records. Both run the same math single threaded, so the difference is memory traffic.
+int BenchmarkSimLayout(const Settings& baseSettings)
+{
+    // The AoS baseline only implements integrated motion
+    Settings settings = baseSettings;
+    settings.closedFormMotion = false;
+
+    AsteroidsSimulation asteroids(1337, settings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+
+    std::vector<AsteroidStaticAoS> staticAoS(count);
+    std::vector<AsteroidDynamicAoS> dynamicAoS(count);
+    for (size_t i = 0; i < count; ++i) {
+        staticAoS[i].surfaceColor  = asteroids.SurfaceColor(i);
+        staticAoS[i].deepColor     = asteroids.DeepColor(i);
+        staticAoS[i].spinAxis      = asteroids.SpinAxis(i);
+        staticAoS[i].scale         = asteroids.Scale(i);
+        staticAoS[i].spinVelocity  = asteroids.SpinVelocity(i);
+        staticAoS[i].orbitVelocity = asteroids.OrbitVelocity(i);
+        staticAoS[i].vertexStart   = asteroids.VertexStart(i);
+        staticAoS[i].textureIndex  = asteroids.TextureIndex(i);
+        dynamicAoS[i].world = asteroids.World(i);
+    }
+
+    std::cout << "Update sweep over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames, animate = "
+              << settings.animate << std::endl;
+    std::cout << "  Static state: " << sizeof(AsteroidStaticAoS) << " bytes/asteroid AoS, "
+              << AsteroidsSimulation::StaticBytesPerAsteroid() << " bytes/asteroid packed SoA" << std::endl;
+
+    {
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            UpdateAoS(staticAoS.data(), dynamicAoS.data(), count, asteroids.IndexOffsets(), asteroids.SubdivCount(),
+                      BENCHMARK_FRAME_TIME, view.eye, settings.animate);
+        }
+        // The whole record shares cache lines with the fields that are read, so it is all pulled in
+        PrintResult("AoS", SecondsSince(start), count, sizeof(AsteroidStaticAoS) + sizeof(AsteroidDynamicAoS));
+    }
+    {
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+        }
+        PrintResult("SoA/AoSoA", SecondsSince(start), count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+    }
+
+    return 0;
+}
+
+
+// Times each Update kernel the CPU supports and checks its LOD picks against the scalar path
+int BenchmarkSimSimd(const Settings& settings)
+{
+    AsteroidsSimulation asteroids(1337, settings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+
+    std::cout << "Update kernels over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames, animate = "
+              << settings.animate << std::endl;
+
+    // AVX-512 CPUs run the AVX2 kernel, so there is no separate row for them
+    auto maxLevel = std::min((int)asteroids.SupportedSimdLevel(), (int)SIMD_LEVEL_AVX2);
+    std::vector<unsigned char> referenceSubdiv(count);
+    for (int level = SIMD_LEVEL_SCALAR; level <= maxLevel; ++level) {
+        // With animation off Update only recomputes LOD, so the scalar reference and this kernel
+        // see the positions the previous level's timing run left behind
+        Settings lodSettings = settings;
+        lodSettings.animate = false;
+        lodSettings.simdLevel = SIMD_LEVEL_SCALAR;
+        asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, lodSettings);
+        asteroids.Update(lodSettings);
+        for (size_t i = 0; i < count; ++i) {
+            referenceSubdiv[i] = (unsigned char)asteroids.Subdiv(i);
+        }
+
+        lodSettings.simdLevel = (SimdLevel)level;
+        asteroids.Update(lodSettings);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            mismatches += (asteroids.Subdiv(i) != referenceSubdiv[i]);
+        }
+
+        Settings timedSettings = settings;
+        timedSettings.simdLevel = (SimdLevel)level;
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, timedSettings);
+            asteroids.Update(timedSettings);
+        }
+        PrintResult(SimdLevelName((SimdLevel)level), SecondsSince(start), count,
+                    AsteroidsSimulation::UpdateBytesPerAsteroid(timedSettings));
+        std::cout << "    LOD mismatches vs. scalar: " << mismatches << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Integrated vs. closed-form motion: per-frame cost, how far integration drifts from the exact
+// transforms over a long run, and the cost of seeking straight to a far-off time
+int BenchmarkSimMotion(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+
+    std::cout << "Motion models over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    {
+        settings.closedFormMotion = false;
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+        }
+        PrintResult("Integrated", SecondsSince(start), count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+    }
+    {
+        settings.closedFormMotion = true;
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+        }
+        PrintResult("Closed-form", SecondsSince(start), count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+    }
+
+    // Drift after ten simulated minutes, on a prefix of the field to keep the run short
+    {
+        const unsigned int driftFrames = 10 * 60 * 60;
+        size_t driftCount = std::min<size_t>(count, 4096);
+        settings.closedFormMotion = false;
+        for (unsigned int f = 0; f < driftFrames; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings, 0, driftCount);
+        }
+
+        float maxPositionError = 0.0f;
+        float maxBasisError = 0.0f;
+        for (size_t i = 0; i < driftCount; ++i) {
+            auto integrated = asteroids.World(i);
+            auto exact = asteroids.WorldAtTime(i, asteroids.Time());
+            auto scale = asteroids.Scale(i);
+            for (int r = 0; r < 3; ++r) {
+                auto error = XMVectorGetX(XMVector3Length(XMVectorSubtract(integrated.r[r], exact.r[r]))) / scale;
+                maxBasisError = std::max(maxBasisError, error);
+            }
+            maxPositionError = std::max(maxPositionError,
+                XMVectorGetX(XMVector3Length(XMVectorSubtract(integrated.r[3], exact.r[3]))));
+        }
+        std::cout << "  Integrated drift after " << driftFrames << " frames: max position error "
+                  << maxPositionError << ", max relative basis error " << maxBasisError << std::endl;
+    }
+
+    {
+        settings.closedFormMotion = true;
+        asteroids.Seek(3600.0);
+        auto start = Clock::now();
+        asteroids.Update(settings);
+        std::cout << "  Seek to t = 3600 s: " << std::fixed << std::setprecision(2)
+                  << 1000.0 * SecondsSince(start) << " ms" << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Per-frame culling cost with the flat per-asteroid sweep and with the spatial grid (including
+// its incremental maintenance in BeginFrame), and whether both agree with SphereInFrustum
+int BenchmarkCull(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.cullAsteroids = true;
+
+    std::cout << "Frustum culling over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    for (int grid = 0; grid < 2; ++grid) {
+        settings.gridCulling = (grid != 0);
+        double seconds = 0.0;
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            auto start = Clock::now();
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            seconds += SecondsSince(start);
+
+            asteroids.Update(settings);
+
+            start = Clock::now();
+            asteroids.Cull(settings, &drawList);
+            seconds += SecondsSince(start);
+        }
+
+        auto stats = asteroids.LastFrameStats();
+        std::cout << "  " << std::left << std::setw(12) << (settings.gridCulling ? "Grid" : "Flat") << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(8) << 1000.0 * seconds / BENCHMARK_FRAMES
+                  << " ms/frame  drawn " << stats.visible << ", culled " << stats.culled;
+        if (settings.gridCulling) {
+            std::cout << "  (cells accepted " << stats.grid.cellsAccepted << ", rejected " << stats.grid.cellsRejected
+                      << ", partial " << stats.grid.cellsPartial << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    // Both paths against the reference test, at the current time
+    auto frustum = ExtractFrustum(view.viewProjection);
+    for (int grid = 0; grid < 2; ++grid) {
+        settings.gridCulling = (grid != 0);
+        asteroids.Cull(settings, &drawList);
+        std::vector<bool> visible(count, false);
+        for (auto i : drawList.indices) visible[i] = true;
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            mismatches += (visible[i] != SphereInFrustum(frustum, asteroids.World(i).r[3], asteroids.BoundingRadius(i)));
+        }
+        std::cout << "  " << (settings.gridCulling ? "Grid" : "Flat") << " mismatches vs. SphereInFrustum: "
+                  << mismatches << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Occlusion culling from inside the belt: how much it removes beyond frustum culling and what the
+// occluder selection, rasterization and occludee tests cost
+int BenchmarkOcclusion(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = InsideBeltBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.cullAsteroids = true;
+    settings.occlusionCulling = true;
+
+    std::cout << "Occlusion culling over " << count << " asteroids from inside the belt, "
+              << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    double inFrustum = 0.0, occluded = 0.0, occluders = 0.0, milliseconds = 0.0;
+    for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+        asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+        asteroids.Update(settings);
+        asteroids.Cull(settings, &drawList);
+
+        auto stats = asteroids.LastFrameStats();
+        inFrustum += stats.visible + stats.occluded;
+        occluded += stats.occluded;
+        occluders += stats.occluders;
+        milliseconds += stats.occlusionMs;
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  In frustum " << inFrustum / BENCHMARK_FRAMES
+              << ", occluders " << occluders / BENCHMARK_FRAMES
+              << ", occluded " << occluded / BENCHMARK_FRAMES
+              << " (" << 100.0 * occluded / std::max(inFrustum, 1.0) << "%)" << std::endl;
+    std::cout << std::setprecision(3) << "  Occlusion cost " << milliseconds / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+
+    return 0;
+}
+
+
+// Cost of bucketing the draw list by subdiv level and texture, its histogram, and a check that the
+// result is a bucket-ordered permutation of the unbucketed list
+int BenchmarkDrawBuckets(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = false;
+    asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, settings);
+    asteroids.Update(settings);
+
+    std::cout << "Draw list bucketing over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    double seconds[2] = {};
+    for (int bucket = 0; bucket < 2; ++bucket) {
+        settings.bucketDrawList = (bucket != 0);
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.Cull(settings, &drawList);
+        }
+        seconds[bucket] = SecondsSince(start);
+    }
+    std::cout << std::fixed << std::setprecision(3)
+              << "  Cull " << 1000.0 * seconds[0] / BENCHMARK_FRAMES << " ms/frame, with bucketing "
+              << 1000.0 * seconds[1] / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+
+    auto stats = asteroids.LastFrameStats();
+    std::cout << "  Draws per subdiv:";
+    for (unsigned int subdiv = 0; subdiv <= asteroids.SubdivCount(); ++subdiv) {
+        std::cout << " " << stats.drawsPerSubdiv[subdiv];
+    }
+    std::cout << std::endl;
+
+    // Same asteroids as the unbucketed list, buckets in order, each bucket matching its offsets
+    settings.bucketDrawList = false;
+    AsteroidDrawList reference;
+    asteroids.Cull(settings, &reference);
+    auto sortedIndices = drawList.indices;
+    std::sort(sortedIndices.begin(), sortedIndices.end());
+    std::sort(reference.indices.begin(), reference.indices.end());
+    size_t errors = (sortedIndices != reference.indices) ? 1 : 0;
+    for (unsigned int b = 0; b < asteroids.DrawBucketCount(); ++b) {
+        for (auto k = drawList.bucketOffsets[b]; k < drawList.bucketOffsets[b + 1]; ++k) {
+            errors += (asteroids.DrawBucket(drawList.indices[k]) != b);
+        }
+    }
+    std::cout << "  Bucketing errors: " << errors << std::endl;
+
+    return 0;
+}
+
+
+// Overdraw from inside the belt for each draw order, estimated headless by a software depth pass:
+// every drawn asteroid's icosahedron LOD, back faces culled, rasterized in draw list order at a
+// quarter of the window resolution. Shaded pixels are those passing the depth test, as with early
+// depth testing on the GPU; overdraw is shaded pixels per covered pixel. The coarse LOD makes
+// this an estimate of the ratio between orders rather than of absolute GPU cost.
+int BenchmarkOverdraw(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = InsideBeltBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = false;
+    settings.cullAsteroids = true;
+    settings.occlusionCulling = false;
+
+    // Icosahedron LOD indices are relative to each mesh instance's first vertex
+    Mesh mesh;
+    DecodeRadialMesh(*asteroids.Meshes(), &mesh);
+    std::vector<XMFLOAT3> positions(mesh.vertices.size());
+    for (size_t v = 0; v < positions.size(); ++v) {
+        positions[v] = XMFLOAT3(mesh.vertices[v].x, mesh.vertices[v].y, mesh.vertices[v].z);
+    }
+    auto indices = &mesh.indices[asteroids.SubdivIndexStart(0)];
+    size_t trianglesPerAsteroid = asteroids.SubdivIndexCount(0) / 3;
+
+    OcclusionBuffer depth(settings.windowWidth / 4, settings.windowHeight / 4);
+    std::vector<size_t> shadedPerTile(depth.TileCount());
+
+    std::cout << "Overdraw over " << count << " asteroids from inside the belt, " << depth.Width() << "x"
+              << depth.Height() << " software depth pass; Cull cost over " << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    static const char* orderNames[] = { "Array", "Bucketed", "Near first", "Bucketed, near first" };
+    for (int order = 0; order < 4; ++order) {
+        settings.bucketDrawList = (order & 1) != 0;
+        settings.frontToBackDraws = (order & 2) != 0;
+        asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, settings);
+        asteroids.Update(settings);
+
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.Cull(settings, &drawList);
+        }
+        double cullSeconds = SecondsSince(start);
+
+        depth.BeginFrame(view.viewProjection, drawList.indices.size() * trianglesPerAsteroid);
+        jobs::parallel_for(size_t(0), drawList.indices.size(), [&](size_t k) {
+            auto i = drawList.indices[k];
+            depth.SetupOccluder(k * trianglesPerAsteroid, asteroids.World(i),
+                                &positions[asteroids.VertexStart(asteroids.AsteroidId(i))], indices,
+                                trianglesPerAsteroid, true);
+        });
+        std::fill(shadedPerTile.begin(), shadedPerTile.end(), 0);
+        jobs::parallel_for(0u, depth.TileCount(), [&](unsigned int tile) {
+            depth.RasterizeTile(tile, &shadedPerTile[tile]);
+        });
+
+        size_t shaded = 0;
+        for (auto s : shadedPerTile) shaded += s;
+        size_t covered = 0;
+        for (unsigned int y = 0; y < depth.Height(); ++y) {
+            for (unsigned int x = 0; x < depth.Width(); ++x) {
+                covered += (depth.Depth(x, y) > 0.0f);
+            }
+        }
+
+        std::cout << "  " << std::left << std::setw(22) << orderNames[order] << std::right
+                  << std::setw(8) << drawList.indices.size() << " draws  "
+                  << std::fixed << std::setprecision(2) << std::setw(6) << (double)shaded / std::max<size_t>(1, covered)
+                  << "x overdraw (" << shaded << " shaded, " << covered << " covered)  Cull "
+                  << std::setprecision(3) << 1000.0 * cullSeconds / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Fixed-step simulation: identical state after the same number of steps regardless of how the
+// frame times split them up, and per-frame cost when rendering faster than the simulation rate
+int BenchmarkFixedStep(const Settings& baseSettings)
+{
+    auto view = DefaultBenchmarkView();
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.simulationHz = 60;
+    float step = 1.0f / settings.simulationHz;
+
+    AsteroidsSimulation steady(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    AsteroidsSimulation jittered(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = steady.AsteroidCount();
+
+    std::cout << "Fixed-step simulation at " << settings.simulationHz << " Hz over " << count << " asteroids" << std::endl;
+
+    // Ten simulated seconds, once at the simulation rate and once with erratic frame times
+    static const float jitter[] = { 0.25f, 1.0f, 3.5f, 0.1f, 0.8f, 1.7f, 0.05f, 2.2f };
+    const double endTime = 10.0;
+    for (unsigned int f = 0; steady.Time() < endTime; ++f) {
+        steady.BeginFrame(step, view.eye, view.viewProjection, settings);
+        steady.Update(settings);
+    }
+    for (unsigned int f = 0; jittered.Time() < endTime; ++f) {
+        jittered.BeginFrame(step * jitter[f % (sizeof(jitter) / sizeof(jitter[0]))], view.eye, view.viewProjection, settings);
+        jittered.Update(settings);
+    }
+
+    // Line the step counts up with sub-step frames, which never take more than one step
+    while (steady.Time() != jittered.Time()) {
+        auto behind = steady.Time() < jittered.Time() ? &steady : &jittered;
+        behind->BeginFrame(0.25f * step, view.eye, view.viewProjection, settings);
+        behind->Update(settings);
+    }
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i) {
+        XMFLOAT4X4 a, b;
+        XMStoreFloat4x4(&a, steady.SimulatedWorld(i));
+        XMStoreFloat4x4(&b, jittered.SimulatedWorld(i));
+        mismatches += (memcmp(&a, &b, sizeof(a)) != 0);
+    }
+    std::cout << "  Mismatched transforms at t = " << steady.Time() << " s: " << mismatches << std::endl;
+
+    // Rendering at 240 fps: variable steps update every frame, fixed steps one frame in four
+    // plus interpolation
+    const float renderFrameTime = 1.0f / 240.0f;
+    for (int fixed = 0; fixed < 2; ++fixed) {
+        settings.simulationHz = fixed ? 60 : 0;
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            steady.BeginFrame(renderFrameTime, view.eye, view.viewProjection, settings);
+            steady.Update(settings);
+        }
+        PrintResult(fixed ? "60 Hz fixed step" : "Variable step", SecondsSince(start), count,
+                    AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+    }
+
+    return 0;
+}
+
+
+// Sim update scaling with the job system's thread count, splitting the field into the same
+// 4096-asteroid ranges as SimulationThread, plus the per-index cost of an empty parallel_for
+int BenchmarkJobs(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+
+    const size_t chunkSize = 4096;
+    size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "Job system scaling over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames, "
+              << hardwareThreads << " hardware threads" << std::endl;
+
+    double singleThreadSeconds = 0.0;
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+        JobSystem jobSystem(threads);
+
+        auto start = Clock::now();
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+                size_t first = chunk * chunkSize;
+                asteroids.Update(settings, first, std::min(chunkSize, count - first));
+            }, 1);
+        }
+        double seconds = SecondsSince(start);
+        if (threads == 1) {
+            singleThreadSeconds = seconds;
+        }
+
+        const size_t emptyCount = 1 << 22;
+        start = Clock::now();
+        jobSystem.ParallelFor(size_t(0), emptyCount, [](size_t) {});
+        double emptySeconds = SecondsSince(start);
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << std::setw(3) << threads << " threads: update " << 1000.0 * seconds / BENCHMARK_FRAMES
+                  << " ms/frame (" << std::setprecision(2) << singleThreadSeconds / seconds << "x), empty parallel_for "
+                  << std::setprecision(3) << 1e9 * emptySeconds / emptyCount << " ns/index" << std::endl;
+
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+// Closed-loop LOD governor runs against a triangle budget and against a frame time budget (with
+// frame time modelled as linear in triangles): how fast it settles and how much it wanders after
+int BenchmarkLodGovernor(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto view = DefaultBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.lodTriangleBudget = 0;
+    settings.lodFrameTimeBudgetMs = 0.0f;
+
+    asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+    asteroids.Update(settings);
+    asteroids.Cull(settings, &drawList);
+    auto ungovernedTriangles = asteroids.LastFrameStats().triangles;
+
+    std::cout << "LOD governor from " << ungovernedTriangles << " triangles at zero bias" << std::endl;
+
+    // Synthetic cost: fixed overhead plus a per-triangle cost; both runs aim for 40% of the ungoverned triangles
+    const float baseMs = 4.0f;
+    const float msPerTriangle = 8.0f / std::max(1u, ungovernedTriangles);
+    for (int mode = 0; mode < 2; ++mode) {
+        bool frameTimeMode = (mode != 0);
+        float targetTriangles = 0.4f * ungovernedTriangles;
+        settings.lodTriangleBudget = frameTimeMode ? 0 : (unsigned int)targetTriangles;
+        settings.lodFrameTimeBudgetMs = frameTimeMode ? baseMs + msPerTriangle * targetTriangles : 0.0f;
+
+        const unsigned int frames = 600;
+        const unsigned int tailFrames = 120;
+        unsigned int settledFrame = frames;
+        double tailSum = 0.0, tailSumSq = 0.0;
+        float frameMs = baseMs + msPerTriangle * ungovernedTriangles;
+        for (unsigned int f = 0; f < frames; ++f) {
+            asteroids.BeginFrame(frameMs * 0.001f, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+            asteroids.Cull(settings, &drawList);
+
+            auto triangles = (float)asteroids.LastFrameStats().triangles;
+            frameMs = baseMs + msPerTriangle * triangles;
+            float relative = triangles / targetTriangles;
+            if (std::abs(relative - 1.0f) > 0.05f) {
+                settledFrame = frames;
+            } else if (settledFrame == frames) {
+                settledFrame = f;
+            }
+            if (f >= frames - tailFrames) {
+                tailSum += relative;
+                tailSumSq += relative * relative;
+            }
+        }
+
+        double mean = tailSum / tailFrames;
+        double deviation = std::sqrt(std::max(0.0, tailSumSq / tailFrames - mean * mean));
+        auto state = asteroids.LastFrameStats().lodGovernor;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << (frameTimeMode ? "Frame time budget " : "Triangle budget   ")
+                  << "settled (within 5%) after " << settledFrame << " frames; last " << tailFrames
+                  << " frames at " << mean << " +- " << deviation << " of target, bias " << state.bias << std::endl;
+        std::cout << "    Draws per subdiv:";
+        for (unsigned int subdiv = 0; subdiv <= asteroids.SubdivCount(); ++subdiv) {
+            std::cout << " " << asteroids.LastFrameStats().drawsPerSubdiv[subdiv];
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Update cost of the log2 screen-size LOD pick vs. the per-frame distance threshold table at each
+// SIMD level, and how the table's resolution-aware levels compare at the benchmark render size
+int BenchmarkLodTable(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+
+    Settings settings = baseSettings;
+    settings.animate = false; // LOD dominates when transforms aren't rewritten
+
+    std::cout << "LOD selection over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames, "
+              << settings.renderHeight << " pixel render height" << std::endl;
+
+    SimdLevel levels[] = { SIMD_LEVEL_SCALAR, SIMD_LEVEL_SSE41, SIMD_LEVEL_AVX2 };
+    for (auto level : levels) {
+        if (level > asteroids.SupportedSimdLevel()) continue;
+        settings.simdLevel = level;
+        for (int table = 0; table < 2; ++table) {
+            settings.lodThresholdTable = (table != 0);
+            auto start = Clock::now();
+            for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+                asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, settings);
+                asteroids.Update(settings);
+            }
+            char label[64];
+            sprintf(label, "%s %s", SimdLevelName(level), table ? "table" : "log2");
+            PrintResult(label, SecondsSince(start), count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+        }
+    }
+
+    // Level histograms and agreement, scalar path
+    settings.simdLevel = SIMD_LEVEL_SCALAR;
+    std::vector<unsigned int> subdivs[2];
+    for (int table = 0; table < 2; ++table) {
+        settings.lodThresholdTable = (table != 0);
+        asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, settings);
+        asteroids.Update(settings);
+        subdivs[table].resize(count);
+        for (size_t i = 0; i < count; ++i) subdivs[table][i] = asteroids.Subdiv(i);
+    }
+    for (int table = 0; table < 2; ++table) {
+        unsigned int histogram[MESH_MAX_SUBDIV_LEVELS + 1] = {};
+        for (auto subdiv : subdivs[table]) histogram[subdiv]++;
+        std::cout << "  " << (table ? "Table" : "Log2 ") << " asteroids per subdiv:";
+        for (unsigned int subdiv = 0; subdiv <= asteroids.SubdivCount(); ++subdiv) {
+            std::cout << " " << histogram[subdiv];
+        }
+        std::cout << std::endl;
+    }
+    size_t differ = 0;
+    for (size_t i = 0; i < count; ++i) differ += (subdivs[0][i] != subdivs[1][i]);
+    std::cout << "  Asteroids at a different level: " << differ << std::endl;
+
+    return 0;
+}
+
+
+// Far update amortization at 1M asteroids: Update cost per interval, the resulting full update
+// rate in each LOD band, and how far the carried-along asteroids stray from their exact
+// closed-form positions (in pixels at the benchmark render height)
+int BenchmarkAmortize(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, 1000000, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = DefaultBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+
+    float aspect = (float)settings.windowWidth / (float)settings.windowHeight;
+    float fov = XM_PIDIV2 * 0.8f * 3.0f / 2.0f;
+    float fovY = (aspect <= 1.0f ? fov : fov / aspect);
+    float pixelsPerRadian = (float)settings.renderHeight / fovY;
+
+    std::cout << "Update over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames, far = subdiv <= "
+              << settings.amortizeMaxSubdiv << std::endl;
+
+    for (int closedForm = 0; closedForm < 2; ++closedForm) {
+        settings.closedFormMotion = (closedForm != 0);
+        const unsigned int intervals[] = { 1, 2, 4, 8 };
+        for (auto interval : intervals) {
+            settings.amortizeFarUpdates = (interval > 1);
+            settings.amortizeInterval = interval;
+
+            // Settle LOD (and with it the bands) before timing
+            asteroids.Seek(0.0);
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+
+            auto start = Clock::now();
+            for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+                asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+                asteroids.Update(settings);
+            }
+            auto seconds = SecondsSince(start);
+            asteroids.Cull(settings, &drawList);
+
+            char label[64];
+            sprintf(label, "%s K=%u", closedForm ? "closed" : "integ.", interval);
+            PrintResult(label, seconds, count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+
+            auto stats = asteroids.LastFrameStats();
+            if (interval > 1) {
+                std::cout << "    Full update rate per subdiv:";
+                for (unsigned int subdiv = 0; subdiv <= asteroids.SubdivCount(); ++subdiv) {
+                    auto asteroidsInBand = stats.asteroidsPerSubdiv[subdiv];
+                    std::cout << std::setprecision(3) << " " << (asteroidsInBand ? (float)stats.updatesPerSubdiv[subdiv] / asteroidsInBand : 0.0f)
+                              << " (" << asteroidsInBand << ")";
+                }
+                std::cout << std::endl;
+            }
+
+            if (closedForm) {
+                float maxPixels = 0.0f;
+                for (size_t i = 0; i < count; ++i) {
+                    auto exact = asteroids.WorldAtTime(i, asteroids.Time()).r[3];
+                    auto error = XMVectorGetX(XMVector3Length(XMVectorSubtract(asteroids.SimulatedWorld(i).r[3], exact)));
+                    auto distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(exact, view.eye)));
+                    maxPixels = std::max(maxPixels, pixelsPerRadian * error / distance);
+                }
+                std::cout << "    Max position error: " << std::setprecision(4) << maxPixels << " pixels" << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+// Culling and Update cost before and after a Morton re-sort, from inside the belt. Hardware cache
+// miss counters aren't portably available, so locality is shown by the 64-byte lines of
+// transform data the drawn asteroids span, per drawn asteroid: lower means fewer misses when
+// culling, capturing and recording draws.
+int BenchmarkResort(const Settings& baseSettings)
+{
+    AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    auto view = InsideBeltBenchmarkView();
+    AsteroidDrawList drawList;
+
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.cullAsteroids = true;
+    settings.occlusionCulling = false;
+
+    // Scatter the field the way a long run would
+    asteroids.Seek(600.0);
+
+    std::cout << "Culling and Update over " << count << " asteroids, " << BENCHMARK_FRAMES << " frames" << std::endl;
+
+    for (int sorted = 0; sorted < 2; ++sorted) {
+        if (sorted) {
+            auto start = Clock::now();
+            asteroids.Resort();
+            std::cout << std::fixed << std::setprecision(2) << "  Resort: " << 1000.0 * SecondsSince(start)
+                      << " ms" << std::endl;
+        }
+        std::cout << (sorted ? "  Morton order" : "  Creation order") << std::endl;
+
+        for (int grid = 0; grid < 2; ++grid) {
+            settings.gridCulling = (grid != 0);
+            asteroids.BeginFrame(0.0f, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+            auto start = Clock::now();
+            for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+                asteroids.Cull(settings, &drawList);
+            }
+            std::cout << "  " << std::left << std::setw(12) << (grid ? "Grid cull" : "Flat cull") << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(8) << 1000.0 * SecondsSince(start) / BENCHMARK_FRAMES
+                      << " ms/frame" << std::endl;
+        }
+
+        {
+            auto start = Clock::now();
+            for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+                asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+                asteroids.Update(settings);
+            }
+            PrintResult("Update", SecondsSince(start), count, AsteroidsSimulation::UpdateBytesPerAsteroid(settings));
+        }
+
+        asteroids.Cull(settings, &drawList);
+        const size_t bytesPerBlock = sizeof(AsteroidTransformBlock);
+        std::vector<size_t> lines;
+        for (auto i : drawList.indices) {
+            for (int e = 0; e < 12; ++e) {
+                lines.push_back(((i / SIM_BLOCK_WIDTH) * bytesPerBlock + (e * SIM_BLOCK_WIDTH + i % SIM_BLOCK_WIDTH) * sizeof(float)) / 64);
+            }
+        }
+        std::sort(lines.begin(), lines.end());
+        auto lineCount = std::unique(lines.begin(), lines.end()) - lines.begin();
+        std::cout << std::setprecision(2) << "    " << drawList.indices.size() << " drawn, "
+                  << (double)lineCount / std::max<size_t>(1, drawList.indices.size())
+                  << " transform cache lines per drawn asteroid" << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Collision detection and response as the job system's thread count grows: sphere pairs tested
+// per second and parallel efficiency against one thread. Each thread count starts from a fresh
+// field and should end in exactly the same state, since every asteroid gathers its own contacts
+// in a fixed order. Grid culling is off so its serial upkeep stays out of the numbers.
+int BenchmarkCollisions(const Settings& baseSettings)
+{
+    auto view = DefaultBenchmarkView();
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.collisions = true;
+    settings.gridCulling = false;
+
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Collisions over " << baseSettings.numAsteroids << " asteroids, " << BENCHMARK_FRAMES << " frames, "
+              << hardwareThreads << " hardware threads" << std::endl;
+
+    double singleThreadSeconds = 0.0;
+    std::vector<XMFLOAT4X3> singleThreadWorld;
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+        AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+        auto count = asteroids.AsteroidCount();
+        JobSystem jobSystem(threads);
+
+        double seconds = 0.0, tests = 0.0, contacts = 0.0;
+        for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+            auto start = Clock::now();
+            asteroids.Collide(settings, jobSystem);
+            seconds += SecondsSince(start);
+
+            AsteroidDrawList drawList;
+            asteroids.Cull(settings, &drawList);
+            auto stats = asteroids.LastFrameStats();
+            tests += (double)stats.collisionTests;
+            contacts += stats.collisionContacts;
+        }
+
+        std::vector<XMFLOAT4X3> world(count);
+        for (size_t i = 0; i < count; ++i) {
+            XMStoreFloat4x3(&world[i], asteroids.SimulatedWorld(i));
+        }
+        if (threads == 1) {
+            singleThreadSeconds = seconds;
+            singleThreadWorld = world;
+        }
+        bool identical = memcmp(world.data(), singleThreadWorld.data(), world.size() * sizeof(XMFLOAT4X3)) == 0;
+
+        double speedup = singleThreadSeconds / seconds;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << std::setw(3) << threads << " threads: " << 1000.0 * seconds / BENCHMARK_FRAMES << " ms/frame, "
+                  << std::setprecision(0) << tests / BENCHMARK_FRAMES << " tests and "
+                  << contacts / BENCHMARK_FRAMES << " contacts/frame, "
+                  << std::setprecision(1) << 1e-6 * tests / seconds << " M tests/s, "
+                  << std::setprecision(2) << speedup << "x (" << std::setprecision(0) << 100.0 * speedup / threads
+                  << "% efficient)" << (identical ? "" : ", STATE DIFFERS from 1 thread") << std::endl;
+
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+// N-body gravity cost and thread scaling. Each frame rebuilds the Barnes-Hut tree and walks it once
+// per asteroid; both are parallel, and the result must not depend on the thread count. A walk
+// costs about a thousand interactions, so this runs fewer frames than the others.
+int BenchmarkGravity(const Settings& baseSettings)
+{
+    enum { GRAVITY_FRAMES = BENCHMARK_FRAMES / 10 };
+    auto view = DefaultBenchmarkView();
+    Settings settings = baseSettings;
+    settings.animate = true;
+    settings.gravity = true;
+    settings.gridCulling = false;
+
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Gravity over " << baseSettings.numAsteroids << " asteroids, " << GRAVITY_FRAMES << " frames, "
+              << hardwareThreads << " hardware threads" << std::endl;
+
+    double singleThreadSeconds = 0.0;
+    std::vector<XMFLOAT4X3> singleThreadWorld;
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+        AsteroidsSimulation asteroids(1337, baseSettings.numAsteroids, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+        auto count = asteroids.AsteroidCount();
+        JobSystem jobSystem(threads);
+
+        double seconds = 0.0, buildSeconds = 0.0, interactions = 0.0;
+        for (unsigned int f = 0; f < GRAVITY_FRAMES; ++f) {
+            asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+            asteroids.Update(settings);
+            auto start = Clock::now();
+            asteroids.Gravitate(settings, jobSystem);
+            seconds += SecondsSince(start);
+
+            AsteroidDrawList drawList;
+            asteroids.Cull(settings, &drawList);
+            auto stats = asteroids.LastFrameStats();
+            buildSeconds += 1e-3 * stats.gravityBuildMs;
+            interactions += (double)stats.gravityInteractions;
+        }
+
+        std::vector<XMFLOAT4X3> world(count);
+        for (size_t i = 0; i < count; ++i) {
+            XMStoreFloat4x3(&world[i], asteroids.SimulatedWorld(i));
+        }
+        if (threads == 1) {
+            singleThreadSeconds = seconds;
+            singleThreadWorld = world;
+        }
+        bool identical = memcmp(world.data(), singleThreadWorld.data(), world.size() * sizeof(XMFLOAT4X3)) == 0;
+
+        double speedup = singleThreadSeconds / seconds;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << std::setw(3) << threads << " threads: " << 1000.0 * seconds / GRAVITY_FRAMES << " ms/frame ("
+                  << 1000.0 * buildSeconds / GRAVITY_FRAMES << " tree build), "
+                  << std::setprecision(0) << interactions / GRAVITY_FRAMES << " interactions/frame, "
+                  << std::setprecision(1) << 1e-6 * interactions / seconds << " M interactions/s, "
+                  << std::setprecision(2) << speedup << "x (" << std::setprecision(0) << 100.0 * speedup / threads
+                  << "% efficient)" << (identical ? "" : ", STATE DIFFERS from 1 thread") << std::endl;
+
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+// Spatial query throughput at a million asteroids: BVH build and refit cost, then batches of
+// picking rays through the default view, neighborhood spheres around asteroids and nearest-
+// neighbor queries from points in the belt, at each thread count. The first few queries of each
+// batch are checked against brute force over every asteroid.
+int BenchmarkQueries(const Settings& baseSettings)
+{
+    enum { QUERY_ASTEROIDS = 1000000 };
+    enum { QUERY_COUNT = 100000 };
+    enum { QUERY_CHECKS = 100 };
+    enum { QUERY_NEAREST = 8 };
+    const float neighborhoodRadius = 10.0f;
+
+    auto view = DefaultBenchmarkView();
+    Settings settings = baseSettings;
+    settings.animate = true;
+
+    AsteroidsSimulation asteroids(1337, QUERY_ASTEROIDS, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES);
+    auto count = asteroids.AsteroidCount();
+    asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+    asteroids.Update(settings);
+    auto start = Clock::now();
+    asteroids.PrepareQueries();
+    double buildSeconds = SecondsSince(start);
+
+    double refitSeconds = 0.0;
+    for (unsigned int f = 0; f < BENCHMARK_FRAMES; ++f) {
+        asteroids.BeginFrame(BENCHMARK_FRAME_TIME, view.eye, view.viewProjection, settings);
+        asteroids.Update(settings);
+        start = Clock::now();
+        asteroids.PrepareQueries();
+        refitSeconds += SecondsSince(start);
+    }
+    std::cout << std::fixed << std::setprecision(2)
+              << "Queries over " << count << " asteroids: BVH build " << 1000.0 * buildSeconds << " ms, refit "
+              << 1000.0 * refitSeconds / BENCHMARK_FRAMES << " ms/frame (including any rebuilds)" << std::endl;
+
+    // Rays from the eye through random pixels; spheres and points at random asteroids
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> ndc(-1.0f, 1.0f);
+    std::uniform_int_distribution<unsigned int> asteroid(0, (unsigned int)count - 1);
+    auto inverseViewProjection = XMMatrixInverse(nullptr, view.viewProjection);
+    std::vector<AsteroidRay> rays(QUERY_COUNT);
+    std::vector<XMFLOAT4> spheres(QUERY_COUNT);
+    std::vector<XMFLOAT3> points(QUERY_COUNT);
+    for (size_t q = 0; q < QUERY_COUNT; ++q) {
+        auto target = XMVector3TransformCoord(XMVectorSet(ndc(rng), ndc(rng), 0.5f, 1.0f), inverseViewProjection);
+        XMStoreFloat3(&rays[q].origin, view.eye);
+        XMStoreFloat3(&rays[q].direction, XMVector3Normalize(XMVectorSubtract(target, view.eye)));
+        rays[q].maxDistance = 10000.0f;
+        XMStoreFloat4(&spheres[q], XMVectorSetW(asteroids.World(asteroid(rng)).r[3], neighborhoodRadius));
+        XMStoreFloat3(&points[q], asteroids.World(asteroid(rng)).r[3]);
+    }
+
+    // Brute force answers for the checked queries
+    size_t rayMismatches = 0, sphereMismatches = 0, nearestMismatches = 0;
+    std::vector<AsteroidRayHit> hits(QUERY_COUNT);
+    AsteroidQueryResults sphereResults, nearestResults;
+    auto check = [&]() {
+        for (size_t q = 0; q < QUERY_CHECKS; ++q) {
+            auto origin = XMLoadFloat3(&rays[q].origin);
+            auto direction = XMLoadFloat3(&rays[q].direction);
+            float nearestHit = rays[q].maxDistance;
+            unsigned int overlaps = 0;
+            std::vector<float> distances(count);
+            for (size_t i = 0; i < count; ++i) {
+                auto center = asteroids.World(i).r[3];
+                float radius = asteroids.BoundingRadius(i);
+
+                auto offset = XMVectorSubtract(origin, center);
+                float b = XMVectorGetX(XMVector3Dot(offset, direction));
+                float c = XMVectorGetX(XMVector3LengthSq(offset)) - radius * radius;
+                if (c <= 0.0f) {
+                    nearestHit = 0.0f;
+                } else if (b <= 0.0f && b * b >= c) {
+                    nearestHit = std::min(nearestHit, -b - std::sqrt(b * b - c));
+                }
+
+                float reach = spheres[q].w + radius;
+                overlaps += XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(center, XMLoadFloat4(&spheres[q])))) < reach * reach;
+                distances[i] = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, XMLoadFloat3(&points[q])))) - radius;
+            }
+            std::partial_sort(distances.begin(), distances.begin() + QUERY_NEAREST, distances.end());
+
+            bool hit = nearestHit < rays[q].maxDistance;
+            rayMismatches += hit != (hits[q].asteroid != NO_ASTEROID) || (hit && std::abs(nearestHit - hits[q].distance) > 1e-3f);
+            sphereMismatches += overlaps != sphereResults.offsets[q + 1] - sphereResults.offsets[q];
+            for (unsigned int n = 0; n < QUERY_NEAREST; ++n) {
+                if (std::abs(distances[n] - nearestResults.distances[nearestResults.offsets[q] + n]) > 1e-3f) {
+                    ++nearestMismatches;
+                    break;
+                }
+            }
+        }
+    };
+
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    double singleThreadSeconds[3] = {};
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+        JobSystem jobSystem(threads);
+        double seconds[3];
+        start = Clock::now();
+        asteroids.Raycast(rays.data(), rays.size(), hits.data(), jobSystem);
+        seconds[0] = SecondsSince(start);
+        start = Clock::now();
+        asteroids.QuerySpheres(spheres.data(), spheres.size(), &sphereResults, jobSystem);
+        seconds[1] = SecondsSince(start);
+        start = Clock::now();
+        asteroids.QueryNearest(points.data(), points.size(), QUERY_NEAREST, &nearestResults, jobSystem);
+        seconds[2] = SecondsSince(start);
+        if (threads == 1) {
+            std::copy(seconds, seconds + 3, singleThreadSeconds);
+            check();
+        }
+
+        size_t rayHits = std::count_if(hits.begin(), hits.end(), [](const AsteroidRayHit& hit) { return hit.asteroid != NO_ASTEROID; });
+        std::cout << "  " << std::setw(3) << threads << " threads:" << std::setprecision(2)
+                  << " rays " << 1e-6 * QUERY_COUNT / seconds[0] << " M/s (" << singleThreadSeconds[0] / seconds[0] << "x, "
+                  << std::setprecision(0) << 100.0 * rayHits / QUERY_COUNT << "% hit)," << std::setprecision(2)
+                  << " spheres " << 1e-6 * QUERY_COUNT / seconds[1] << " M/s (" << singleThreadSeconds[1] / seconds[1] << "x, "
+                  << std::setprecision(1) << (double)sphereResults.asteroids.size() / QUERY_COUNT << " found)," << std::setprecision(2)
+                  << " " << QUERY_NEAREST << "-nearest " << 1e-6 * QUERY_COUNT / seconds[2] << " M/s ("
+                  << singleThreadSeconds[2] / seconds[2] << "x)" << std::endl;
+
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+    std::cout << "  Mismatches against brute force in " << QUERY_CHECKS << " queries each: " << rayMismatches << " rays, "
+              << sphereMismatches << " spheres, " << nearestMismatches << " nearest" << std::endl;
+
+    return 0;
+}
+
+
+// Geosphere generation at each subdiv level count the mesh could be built with. Every startup
+// builds these before displacing them into the unique asteroid meshes; vertex order optimization
+// is left out here and measured by BenchmarkVertexCache.
+int BenchmarkGeospheres(const Settings& baseSettings)
+{
+    enum { GEOSPHERE_REPEATS = 20 };
+
+    for (unsigned int levels = 3; levels <= 6; ++levels) {
+        std::vector<unsigned int> subdivIndexOffsets(levels + 2);
+        Mesh mesh;
+        auto start = Clock::now();
+        for (unsigned int r = 0; r < GEOSPHERE_REPEATS; ++r) {
+            CreateGeospheres(&mesh, levels, subdivIndexOffsets.data(), false);
+        }
+        auto seconds = SecondsSince(start) / GEOSPHERE_REPEATS;
+
+        // Each level adds a vertex per edge of the one before, and a closed mesh has 3 edges
+        // per 2 triangles
+        size_t midpoints = 0;
+        for (unsigned int level = 0; level < levels; ++level) {
+            midpoints += (subdivIndexOffsets[level + 1] - subdivIndexOffsets[level]) / 2;
+        }
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << levels << " subdiv levels: " << std::setw(8) << 1000.0 * seconds << " ms, "
+                  << std::setw(6) << mesh.vertices.size() << " vertices, " << std::setw(7) << mesh.indices.size()
+                  << " indices, " << std::setprecision(1) << 1e9 * seconds / midpoints << " ns/midpoint" << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Post-transform vertex cache efficiency of each LOD's indices as subdivided and after the
+// startup reordering, replayed through FIFO caches of typical sizes
+int BenchmarkVertexCache(const Settings& baseSettings)
+{
+    const unsigned int cacheSizes[] = { 16, 32 };
+
+    std::vector<unsigned int> subdivIndexOffsets(MESH_MAX_SUBDIV_LEVELS + 2);
+    Mesh subdivided;
+    auto start = Clock::now();
+    CreateGeospheres(&subdivided, MESH_MAX_SUBDIV_LEVELS, subdivIndexOffsets.data(), false);
+    auto subdividedSeconds = SecondsSince(start);
+
+    Mesh optimized;
+    start = Clock::now();
+    CreateGeospheres(&optimized, MESH_MAX_SUBDIV_LEVELS, subdivIndexOffsets.data());
+    auto optimizedSeconds = SecondsSince(start);
+
+    std::cout << std::fixed << std::setprecision(2) << "Geospheres with " << MESH_MAX_SUBDIV_LEVELS
+              << " subdiv levels: " << 1000.0 * subdividedSeconds << " ms, " << 1000.0 * optimizedSeconds
+              << " ms with reordering" << std::endl;
+
+    for (unsigned int level = 0; level <= MESH_MAX_SUBDIV_LEVELS; ++level) {
+        auto indexStart = subdivIndexOffsets[level];
+        auto indexCount = subdivIndexOffsets[level + 1] - indexStart;
+        std::cout << "  Level " << level << ", " << std::setw(6) << indexCount / 3 << " triangles:";
+        for (auto cacheSize : cacheSizes) {
+            auto before = AnalyzeVertexCache(&subdivided.indices[indexStart], indexCount, subdivided.vertices.size(), cacheSize);
+            auto after = AnalyzeVertexCache(&optimized.indices[indexStart], indexCount, optimized.vertices.size(), cacheSize);
+            std::cout << "  FIFO " << std::setw(2) << cacheSize << " ACMR " << before.acmr << " -> " << after.acmr
+                      << ", ATVR " << before.atvr << " -> " << after.atvr;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+
+// Quantized radial asteroid meshes against the float meshes they are encoded from: generation
+// cost, the vertex stream the GPU fetches, and the decode error.
+int BenchmarkMeshQuantization(const Settings& baseSettings)
+{
+    std::vector<unsigned int> subdivIndexOffsets(MESH_MAX_SUBDIV_LEVELS + 2);
+    unsigned int vertexCountPerMesh = 0;
+
+    Mesh reference;
+    auto start = Clock::now();
+    CreateAsteroidsFromGeospheres(&reference, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_MESHES, 1337,
+                                  subdivIndexOffsets.data(), &vertexCountPerMesh);
+    auto referenceSeconds = SecondsSince(start);
+
+    RadialMesh radial;
+    start = Clock::now();
+    CreateAsteroidsFromGeospheres(&radial, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_MESHES, 1337,
+                                  subdivIndexOffsets.data(), &vertexCountPerMesh);
+    auto radialSeconds = SecondsSince(start);
+
+    auto referenceBytes = reference.vertices.size() * sizeof(Vertex);
+    auto radialBytes = radial.vertices.size() * sizeof(RadialVertex) + radial.directions.size() * sizeof(XMFLOAT3);
+    auto error = MeasureRadialMeshError(radial, reference);
+
+    std::cout << NUM_UNIQUE_MESHES << " meshes of " << vertexCountPerMesh << " vertices" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "  Float:  " << std::setw(7) << 1000.0 * referenceSeconds << " ms, " << std::setw(2) << sizeof(Vertex)
+              << " B/vertex, " << std::setw(7) << referenceBytes / (1024.0 * 1024.0) << " MB" << std::endl
+              << "  Radial: " << std::setw(7) << 1000.0 * radialSeconds << " ms, " << std::setw(2) << sizeof(RadialVertex)
+              << " B/vertex, " << std::setw(7) << radialBytes / (1024.0 * 1024.0) << " MB ("
+              << std::setprecision(2) << (double)referenceBytes / radialBytes << "x smaller)" << std::endl;
+    std::cout << std::scientific << std::setprecision(2)
+              << "  Position error / radius: max " << error.maxPosition << ", rms " << error.rmsPosition << std::endl
+              << std::fixed
+              << "  Normal error: max " << error.maxNormal * (180.0f / XM_PI) << " deg, mean "
+              << error.meanNormal * (180.0f / XM_PI) << " deg" << std::endl;
+
+    return 0;
+}
+
+
+// Simulation construction time as the field grows. Mesh and texture generation don't depend on
+// the asteroid count, so the growth is the per-asteroid setup (reported on its own by the
+// constructor) and the grid build. Every asteroid parameter, the mesh instance included, comes
+// from the (seed, index) stream, so each field starts with the asteroids of the smaller ones.
+int BenchmarkStartup(const Settings& baseSettings)
+{
+    const unsigned int counts[] = { 50000, 1000000, 10000000 };
+
+    std::unique_ptr<AsteroidsSimulation> smallest;
+    for (auto count : counts) {
+        auto start = Clock::now();
+        std::unique_ptr<AsteroidsSimulation> asteroids(new AsteroidsSimulation(
+            1337, count, NUM_UNIQUE_MESHES, MESH_MAX_SUBDIV_LEVELS, NUM_UNIQUE_TEXTURES));
+        auto seconds = SecondsSince(start);
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "  " << std::setw(8) << count << " asteroids: " << std::setw(9) << 1000.0 * seconds
+                  << " ms total, " << std::setw(7) << 1e9 * seconds / count << " ns/asteroid" << std::endl;
+
+        if (!smallest) {
+            smallest = std::move(asteroids);
+            continue;
+        }
+
+        size_t differ = 0;
+        for (size_t i = 0; i < smallest->AsteroidCount(); ++i) {
+            differ += smallest->Scale(i) != asteroids->Scale(i) ||
+                      smallest->OrbitVelocity(i) != asteroids->OrbitVelocity(i) ||
+                      smallest->TextureIndex(i) != asteroids->TextureIndex(i) ||
+                      smallest->VertexStart(i) != asteroids->VertexStart(i) ||
+                      smallest->RadiusScale(i) != asteroids->RadiusScale(i) ||
+                      XMVector4NotEqual(smallest->SpinAxis(i), asteroids->SpinAxis(i)) ||
+                      XMVector4NotEqual(smallest->SimulatedWorld(i).r[3], asteroids->SimulatedWorld(i).r[3]);
+        }
+        std::cout << "    First " << smallest->AsteroidCount() << " asteroids differing from the "
+                  << smallest->AsteroidCount() << " asteroid field: " << differ << std::endl;
+    }
+
+    return 0;
+}
+
+
+struct Benchmark
+{
+    const char* name;
+    const char* description;
+    int (*run)(const Settings& settings);
+};
+
+const Benchmark gBenchmarks[] = {
+    { "sim_layout", "Update cost of the SoA asteroid storage vs. the original AoS layout", BenchmarkSimLayout },
+    { "sim_simd",   "Update cost of each SIMD kernel and LOD agreement with the scalar path", BenchmarkSimSimd },
+    { "sim_motion", "Integrated vs. closed-form motion: cost, drift and seeking", BenchmarkSimMotion },
+    { "cull",       "Flat vs. spatial grid frustum culling: cost, survivors and agreement", BenchmarkCull },
+    { "occlusion",  "CPU occlusion culling from inside the belt: occluded share and cost", BenchmarkOcclusion },
+    { "draw_buckets", "Cost, histogram and correctness of LOD/texture draw list bucketing", BenchmarkDrawBuckets },
+    { "overdraw",   "Software-estimated overdraw and Cull cost of each draw order, from inside the belt", BenchmarkOverdraw },
+    { "fixed_step", "Fixed-step determinism across frame time patterns and cost with interpolation", BenchmarkFixedStep },
+    { "jobs",       "Sim update scaling with job system thread count and parallel_for overhead", BenchmarkJobs },
+    { "lod_governor", "Settling time and steady-state wander of the LOD budget controller", BenchmarkLodGovernor },
+    { "lod_table",  "Update cost and LOD levels of log2 screen size vs. distance threshold table", BenchmarkLodTable },
+    { "startup",    "Simulation construction time at 50k, 1M and 10M asteroids", BenchmarkStartup },
+    { "resort",     "Culling/Update cost and draw locality before and after a Morton re-sort", BenchmarkResort },
+    { "amortize",   "Update cost, per-band update rate and position error of amortized far updates", BenchmarkAmortize },
+    { "collisions", "Collision detection and response: pairs tested per second and thread scaling", BenchmarkCollisions },
+    { "gravity",    "Barnes-Hut N-body gravity: interactions per second and thread scaling", BenchmarkGravity },
+    { "queries",    "Ray, sphere and nearest-neighbor queries over 1M asteroids: BVH upkeep and throughput", BenchmarkQueries },
+    { "geospheres", "CreateGeospheres cost at 3 through 6 subdiv levels", BenchmarkGeospheres },
+    { "vertex_cache", "Per-LOD vertex cache ACMR/ATVR before and after the startup reordering", BenchmarkVertexCache },
+    { "meshquant",  "Quantized radial asteroid meshes: size and decode error against the float meshes", BenchmarkMeshQuantization },
+};
+
+// Case-insensitive, like the command line options; _stricmp is MSVC-only
+bool NamesMatch(const char* a, const char* b)
+{
+    for (; *a && *b; ++a, ++b) {
+        if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) return false;
+    }
+    return *a == *b;
+}
+
+} // namespace
+
+
+int RunBenchmark(const char* name, const Settings& baseSettings)
+{
+    // No window, so render at the size one would have been created at
+    Settings settings = baseSettings;
+    settings.renderWidth = (int)(settings.windowWidth * settings.renderScale);
+    settings.renderHeight = (int)(settings.windowHeight * settings.renderScale);
+
+    for (auto const& benchmark : gBenchmarks) {
+        if (NamesMatch(name, benchmark.name)) {
+            return benchmark.run(settings);
+        }
+    }
+
+    fprintf(stderr, "error: unknown benchmark '%s'\n", name);
+    fprintf(stderr, "benchmarks:\n");
+    for (auto const& benchmark : gBenchmarks) {
+        fprintf(stderr, "  %-16s %s\n", benchmark.name, benchmark.description);
+    }
+    return -1;
+}
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+// Entry point of the headless benchmark build (see CMakeLists.txt), for platforms without the
+// D3D front end. Takes the simulation-side subset of WinWrapper's options.
+
+#include "benchmark.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static bool OptionIs(const char* arg, const char* option)
+{
+    for (; *arg && *option; ++arg, ++option) {
+        if (tolower((unsigned char)*arg) != tolower((unsigned char)*option)) return false;
+    }
+    return *arg == *option;
+}
+
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    char* benchmarkName = nullptr;
+    for (int a = 1; a < argc; ++a) {
+        if (OptionIs(argv[a], "-window") && a + 2 < argc) {
+            settings.windowWidth = atoi(argv[++a]);
+            settings.windowHeight = atoi(argv[++a]);
+            printf("%ux%u window\n", settings.windowWidth, settings.windowHeight);
+        } else if (OptionIs(argv[a], "-render_scale") && a + 1 < argc) {
+            settings.renderScale = atof(argv[++a]);
+            printf("%f render scale\n", settings.renderScale);
+        } else if (OptionIs(argv[a], "-num_asteroids") && a + 1 < argc) {
+            settings.numAsteroids = (unsigned int) std::max(0, atoi(argv[++a]));
+            printf("%u asteroids\n", settings.numAsteroids);
+        } else if (OptionIs(argv[a], "-job_threads") && a + 1 < argc) {
+            settings.jobThreads = (unsigned int) std::max(1, atoi(argv[++a]));
+            printf("%u job threads\n", settings.jobThreads);
+        } else if (OptionIs(argv[a], "-sim_simd") && a + 1 < argc) {
+            ++a;
+            if      (OptionIs(argv[a], "scalar")) settings.simdLevel = SIMD_LEVEL_SCALAR;
+            else if (OptionIs(argv[a], "sse41"))  settings.simdLevel = SIMD_LEVEL_SSE41;
+            else if (OptionIs(argv[a], "avx2"))   settings.simdLevel = SIMD_LEVEL_AVX2;
+            printf("Simulation SIMD limited to %s\n", SimdLevelName(settings.simdLevel));
+        } else if (OptionIs(argv[a], "-benchmark") && a + 1 < argc) {
+            benchmarkName = argv[++a];
+            printf("Run benchmark '%s'\n", benchmarkName);
+        } else {
+            fprintf(stderr, "error: unrecognized argument '%s'\n", argv[a]);
+            benchmarkName = nullptr;
+            break;
+        }
+    }
+
+    if (benchmarkName == nullptr) {
+        fprintf(stderr, "usage: asteroids_benchmark -benchmark [name] [options]\n");
+        fprintf(stderr, "options:\n");
+        fprintf(stderr, "  -window [width] [height]\n");
+        fprintf(stderr, "  -render_scale [scale]\n");
+        fprintf(stderr, "  -num_asteroids [count]\n");
+        fprintf(stderr, "  -job_threads [count]\n");
+        fprintf(stderr, "  -sim_simd [scalar|sse41|avx2]\n");
+        return -1;
+    }
+
+    JobSystem::SetDefaultThreadCount(settings.jobThreads);
+    return RunBenchmark(benchmarkName, settings);
+}
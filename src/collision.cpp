@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "collision.h"
+#include "radix_sort.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+// Share of the spheres, the largest, binned in the coarse hash
+static const float COLLISION_LARGE_FRACTION = 0.05f;
+
+void CollisionBroadphase::Reset(size_t count, const float* radius)
+{
+    mRadius.assign(radius, radius + count);
+    mSmall = HashGrid();
+    mLarge = HashGrid();
+    if (count == 0) return;
+
+    // Radius at and below which spheres go in the fine hash
+    std::vector<float> sorted(mRadius);
+    size_t split = std::min(count - 1, (size_t)((1.0f - COLLISION_LARGE_FRACTION) * count));
+    std::nth_element(sorted.begin(), sorted.begin() + split, sorted.end());
+    float splitRadius = sorted[split];
+
+    for (size_t i = 0; i < count; ++i) {
+        auto grid = (mRadius[i] <= splitRadius) ? &mSmall : &mLarge;
+        grid->members.push_back((unsigned int)i);
+        grid->maxRadius = std::max(grid->maxRadius, mRadius[i]);
+    }
+
+    // Two spheres of a hash that touch are at most a cell apart on each axis
+    for (auto grid : { &mSmall, &mLarge }) {
+        grid->cellSize = std::max(2.0f * grid->maxRadius, 1e-3f);
+        grid->bucketBits = 10;
+        while (grid->bucketBits < MAX_BUCKET_BITS && ((size_t)1 << grid->bucketBits) < 4 * grid->members.size()) {
+            grid->bucketBits++;
+        }
+    }
+}
+
+
+void CollisionBroadphase::Build(const XMFLOAT3* centers, JobSystem& jobSystem)
+{
+    mCenters = centers;
+    BuildGrid(&mSmall, jobSystem);
+    BuildGrid(&mLarge, jobSystem);
+}
+
+
+void CollisionBroadphase::BuildGrid(HashGrid* grid, JobSystem& jobSystem)
+{
+    enum { CHUNK_SIZE = 4096 };
+    auto const& members = grid->members;
+    size_t count = members.size();
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (count == 0) return;
+
+    grid->entries.resize(count);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            auto center = mCenters[members[k]];
+            auto bucket = Bucket(CellCoord(center.x, grid->cellSize), CellCoord(center.y, grid->cellSize),
+                                 CellCoord(center.z, grid->cellSize), grid->bucketBits);
+            grid->entries[k] = ((uint64_t)bucket << 32) | members[k];
+        }
+    }, 1);
+
+    // Members are in index order and the sort is stable, so each bucket lists its spheres in
+    // index order too and queries don't depend on the thread count
+    RadixSortHighBits(&grid->entries, &grid->scratch, grid->bucketBits, jobSystem);
+
+    // Every bucket's start is written exactly once, by the first entry at or after it
+    unsigned int bucketCount = 1u << grid->bucketBits;
+    grid->cells.resize(count);
+    grid->spheres.resize(count);
+    grid->bucketStart.resize(bucketCount + 1);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            auto i = (unsigned int)grid->entries[k];
+            auto center = mCenters[i];
+            grid->cells[k] = CellKey(CellCoord(center.x, grid->cellSize), CellCoord(center.y, grid->cellSize),
+                                     CellCoord(center.z, grid->cellSize));
+            grid->spheres[k] = XMFLOAT4(center.x, center.y, center.z, mRadius[i]);
+
+            unsigned int bucket = (unsigned int)(grid->entries[k] >> 32);
+            unsigned int firstBucket = (k == 0) ? 0 : (unsigned int)(grid->entries[k - 1] >> 32) + 1;
+            for (unsigned int b = firstBucket; b <= bucket; ++b) {
+                grid->bucketStart[b] = (unsigned int)k;
+            }
+        }
+    }, 1);
+    for (unsigned int b = (unsigned int)(grid->entries[count - 1] >> 32) + 1; b <= bucketCount; ++b) {
+        grid->bucketStart[b] = (unsigned int)count;
+    }
+}
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "job_system.h"
+
+// Broadphase for overlapping spheres, such as the asteroids' bounding spheres. Spheres are binned
+// by center into two uniform spatial hashes: most go in a fine one with cells the diameter of the
+// largest of them, and the largest few percent in a coarse one sized for the very largest, so
+// neither the common case nor the outliers set the cell size for everyone. Each hash is a
+// parallel radix sort of (bucket, sphere) pairs plus a table of where each bucket starts, with
+// the spheres copied out in that order.
+//
+// Cells are hashed in 4x4x4 blocks so nearby cells get nearby buckets, and there are about four
+// buckets per sphere so far cells rarely share one; those that do are told apart by their full
+// key. Querying spheres in bucket order (see SphereInOrder) then walks memory coherently.
+//
+// Queries gather the overlaps of one sphere at a time, in a fixed order, so callers can resolve
+// every sphere in parallel without atomics and get the same result whatever the thread count.
+class CollisionBroadphase
+{
+public:
+    // Takes the radii, which stay fixed until the next Reset, and sizes the cells from them
+    void Reset(size_t count, const float* radius);
+
+    size_t Count() const { return mRadius.size(); }
+    float Radius(size_t i) const { return mRadius[i]; }
+
+    // The spheres in hash order, k in [0, Count()), as of the last Build
+    unsigned int SphereInOrder(size_t k) const
+    {
+        return k < mSmall.entries.size() ? (unsigned int)mSmall.entries[k]
+                                         : (unsigned int)mLarge.entries[k - mSmall.entries.size()];
+    }
+
+    // Bins the spheres at their current centers, which must stay put until the queries are done
+    void Build(const DirectX::XMFLOAT3* centers, JobSystem& jobSystem);
+
+    // Calls overlap(j) for each sphere j != i whose sphere overlaps sphere i and returns the number
+    // of spheres tested. Safe to call from any number of threads between Builds.
+    template <typename Overlap>
+    unsigned int ForEachOverlap(unsigned int i, const Overlap& overlap) const
+    {
+        // Anything that can touch sphere i has its center within reach of i's
+        return QueryGrid(mSmall, i, mRadius[i] + mSmall.maxRadius, overlap) +
+               QueryGrid(mLarge, i, mRadius[i] + mLarge.maxRadius, overlap);
+    }
+
+private:
+    enum { CELL_BIAS = 1 << 20 }; // Cell coordinates are stored in 21 bits each
+    enum { MAX_BUCKET_BITS = 24 };
+
+    struct HashGrid
+    {
+        float cellSize = 1.0f;
+        float maxRadius = 0.0f;
+        unsigned int bucketBits = 0;
+        std::vector<unsigned int> members;     // Spheres binned here
+        std::vector<uint64_t> entries;         // Bucket << 32 | sphere, sorted
+        std::vector<uint64_t> scratch;
+        std::vector<uint64_t> cells;           // Cell key of each entry
+        std::vector<DirectX::XMFLOAT4> spheres; // Center and radius of each entry
+        std::vector<unsigned int> bucketStart; // Per bucket, plus the end
+    };
+
+    static uint64_t CellKey(int x, int y, int z)
+    {
+        return (uint64_t)(x + CELL_BIAS) | ((uint64_t)(y + CELL_BIAS) << 21) | ((uint64_t)(z + CELL_BIAS) << 42);
+    }
+    // Cells are grouped in 4x4x4 blocks whose 64 buckets are consecutive; the blocks themselves
+    // are hashed. Neighboring cells mostly share a block, so a query touches few cache lines of
+    // the bucket table, and walking the buckets in order walks space block by block.
+    static unsigned int Bucket(int x, int y, int z, unsigned int bucketBits)
+    {
+        uint64_t block = CellKey(x >> 2, y >> 2, z >> 2) * 0x9E3779B97F4A7C15ull;
+        unsigned int local = (unsigned int)(((x & 3) << 4) | ((y & 3) << 2) | (z & 3));
+        return ((unsigned int)(block >> 32) << 6 | local) & ((1u << bucketBits) - 1);
+    }
+    static int CellCoord(float x, float cellSize) { return (int)std::floor(x / cellSize); }
+
+    void BuildGrid(HashGrid* grid, JobSystem& jobSystem);
+
+    template <typename Overlap>
+    unsigned int QueryGrid(const HashGrid& grid, unsigned int i, float reach, const Overlap& overlap) const
+    {
+        if (grid.members.empty()) return 0;
+
+        auto center = mCenters[i];
+        int x0 = CellCoord(center.x - reach, grid.cellSize), x1 = CellCoord(center.x + reach, grid.cellSize);
+        int y0 = CellCoord(center.y - reach, grid.cellSize), y1 = CellCoord(center.y + reach, grid.cellSize);
+        int z0 = CellCoord(center.z - reach, grid.cellSize), z1 = CellCoord(center.z + reach, grid.cellSize);
+
+        unsigned int tests = 0;
+        for (int z = z0; z <= z1; ++z) {
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    auto key = CellKey(x, y, z);
+                    auto bucket = Bucket(x, y, z, grid.bucketBits);
+                    for (auto k = grid.bucketStart[bucket]; k < grid.bucketStart[bucket + 1]; ++k) {
+                        // Far cells can share the bucket
+                        if (grid.cells[k] != key) continue;
+                        auto j = (unsigned int)grid.entries[k];
+                        if (j == i) continue;
+
+                        ++tests;
+                        auto const& sphere = grid.spheres[k];
+                        float dx = sphere.x - center.x;
+                        float dy = sphere.y - center.y;
+                        float dz = sphere.z - center.z;
+                        float r = mRadius[i] + sphere.w;
+                        if (dx * dx + dy * dy + dz * dz < r * r) {
+                            overlap(j);
+                        }
+                    }
+                }
+            }
+        }
+        return tests;
+    }
+
+    std::vector<float> mRadius;
+    const DirectX::XMFLOAT3* mCenters = nullptr;
+    HashGrid mSmall;
+    HashGrid mLarge;
+};
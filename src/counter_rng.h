@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011). A
+// counter-based generator: output block n of stream (seed, index) is a pure function of those
+// three values, so any stream can be started anywhere, on any thread, in O(1).
+inline void Philox4x32(uint32_t const counter[4], uint32_t const key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// Random numbers for one (seed, index) stream; e.g. everything about asteroid i
+class CounterRng
+{
+public:
+    CounterRng(uint32_t seed, uint64_t index)
+        : mKey{ seed, 0x41535452u /* "ASTR" */ }
+        , mCounter{ (uint32_t)index, (uint32_t)(index >> 32), 0, 0 }
+    {
+    }
+
+    uint32_t NextUInt()
+    {
+        if (mNext == 4) {
+            Philox4x32(mCounter, mKey, mBlock);
+            ++mCounter[2];
+            mNext = 0;
+        }
+        return mBlock[mNext++];
+    }
+
+    // [0, 1)
+    float NextFloat() { return (float)(NextUInt() >> 8) * (1.0f / 16777216.0f); }
+
+    // [a, b)
+    float Uniform(float a, float b) { return a + (b - a) * NextFloat(); }
+
+    // [0, n); the bias of a multiply-shift is negligible for the small n used here
+    uint32_t UniformInt(uint32_t n) { return (uint32_t)(((uint64_t)NextUInt() * n) >> 32); }
+
+    // Box-Muller; the second value of each pair is kept for the next call
+    float Normal(float mean, float stddev)
+    {
+        if (mHaveSpare) {
+            mHaveSpare = false;
+            return mean + stddev * mSpare;
+        }
+        float u = 1.0f - NextFloat(); // (0, 1], keeps log finite
+        float r = std::sqrt(-2.0f * std::log(u));
+        float theta = 6.28318530718f * NextFloat();
+        mSpare = r * std::sin(theta);
+        mHaveSpare = true;
+        return mean + stddev * r * std::cos(theta);
+    }
+
+private:
+    uint32_t mKey[2];
+    uint32_t mCounter[4];
+    uint32_t mBlock[4];
+    unsigned int mNext = 4;
+    float mSpare = 0.0f;
+    bool mHaveSpare = false;
+};
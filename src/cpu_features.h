@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <stdint.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Instruction sets the simulation kernels can be dispatched to, in increasing order
+enum SimdLevel
+{
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE41,
+    SIMD_LEVEL_AVX2,
+    SIMD_LEVEL_AVX512,
+};
+
+inline const char* SimdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SIMD_LEVEL_SSE41:  return "SSE4.1";
+    case SIMD_LEVEL_AVX2:   return "AVX2";
+    case SIMD_LEVEL_AVX512: return "AVX-512";
+    default:                return "Scalar";
+    }
+}
+
+// CPUID leaf/subleaf into EAX, EBX, ECX, EDX; zeros for leaves past the highest one
+inline void CpuId(int info[4], int leaf, int subleaf = 0)
+{
+#if defined(_MSC_VER)
+    __cpuidex(info, leaf, subleaf);
+#else
+    unsigned int r[4] = {};
+    __get_cpuid_count((unsigned int)leaf, (unsigned int)subleaf, &r[0], &r[1], &r[2], &r[3]);
+    for (int i = 0; i < 4; ++i) info[i] = (int)r[i];
+#endif
+}
+
+// XCR0: which register state the OS saves. Only valid if CPUID reports OSXSAVE.
+inline uint64_t ExtendedControlRegister0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t)edx << 32 | eax;
+#endif
+}
+
+// Highest level supported by both the CPU and the OS (i.e. the OS saves the wider register state)
+inline SimdLevel DetectSimdLevel()
+{
+    int info[4] = {};
+    CpuId(info, 0);
+    int maxLeaf = info[0];
+
+    CpuId(info, 1);
+    bool sse41   = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!sse41) return SIMD_LEVEL_SCALAR;
+    if (!(osxsave && avx)) return SIMD_LEVEL_SSE41;
+
+    auto xcr0 = ExtendedControlRegister0();
+    if ((xcr0 & 0x6) != 0x6 || maxLeaf < 7) return SIMD_LEVEL_SSE41; // XMM/YMM state
+
+    CpuId(info, 7, 0);
+    bool avx2    = (info[1] & (1 <<  5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+    if (!avx2) return SIMD_LEVEL_SSE41;
+    if (!avx512f || (xcr0 & 0xE0) != 0xE0) return SIMD_LEVEL_AVX2; // Opmask/ZMM state
+
+    return SIMD_LEVEL_AVX512;
+}
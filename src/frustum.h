@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+
+// View frustum as six normalized planes (xyz = normal pointing inside, w = distance)
+struct Frustum
+{
+    DirectX::XMVECTOR planes[6];
+};
+
+// Gribb/Hartmann plane extraction for row-vector matrices (clip = v * M) and D3D clip space
+// (0 <= z <= w). Works unchanged with our reversed-Z projection; near/far just swap roles.
+inline Frustum ExtractFrustum(DirectX::FXMMATRIX viewProjection)
+{
+    using namespace DirectX;
+    auto columns = XMMatrixTranspose(viewProjection);
+
+    Frustum f;
+    f.planes[0] = XMVectorAdd(columns.r[3], columns.r[0]);      // Left
+    f.planes[1] = XMVectorSubtract(columns.r[3], columns.r[0]); // Right
+    f.planes[2] = XMVectorAdd(columns.r[3], columns.r[1]);      // Bottom
+    f.planes[3] = XMVectorSubtract(columns.r[3], columns.r[1]); // Top
+    f.planes[4] = columns.r[2];                                 // z >= 0
+    f.planes[5] = XMVectorSubtract(columns.r[3], columns.r[2]); // z <= w
+    for (auto& p : f.planes) {
+        p = XMPlaneNormalize(p);
+    }
+    return f;
+}
+
+enum FrustumTest
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE,
+};
+
+// Conservative: boxes near frustum corners can report INTERSECTS while being outside
+inline FrustumTest BoxInFrustum(const Frustum& frustum, DirectX::FXMVECTOR center, DirectX::FXMVECTOR extents)
+{
+    using namespace DirectX;
+    auto c = XMVectorSetW(center, 1.0f);
+    auto result = FRUSTUM_INSIDE;
+    for (auto const& p : frustum.planes) {
+        float distance = XMVectorGetX(XMVector4Dot(p, c));
+        float radius = XMVectorGetX(XMVector3Dot(XMVectorAbs(p), extents));
+        if (distance < -radius) return FRUSTUM_OUTSIDE;
+        if (distance < radius) result = FRUSTUM_INTERSECTS;
+    }
+    return result;
+}
+
+inline bool SphereInFrustum(const Frustum& frustum, DirectX::FXMVECTOR center, float radius)
+{
+    using namespace DirectX;
+    auto c = XMVectorSetW(center, 1.0f);
+    for (auto const& p : frustum.planes) {
+        if (XMVectorGetX(XMVector4Dot(p, c)) < -radius) return false;
+    }
+    return true;
+}
@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "gravity.h"
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+
+GravityTree::Node GravityTree::MakeNode(unsigned int first, unsigned int count, unsigned int level) const
+{
+    Node node = {};
+    float edge = mRootEdge / (float)(1u << level);
+    node.edgeSq = edge * edge;
+    node.first = first;
+    node.count = count;
+    return node;
+}
+
+
+void GravityTree::SumChildren(std::vector<Node>* nodes, unsigned int n) const
+{
+    auto node = &(*nodes)[n];
+    float x = 0.0f, y = 0.0f, z = 0.0f, mass = 0.0f;
+    if (node->childCount == 0) {
+        for (unsigned int k = node->first; k < node->first + node->count; ++k) {
+            auto const& body = mBodies[k];
+            x += body.w * body.x;
+            y += body.w * body.y;
+            z += body.w * body.z;
+            mass += body.w;
+        }
+    } else {
+        for (unsigned int c = node->firstChild; c < node->firstChild + node->childCount; ++c) {
+            auto const& child = (*nodes)[c].massCenter;
+            x += child.w * child.x;
+            y += child.w * child.y;
+            z += child.w * child.z;
+            mass += child.w;
+        }
+    }
+    float invMass = mass > 0.0f ? 1.0f / mass : 0.0f;
+    node->massCenter = XMFLOAT4(x * invMass, y * invMass, z * invMass, mass);
+}
+
+
+void GravityTree::Split(std::vector<Node>* nodes, unsigned int n, unsigned int level, std::vector<Task>* tasks) const
+{
+    auto first = (*nodes)[n].first;
+    auto count = (*nodes)[n].count;
+    if (count > LEAF_SIZE && level < MORTON_BITS) {
+        if (tasks && count <= TASK_SIZE) {
+            tasks->push_back({ n, level });
+            return;
+        }
+
+        // The range is sorted, so each non-empty child is a run of one digit
+        auto firstChild = (unsigned int)nodes->size();
+        for (auto k = first; k < first + count; ) {
+            auto digit = ChildDigit(k, level);
+            auto end = k + 1;
+            while (end < first + count && ChildDigit(end, level) == digit) ++end;
+            nodes->push_back(MakeNode(k, end - k, level + 1));
+            k = end;
+        }
+        (*nodes)[n].firstChild = firstChild;
+        (*nodes)[n].childCount = (unsigned int)nodes->size() - firstChild;
+
+        for (auto c = firstChild; c < firstChild + (*nodes)[n].childCount; ++c) {
+            Split(nodes, c, level + 1, tasks);
+        }
+    }
+
+    // Done on the way back up, except for the top of the tree, whose task subtrees aren't built yet
+    if (!tasks) {
+        SumChildren(nodes, n);
+    }
+}
+
+
+void GravityTree::Build(size_t count, const XMFLOAT3* positions, const float* masses, JobSystem& jobSystem)
+{
+    enum { CHUNK_SIZE = 4096 };
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    mKeys.resize(count);
+    mBodies.resize(count);
+    mNodes.clear();
+    mTasks.clear();
+    if (count == 0) return;
+
+    // Bounding cube, from per-chunk bounds
+    std::vector<XMFLOAT3> chunkMin(chunkCount), chunkMax(chunkCount);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        auto lo = XMVectorReplicate(FLT_MAX);
+        auto hi = XMVectorReplicate(-FLT_MAX);
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; ++i) {
+            auto p = XMLoadFloat3(&positions[i]);
+            lo = XMVectorMin(lo, p);
+            hi = XMVectorMax(hi, p);
+        }
+        XMStoreFloat3(&chunkMin[chunk], lo);
+        XMStoreFloat3(&chunkMax[chunk], hi);
+    }, 1);
+    auto lo = XMLoadFloat3(&chunkMin[0]);
+    auto hi = XMLoadFloat3(&chunkMax[0]);
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        lo = XMVectorMin(lo, XMLoadFloat3(&chunkMin[chunk]));
+        hi = XMVectorMax(hi, XMLoadFloat3(&chunkMax[chunk]));
+    }
+    XMFLOAT3 origin, extent;
+    XMStoreFloat3(&origin, lo);
+    XMStoreFloat3(&extent, XMVectorSubtract(hi, lo));
+    // Slightly oversized so the far faces quantize inside
+    mRootEdge = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f)) * 1.0001f;
+
+    // Morton keys. Members are in index order and the sort is stable, so the order only depends
+    // on the positions.
+    float scale = (float)(1 << MORTON_BITS) / mRootEdge;
+    auto quantize = [&](float v, float lo) {
+        return (uint32_t)std::min(std::max((v - lo) * scale, 0.0f), (float)((1 << MORTON_BITS) - 1));
+    };
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; ++i) {
+            auto p = positions[i];
+            uint32_t key = Part1By2(quantize(p.x, origin.x)) |
+                           Part1By2(quantize(p.y, origin.y)) << 1 |
+                           Part1By2(quantize(p.z, origin.z)) << 2;
+            mKeys[i] = (uint64_t)key << 32 | i;
+        }
+    }, 1);
+    RadixSortHighBits(&mKeys, &mScratch, 3 * MORTON_BITS, jobSystem);
+
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            auto i = BodyInOrder(k);
+            mBodies[k] = XMFLOAT4(positions[i].x, positions[i].y, positions[i].z, masses[i]);
+        }
+    }, 1);
+
+    // Top of the tree, serially, down to subtrees small enough for one job each
+    mNodes.push_back(MakeNode(0, (unsigned int)count, 0));
+    Split(&mNodes, 0, 0, &mTasks);
+
+    // Each task builds its subtree on its own, with the task node at local index 0
+    if (mTaskNodes.size() < mTasks.size()) {
+        mTaskNodes.resize(mTasks.size());
+    }
+    jobSystem.ParallelFor(size_t(0), mTasks.size(), [&](size_t t) {
+        auto& nodes = mTaskNodes[t];
+        nodes.clear();
+        nodes.push_back(mNodes[mTasks[t].node]);
+        Split(&nodes, 0, mTasks[t].level, nullptr);
+    }, 1);
+
+    // Splice the subtrees in after the top of the tree, in task order
+    std::vector<unsigned int> offsets(mTasks.size());
+    size_t nodeCount = mNodes.size();
+    for (size_t t = 0; t < mTasks.size(); ++t) {
+        offsets[t] = (unsigned int)nodeCount - 1; // Local index 1 lands at the offset + 1
+        nodeCount += mTaskNodes[t].size() - 1;
+    }
+    size_t topCount = mNodes.size();
+    mNodes.resize(nodeCount);
+    jobSystem.ParallelFor(size_t(0), mTasks.size(), [&](size_t t) {
+        auto const& nodes = mTaskNodes[t];
+        auto relocate = [&](Node node) {
+            node.firstChild += node.childCount > 0 ? offsets[t] : 0;
+            return node;
+        };
+        mNodes[mTasks[t].node] = relocate(nodes[0]);
+        for (size_t n = 1; n < nodes.size(); ++n) {
+            mNodes[offsets[t] + n] = relocate(nodes[n]);
+        }
+    }, 1);
+
+    // Children come after their parents, so the top of the tree sums bottom up in reverse.
+    // Task nodes were summed by their jobs.
+    std::vector<bool> isTask(topCount, false);
+    for (auto const& task : mTasks) {
+        isTask[task.node] = true;
+    }
+    for (size_t n = topCount; n-- > 0; ) {
+        if (!isTask[n]) {
+            SumChildren(&mNodes, (unsigned int)n);
+        }
+    }
+}
+
+
+XMVECTOR GravityTree::AccelerationInOrder(size_t k, float openingAngle, float softeningSq, uint64_t* interactions) const
+{
+    // Deep enough for a full path of MORTON_BITS levels with all 8 children pending at each
+    enum { MAX_STACK = 8 * (MORTON_BITS + 1) };
+    unsigned int stack[MAX_STACK];
+    unsigned int depth = 0;
+
+    auto const& self = mBodies[k];
+    float openingSq = openingAngle * openingAngle;
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    uint64_t taken = 0;
+
+    auto attract = [&](const XMFLOAT4& mass) {
+        float dx = mass.x - self.x;
+        float dy = mass.y - self.y;
+        float dz = mass.z - self.z;
+        float invDistance = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + softeningSq);
+        float s = mass.w * invDistance * invDistance * invDistance;
+        ax += s * dx;
+        ay += s * dy;
+        az += s * dz;
+    };
+
+    stack[depth++] = 0;
+    while (depth > 0) {
+        auto const& node = mNodes[stack[--depth]];
+        if (node.childCount == 0) {
+            for (unsigned int b = node.first; b < node.first + node.count; ++b) {
+                if (b != k) {
+                    attract(mBodies[b]);
+                    ++taken;
+                }
+            }
+            continue;
+        }
+
+        float dx = node.massCenter.x - self.x;
+        float dy = node.massCenter.y - self.y;
+        float dz = node.massCenter.z - self.z;
+        if (node.edgeSq < openingSq * (dx * dx + dy * dy + dz * dz)) {
+            attract(node.massCenter);
+            ++taken;
+        } else {
+            for (unsigned int c = node.firstChild + node.childCount; c-- > node.firstChild; ) {
+                stack[depth++] = c;
+            }
+        }
+    }
+
+    *interactions += taken;
+    return XMVectorSet(ax, ay, az, 0.0f);
+}
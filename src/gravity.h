@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+#include "job_system.h"
+
+// Barnes-Hut octree for approximate N-body gravity. Bodies are sorted along a Morton curve over
+// their bounding cube (a parallel radix sort), and the tree is cut from the sorted order: a node
+// is a cube whose bodies are a contiguous range, split by the next three bits of their codes.
+// The top of the tree is split serially until the ranges are small enough to hand one subtree
+// to each job; the subtrees are then built in parallel and spliced in.
+//
+// A query walks the tree for one body and takes a node's total mass at its center of mass once
+// the node is small enough next to its distance, and each body of a leaf otherwise. The walk
+// order is fixed, so bodies can be queried in parallel and give the same result whatever the
+// thread count.
+class GravityTree
+{
+public:
+    // Copies the bodies into Morton order and builds the tree over them. Masses include the
+    // gravitational constant.
+    void Build(size_t count, const DirectX::XMFLOAT3* positions, const float* masses, JobSystem& jobSystem);
+
+    size_t Count() const { return mBodies.size(); }
+    size_t NodeCount() const { return mNodes.size(); }
+
+    // The bodies in Morton order, k in [0, Count()), as of the last Build
+    unsigned int BodyInOrder(size_t k) const { return (unsigned int)mKeys[k]; }
+
+    // Acceleration of the k-th body in Morton order due to all the others, softened by
+    // softeningSq so close pairs stay bounded. A node is taken whole when its edge is under
+    // openingAngle times its distance; openingAngle must be under 1/sqrt(3) so a body never
+    // takes a node it is inside as a whole. Adds the number of bodies and nodes taken to
+    // interactions.
+    DirectX::XMVECTOR AccelerationInOrder(size_t k, float openingAngle, float softeningSq, uint64_t* interactions) const;
+
+private:
+    enum { MORTON_BITS = 10 }; // Per axis, which bounds the depth
+    enum { LEAF_SIZE = 8 };    // Bodies at and below which a node isn't split
+    enum { TASK_SIZE = 4096 }; // Bodies at and below which a subtree is built by a single job
+
+    struct Node
+    {
+        DirectX::XMFLOAT4 massCenter; // Center of mass and total mass
+        float edgeSq;                 // Squared edge of the node's cube
+        unsigned int firstChild;      // Children are consecutive
+        unsigned int childCount;      // 0 for leaves
+        unsigned int first;           // Range of bodies in Morton order
+        unsigned int count;
+    };
+
+    // A node at the top of the tree whose subtree is left to a job
+    struct Task
+    {
+        unsigned int node;
+        unsigned int level;
+    };
+
+    unsigned int ChildDigit(size_t k, unsigned int level) const
+    {
+        return (unsigned int)(mKeys[k] >> (32 + 3 * (MORTON_BITS - 1 - level))) & 7;
+    }
+
+    // Splits nodes[n] if it's big enough, and all the way down unless tasks is given, in which
+    // case nodes of at most TASK_SIZE bodies are left for it
+    void Split(std::vector<Node>* nodes, unsigned int n, unsigned int level, std::vector<Task>* tasks) const;
+    void SumChildren(std::vector<Node>* nodes, unsigned int n) const;
+    Node MakeNode(unsigned int first, unsigned int count, unsigned int level) const;
+
+    float mRootEdge = 0.0f;
+    std::vector<uint64_t> mKeys; // Morton code << 32 | body, sorted
+    std::vector<uint64_t> mScratch;
+    std::vector<DirectX::XMFLOAT4> mBodies; // Position and mass, in Morton order
+    std::vector<Node> mNodes;
+    std::vector<Task> mTasks;
+    std::vector<std::vector<Node>> mTaskNodes; // Per task, its subtree below the task node
+};
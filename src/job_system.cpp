@@ -0,0 +1,411 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "job_system.h"
+
+#include <assert.h>
+
+// Failed steals and empty queues before an idle worker goes to sleep
+enum { WORKER_SPIN_COUNT = 64 };
+
+struct JobSystem::Job
+{
+    Task task;
+    Job* parent = nullptr;
+    std::atomic<int> unfinished;    // This job plus its unfinished children
+    std::atomic<int> predecessors;  // Unfinished predecessors, plus one until submitted
+    std::atomic<int> references;
+
+    std::mutex successorMutex;
+    std::vector<Job*> successors;
+    bool finished = false;
+};
+
+namespace {
+
+// Which worker of which system the current thread is, if any
+struct WorkerIdentity
+{
+    const JobSystem* system;
+    int worker;
+};
+thread_local WorkerIdentity tWorker = { nullptr, -1 };
+
+std::atomic<unsigned int> gDefaultThreadCount(0);
+
+unsigned int XorShift(unsigned int* state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+} // namespace
+
+
+JobSystem::WorkStealingDeque::WorkStealingDeque()
+    : mTop(0)
+    , mBottom(0)
+{
+    for (auto& job : mJobs) {
+        job.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+
+bool JobSystem::WorkStealingDeque::Push(Job* job)
+{
+    auto bottom = mBottom.load(std::memory_order_relaxed);
+    auto top = mTop.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+        return false;
+    }
+    mJobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Take()
+{
+    auto bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto job = mJobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last one: race any thieves for it
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Steal()
+{
+    auto top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto bottom = mBottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    auto job = mJobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr; // Lost to the owner or another thief
+    }
+    return job;
+}
+
+
+bool JobSystem::WorkStealingDeque::Empty() const
+{
+    return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+}
+
+
+JobSystem::JobSystem(unsigned int threadCount)
+    : mSharedCount(0)
+    , mWorkEpoch(0)
+    , mSleepers(0)
+    , mQuit(false)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    unsigned int workerCount = threadCount - 1;
+
+    for (unsigned int w = 0; w < workerCount; ++w) {
+        mDeques.emplace_back(new WorkStealingDeque);
+    }
+    for (unsigned int w = 0; w < workerCount; ++w) {
+        mWorkers.emplace_back(&JobSystem::WorkerMain, this, (int)w);
+    }
+}
+
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+
+JobSystem& JobSystem::Default()
+{
+    static JobSystem system(gDefaultThreadCount.load());
+    return system;
+}
+
+
+void JobSystem::SetDefaultThreadCount(unsigned int threadCount)
+{
+    gDefaultThreadCount = threadCount;
+}
+
+
+JobSystem::Job* JobSystem::Create(Task task, Job* parent)
+{
+    auto job = new Job;
+    job->task = std::move(task);
+    job->parent = parent;
+    job->unfinished = 1;
+    job->predecessors = 1;
+    job->references = 2; // The caller's, and one dropped on completion
+    if (parent) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+
+void JobSystem::Precede(Job* first, Job* then)
+{
+    std::lock_guard<std::mutex> lock(first->successorMutex);
+    if (!first->finished) {
+        then->predecessors.fetch_add(1, std::memory_order_relaxed);
+        then->references.fetch_add(1, std::memory_order_relaxed);
+        first->successors.push_back(then);
+    }
+}
+
+
+void JobSystem::Submit(Job* job)
+{
+    if (job->predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Schedule(job);
+    }
+}
+
+
+void JobSystem::Wait(Job* job)
+{
+    int worker = (tWorker.system == this) ? tWorker.worker : -1;
+    unsigned int stealSeed = 0x9E3779B9u;
+    while (job->unfinished.load(std::memory_order_acquire) != 0) {
+        if (auto other = FindJob(worker, &stealSeed)) {
+            Execute(other);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    Release(job);
+}
+
+
+void JobSystem::Release(Job* job)
+{
+    if (job->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete job;
+    }
+}
+
+
+JobSystem::Job* JobSystem::CreateGroup()
+{
+    // Never scheduled: the creating thread does the group's own share inline and then
+    // finishes it by hand in WaitGroup
+    return Create(Task());
+}
+
+
+void JobSystem::WaitGroup(Job* group)
+{
+    Finish(group);
+    Wait(group);
+}
+
+
+void JobSystem::RunRange(Job* group, size_t begin, size_t end, size_t grain, const RangeBody& body)
+{
+    while (begin < end) {
+        if (end - begin > grain && LocalQueueEmpty()) {
+            // Nothing of ours is left for idle threads to steal: offer them half of what remains
+            size_t middle = begin + (end - begin) / 2;
+            auto job = Create([=, &body]() { RunRange(group, middle, end, grain, body); }, group);
+            Submit(job);
+            Release(job);
+            end = middle;
+            continue;
+        }
+
+        size_t stop = std::min(end, begin + grain);
+        body(begin, stop);
+        begin = stop;
+    }
+}
+
+
+void JobSystem::Schedule(Job* job)
+{
+    int worker = (tWorker.system == this) ? tWorker.worker : -1;
+    if (worker >= 0) {
+        if (!mDeques[worker]->Push(job)) {
+            Execute(job); // Deque full; plenty of work queued anyway
+            return;
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(mSharedMutex);
+        mShared.push_back(job);
+        mSharedCount.fetch_add(1);
+    }
+
+    // Pairs with the sleeper count/epoch check in WorkerMain so a wakeup can't be missed
+    mWorkEpoch.fetch_add(1);
+    if (mSleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWake.notify_one();
+    }
+}
+
+
+void JobSystem::Execute(Job* job)
+{
+    if (job->task) {
+        job->task();
+    }
+    Finish(job);
+}
+
+
+void JobSystem::Finish(Job* job)
+{
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    std::vector<Job*> successors;
+    {
+        std::lock_guard<std::mutex> lock(job->successorMutex);
+        job->finished = true;
+        successors.swap(job->successors);
+    }
+    for (auto successor : successors) {
+        if (successor->predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Schedule(successor);
+        }
+        Release(successor);
+    }
+
+    auto parent = job->parent;
+    Release(job);
+    if (parent) {
+        Finish(parent);
+    }
+}
+
+
+JobSystem::Job* JobSystem::FindJob(int worker, unsigned int* stealSeed)
+{
+    if (worker >= 0) {
+        if (auto job = mDeques[worker]->Take()) {
+            return job;
+        }
+    }
+
+    if (mSharedCount.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(mSharedMutex);
+        if (!mShared.empty()) {
+            auto job = mShared.front();
+            mShared.pop_front();
+            mSharedCount.fetch_sub(1);
+            return job;
+        }
+    }
+
+    auto dequeCount = (unsigned int)mDeques.size();
+    if (dequeCount > 0) {
+        auto start = XorShift(stealSeed) % dequeCount;
+        for (unsigned int d = 0; d < dequeCount; ++d) {
+            auto victim = (start + d) % dequeCount;
+            if ((int)victim == worker) continue;
+            if (auto job = mDeques[victim]->Steal()) {
+                return job;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+
+bool JobSystem::LocalQueueEmpty() const
+{
+    int worker = (tWorker.system == this) ? tWorker.worker : -1;
+    if (worker >= 0) {
+        return mDeques[worker]->Empty();
+    }
+    return mSharedCount.load(std::memory_order_relaxed) == 0;
+}
+
+
+void JobSystem::WorkerMain(int worker)
+{
+    tWorker.system = this;
+    tWorker.worker = worker;
+    unsigned int stealSeed = 2654435761u * (worker + 1);
+
+    unsigned int idleCount = 0;
+    while (!mQuit.load(std::memory_order_relaxed)) {
+        if (auto job = FindJob(worker, &stealSeed)) {
+            Execute(job);
+            idleCount = 0;
+            continue;
+        }
+
+        if (++idleCount < WORKER_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Look once more after registering as a sleeper; Schedule bumps the epoch before it
+        // checks for sleepers, so either it sees us or we see its job
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepers.fetch_add(1);
+        auto epoch = mWorkEpoch.load();
+        lock.unlock();
+        auto job = FindJob(worker, &stealSeed);
+        lock.lock();
+        if (!job && mWorkEpoch.load() == epoch && !mQuit) {
+            mWake.wait(lock);
+        }
+        mSleepers.fetch_sub(1);
+        lock.unlock();
+
+        if (job) {
+            Execute(job);
+        }
+        idleCount = 0;
+    }
+}
@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Portable work-stealing job system. Each worker thread owns a Chase-Lev deque: it pushes and
+// pops its own jobs at the bottom while idle workers steal from the top of others. Threads that
+// aren't workers (the main thread, the simulation thread) submit through a shared queue and help
+// run jobs while they wait, so they never just block.
+//
+// A job finishes when its task and all of its children have; Precede orders jobs on top of that.
+// Jobs are reference counted: Create returns one reference to the caller, which Wait or Release
+// gives back.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Task;
+    struct Job;
+
+    // threadCount - 1 background workers, the waiting thread being the last one; 0 = one thread
+    // per hardware thread
+    explicit JobSystem(unsigned int threadCount = 0);
+    ~JobSystem();
+
+    // Worker threads plus the thread that waits
+    unsigned int ThreadCount() const { return (unsigned int)mWorkers.size() + 1; }
+
+    // The instance behind jobs::parallel_for and friends. SetDefaultThreadCount must come before
+    // the first Default() to have any effect.
+    static JobSystem& Default();
+    static void SetDefaultThreadCount(unsigned int threadCount);
+
+    // Creates a job; with a parent, the parent doesn't finish until this job has
+    Job* Create(Task task, Job* parent = nullptr);
+    // then doesn't start until first has finished; call before Submit(then)
+    void Precede(Job* first, Job* then);
+    // Schedules the job to run once its predecessors have finished
+    void Submit(Job* job);
+    // Runs other jobs until job has finished, then releases the caller's reference
+    void Wait(Job* job);
+    // Releases the caller's reference without waiting
+    void Release(Job* job);
+
+    // Calls f(i) for every i in [first, last). Each participating thread works through its range
+    // grain indices at a time and splits off half of what's left whenever its own queue has run
+    // dry, so the range is only cut up as finely as idle threads actually need. grain = 0 picks
+    // one that keeps per-job overhead small relative to an even split across threads.
+    template <typename Index, typename Function>
+    void ParallelFor(Index first, Index last, const Function& f, size_t grain = 0)
+    {
+        if (!(first < last)) {
+            return;
+        }
+        size_t count = (size_t)(last - first);
+        if (grain == 0) {
+            grain = std::max<size_t>(1, count / (16 * ThreadCount()));
+        }
+        if (count <= grain || mWorkers.empty()) {
+            for (Index i = first; i < last; ++i) f(i);
+            return;
+        }
+
+        RangeBody body = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) f((Index)(first + (Index)i));
+        };
+        auto group = CreateGroup();
+        RunRange(group, 0, count, grain, body);
+        WaitGroup(group);
+    }
+
+    // Runs all of the functions, potentially in parallel
+    template <typename... Functions>
+    void ParallelInvoke(const Functions&... functions)
+    {
+        auto group = CreateGroup();
+        Task tasks[] = { Task(functions)... };
+        for (size_t t = 1; t < sizeof...(Functions); ++t) {
+            auto job = Create(std::move(tasks[t]), group);
+            Submit(job);
+            Release(job);
+        }
+        tasks[0]();
+        WaitGroup(group);
+    }
+
+private:
+    typedef std::function<void(size_t, size_t)> RangeBody;
+
+    // Fixed-capacity Chase-Lev deque ("Correct and Efficient Work-Stealing for Weak Memory
+    // Models", Le et al. 2013). Push and Take are owner-only; Steal may be called from any thread.
+    class WorkStealingDeque
+    {
+    public:
+        enum { CAPACITY = 4096 };
+
+        WorkStealingDeque();
+        bool Push(Job* job); // False if full
+        Job* Take();
+        Job* Steal();
+        bool Empty() const;
+
+    private:
+        std::atomic<int64_t> mTop;
+        std::atomic<int64_t> mBottom;
+        std::atomic<Job*> mJobs[CAPACITY];
+    };
+
+    Job* CreateGroup();
+    void WaitGroup(Job* group);
+    void RunRange(Job* group, size_t begin, size_t end, size_t grain, const RangeBody& body);
+
+    void Schedule(Job* job);
+    void Execute(Job* job);
+    void Finish(Job* job);
+    Job* FindJob(int worker, unsigned int* stealSeed);
+    bool LocalQueueEmpty() const;
+    void WorkerMain(int worker);
+
+    std::vector<std::thread> mWorkers;
+    std::vector<std::unique_ptr<WorkStealingDeque>> mDeques; // One per worker
+
+    // Jobs submitted from threads that aren't workers
+    mutable std::mutex mSharedMutex;
+    std::deque<Job*> mShared;
+    std::atomic<size_t> mSharedCount;
+
+    // Idle workers sleep until the work epoch changes
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+    std::atomic<unsigned int> mWorkEpoch;
+    std::atomic<unsigned int> mSleepers;
+    std::atomic<bool> mQuit;
+};
+
+
+// Drop-in replacements for the PPL algorithms used by this project, on JobSystem::Default().
+// Define ASTEROIDS_USE_PPL to route them back to PPL.
+#if defined(ASTEROIDS_USE_PPL)
+#include <ppl.h>
+#endif
+
+namespace jobs {
+
+template <typename Index, typename Function>
+void parallel_for(Index first, Index last, const Function& f)
+{
+#if defined(ASTEROIDS_USE_PPL)
+    concurrency::parallel_for(first, last, f);
+#else
+    JobSystem::Default().ParallelFor(first, last, f);
+#endif
+}
+
+template <typename... Functions>
+void parallel_invoke(const Functions&... functions)
+{
+#if defined(ASTEROIDS_USE_PPL)
+    concurrency::parallel_invoke(functions...);
+#else
+    JobSystem::Default().ParallelInvoke(functions...);
+#endif
+}
+
+} // namespace jobs
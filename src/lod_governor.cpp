@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lod_governor.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float LOD_GOVERNOR_SMOOTHING = 0.25f;     // Weight of the newest measurement
+static const float LOD_GOVERNOR_GAIN = 0.3f;           // Fraction of the error corrected per frame
+static const float LOD_GOVERNOR_DEAD_BAND = 0.05f;     // log2 units, about 3.5%
+static const float LOD_GOVERNOR_MAX_STEP = 0.1f;       // Bias change per frame
+static const float LOD_GOVERNOR_MIN_BIAS = -2.0f;
+static const float LOD_GOVERNOR_MAX_BIAS = 6.0f;
+static const float LOD_GOVERNOR_MAX_ERROR = 2.0f;      // Clamp for empty frames and hitches
+
+
+void LodGovernor::Update(const Settings& settings, float frameTime, unsigned int triangles)
+{
+    bool triangleBudget = settings.lodTriangleBudget > 0;
+    bool frameTimeBudget = settings.lodFrameTimeBudgetMs > 0.0f;
+    if (!triangleBudget && !frameTimeBudget) {
+        mState = LodGovernorState();
+        return;
+    }
+
+    // Start measurements from the first sample rather than from zero
+    float frameTimeMs = 1000.0f * frameTime;
+    if (!mState.active) {
+        mState.active = true;
+        mState.frameTimeMs = frameTimeMs;
+        mState.triangles = (float)triangles;
+    }
+    mState.frameTimeMs += LOD_GOVERNOR_SMOOTHING * (frameTimeMs - mState.frameTimeMs);
+    mState.triangles += LOD_GOVERNOR_SMOOTHING * ((float)triangles - mState.triangles);
+
+    // Positive when over budget; with both budgets, hold the tighter one
+    float error = -LOD_GOVERNOR_MAX_ERROR;
+    if (triangleBudget) {
+        error = std::max(error, std::log2(std::max(mState.triangles, 1.0f) / settings.lodTriangleBudget));
+    }
+    if (frameTimeBudget) {
+        error = std::max(error, std::log2(std::max(mState.frameTimeMs, 1e-3f) / settings.lodFrameTimeBudgetMs));
+    }
+    mState.error = std::min(error, LOD_GOVERNOR_MAX_ERROR);
+
+    if (std::abs(mState.error) > LOD_GOVERNOR_DEAD_BAND) {
+        // Half the log2 error is the bias that would cancel it
+        float step = LOD_GOVERNOR_GAIN * 0.5f * mState.error;
+        step = std::max(-LOD_GOVERNOR_MAX_STEP, std::min(step, LOD_GOVERNOR_MAX_STEP));
+        mState.bias = std::max(LOD_GOVERNOR_MIN_BIAS, std::min(mState.bias + step, LOD_GOVERNOR_MAX_BIAS));
+    }
+}
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include "settings.h"
+
+// Controller state, exported for tuning
+struct LodGovernorState
+{
+    bool active = false;
+    float bias = 0.0f;       // Added to the LOD screen-size threshold (log2); positive = coarser
+    float error = 0.0f;      // Smoothed log2(measured / budget) of whichever budget is tighter
+    float frameTimeMs = 0.0f;  // Smoothed measurements
+    float triangles = 0.0f;
+};
+
+// Feedback control of the LOD threshold to hold settings.lodTriangleBudget and/or
+// settings.lodFrameTimeBudgetMs. Each subdiv level quarters the triangle count, so log2 of the
+// triangle count moves about -2 per unit of bias: the controller works in that log domain and
+// corrects a fraction of the smoothed error per frame. Smoothing, a dead band and a step limit
+// keep it from chasing frame time noise or oscillating between levels.
+class LodGovernor
+{
+public:
+    // Feeds the last frame's measurements and moves the bias for the next one. With no budget
+    // set the bias is reset to zero.
+    void Update(const Settings& settings, float frameTime, unsigned int triangles);
+
+    const LodGovernorState& State() const { return mState; }
+
+private:
+    LodGovernorState mState;
+};
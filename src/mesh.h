@@ -17,7 +17,8 @@
 #pragma once
 
 #include <vector>
-#include <directxmath.h>
+#include <stdint.h>
+#include <DirectXMath.h>
 
 typedef unsigned short IndexType;
 
@@ -54,7 +55,9 @@ void SpherifyInPlace(Mesh *outMesh, float radius = 1.0f);
 void ComputeAvgNormalsInPlace(Mesh *outMesh);
 
 // subdivIndexOffset array should be [subdivLevels+2] in size
-void CreateGeospheres(Mesh *outMesh, unsigned int subdivLevelCount, unsigned int* outSubdivIndexOffsets);
+// optimizeVertexOrder reorders each level's triangles for the vertex cache and its vertices for fetch
+void CreateGeospheres(Mesh *outMesh, unsigned int subdivLevelCount, unsigned int* outSubdivIndexOffsets,
+                      bool optimizeVertexOrder = true);
 
 // Returns a combined "mesh" that includes:
 // - A set of indices for each subdiv level (outSubdivIndexOffsets for offsets/counts)
@@ -66,6 +69,60 @@ void CreateAsteroidsFromGeospheres(Mesh *outMesh,
                                    unsigned int* outSubdivIndexOffsets, unsigned int* vertexCountPerMesh);
 
 
+// Asteroid instances are all the same geosphere with each vertex pushed out along its direction,
+// so the directions can be shared and each instance vertex reduced to a radius and a normal.
+// Radii are unorm16 fractions of the instance's radius scale, which the draw constants carry.
+struct RadialVertex
+{
+    uint16_t normal; // Octahedral snorm8x2, see PackOctahedral8
+    uint16_t radius;
+};
+
+struct RadialMesh
+{
+    void clear()
+    {
+        directions.clear();
+        radiusScale.clear();
+        vertices.clear();
+        indices.clear();
+    }
+
+    float Radius(size_t vertex) const
+    {
+        return radiusScale[vertex / directions.size()] * ((float)vertices[vertex].radius / 65535.0f);
+    }
+
+    std::vector<DirectX::XMFLOAT3> directions; // Geosphere vertices, one per vertex of an instance
+    std::vector<float> radiusScale;            // Largest radius of each mesh instance
+    std::vector<RadialVertex> vertices;        // directions.size() per mesh instance
+    std::vector<IndexType> indices;
+};
+
+// Same meshes as above, stored radially and quantized; see MeasureRadialMeshError
+void CreateAsteroidsFromGeospheres(RadialMesh *outMesh,
+                                   unsigned int subdivLevelCount, unsigned int meshInstanceCount,
+                                   unsigned int rngSeed,
+                                   unsigned int* outSubdivIndexOffsets, unsigned int* vertexCountPerMesh);
+
+// CPU decode for tools and tests; vertex indexes RadialMesh::vertices
+Vertex DecodeRadialVertex(const RadialMesh& mesh, size_t vertex);
+
+void DecodeRadialMesh(const RadialMesh& mesh, Mesh *outMesh);
+
+// Decoded radial mesh against the float meshes it was encoded from. Position errors are relative
+// to the instance's radius scale; normal errors are angles in radians.
+struct RadialMeshError
+{
+    float maxPosition;
+    float rmsPosition;
+    float maxNormal;
+    float meanNormal;
+};
+
+RadialMeshError MeasureRadialMeshError(const RadialMesh& mesh, const Mesh& reference);
+
+
 struct SkyboxVertex
 {
     float x;
@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "occlusion.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+// Matches the near plane distance of OrbitCamera's projection
+static const float OCCLUSION_MIN_W = 0.1f;
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height)
+    : mWidth((width + 3) & ~3u)
+    , mHeight(height)
+    , mTilesX((mWidth + TILE_WIDTH - 1) / TILE_WIDTH)
+    , mTilesY((height + TILE_HEIGHT - 1) / TILE_HEIGHT)
+    , mViewProjection(XMMatrixIdentity())
+    , mDepth(mWidth * height, 0.0f)
+{
+    static_assert(TILE_WIDTH % 4 == 0, "Tiles must hold whole 4-pixel groups");
+}
+
+
+void OcclusionBuffer::BeginFrame(CXMMATRIX viewProjection, size_t triangleCount)
+{
+    mViewProjection = viewProjection;
+    mTriangles.resize(triangleCount);
+}
+
+
+void OcclusionBuffer::SetupOccluder(size_t firstTriangle, FXMMATRIX world, const XMFLOAT3* vertices,
+                                    const unsigned short* indices, size_t triangleCount, bool cullBackFaces)
+{
+    assert(firstTriangle + triangleCount <= mTriangles.size());
+    auto worldViewProjection = XMMatrixMultiply(world, mViewProjection);
+
+    for (size_t t = 0; t < triangleCount; ++t) {
+        auto triangle = &mTriangles[firstTriangle + t];
+        triangle->valid = false;
+
+        float x[3], y[3], invW[3];
+        bool clipped = false;
+        for (int v = 0; v < 3; ++v) {
+            XMFLOAT4 clip;
+            XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&vertices[indices[t*3 + v]]), worldViewProjection));
+            if (clip.w < OCCLUSION_MIN_W) {
+                clipped = true;
+                break;
+            }
+            invW[v] = 1.0f / clip.w;
+            x[v] = (clip.x * invW[v] * 0.5f + 0.5f) * mWidth;
+            y[v] = (0.5f - clip.y * invW[v] * 0.5f) * mHeight;
+        }
+        if (clipped) continue;
+
+        float area2 = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (std::abs(area2) < 1e-6f) continue;
+        if (cullBackFaces && area2 < 0.0f) continue; // Y points down, so positive is clockwise
+
+        // Either winding works: dividing by the signed area turns the edge functions into
+        // barycentrics, positive inside. Both faces get drawn; the far ones just lose the max.
+        float rcpArea2 = 1.0f / area2;
+        triangle->depthA = triangle->depthB = triangle->depthC = 0.0f;
+        for (int e = 0; e < 3; ++e) {
+            int j = (e + 1) % 3;
+            int k = (e + 2) % 3;
+            triangle->edgeA[e] = (y[j] - y[k]) * rcpArea2;
+            triangle->edgeB[e] = (x[k] - x[j]) * rcpArea2;
+            triangle->edgeC[e] = ((y[k] - y[j]) * x[j] - (x[k] - x[j]) * y[j]) * rcpArea2;
+            triangle->depthA += triangle->edgeA[e] * invW[e];
+            triangle->depthB += triangle->edgeB[e] * invW[e];
+            triangle->depthC += triangle->edgeC[e] * invW[e];
+        }
+
+        // Pixels whose centers can be inside
+        float minX = std::min(x[0], std::min(x[1], x[2]));
+        float maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2]));
+        float maxY = std::max(y[0], std::max(y[1], y[2]));
+        triangle->minX = std::max(0, (int)std::ceil(minX - 0.5f));
+        triangle->maxX = std::min((int)mWidth - 1, (int)std::floor(maxX - 0.5f));
+        triangle->minY = std::max(0, (int)std::ceil(minY - 0.5f));
+        triangle->maxY = std::min((int)mHeight - 1, (int)std::floor(maxY - 0.5f));
+        triangle->valid = (triangle->minX <= triangle->maxX && triangle->minY <= triangle->maxY);
+    }
+}
+
+
+void OcclusionBuffer::RasterizeTile(unsigned int tile, size_t* shadedPixels)
+{
+    int tileMinX = (int)(tile % mTilesX) * TILE_WIDTH;
+    int tileMinY = (int)(tile / mTilesX) * TILE_HEIGHT;
+    int tileMaxX = std::min(tileMinX + (int)TILE_WIDTH, (int)mWidth) - 1;
+    int tileMaxY = std::min(tileMinY + (int)TILE_HEIGHT, (int)mHeight) - 1;
+
+    for (int y = tileMinY; y <= tileMaxY; ++y) {
+        std::fill(&mDepth[y * mWidth + tileMinX], &mDepth[y * mWidth + tileMaxX] + 1, 0.0f);
+    }
+
+    const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t shaded = 0;
+
+    for (auto const& triangle : mTriangles) {
+        if (!triangle.valid) continue;
+
+        int minX = std::max(triangle.minX, tileMinX) & ~3;
+        int maxX = std::min(triangle.maxX, tileMaxX);
+        int minY = std::max(triangle.minY, tileMinY);
+        int maxY = std::min(triangle.maxY, tileMaxY);
+        if (minX > maxX || minY > maxY) continue;
+
+        __m128 edgeA[3], edgeB[3], edgeC[3];
+        for (int e = 0; e < 3; ++e) {
+            edgeA[e] = _mm_set1_ps(triangle.edgeA[e]);
+            edgeB[e] = _mm_set1_ps(triangle.edgeB[e]);
+            edgeC[e] = _mm_set1_ps(triangle.edgeC[e]);
+        }
+        __m128 depthA = _mm_set1_ps(triangle.depthA);
+        __m128 depthB = _mm_set1_ps(triangle.depthB);
+        __m128 depthC = _mm_set1_ps(triangle.depthC);
+
+        for (int y = minY; y <= maxY; ++y) {
+            __m128 py = _mm_set1_ps((float)y + 0.5f);
+            __m128 rowEdge[3];
+            for (int e = 0; e < 3; ++e) {
+                rowEdge[e] = _mm_add_ps(_mm_mul_ps(edgeB[e], py), edgeC[e]);
+            }
+            __m128 rowDepth = _mm_add_ps(_mm_mul_ps(depthB, py), depthC);
+
+            float* row = &mDepth[y * mWidth];
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+
+                // Strictly inside: pixels centered on a shared edge are left to neither triangle
+                __m128 inside = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), rowEdge[0]), zero);
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), rowEdge[1]), zero));
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), rowEdge[2]), zero));
+                if (_mm_movemask_ps(inside) == 0) continue;
+
+                __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+                __m128 current = _mm_loadu_ps(row + x);
+                if (shadedPixels) {
+                    // Groups never straddle tiles, and lanes outside the triangle fail the edge tests
+                    int passed = _mm_movemask_ps(_mm_and_ps(inside, _mm_cmpge_ps(depth, current)));
+                    shaded += (passed & 1) + ((passed >> 1) & 1) + ((passed >> 2) & 1) + (passed >> 3);
+                }
+                _mm_storeu_ps(row + x, _mm_max_ps(current, _mm_and_ps(inside, depth)));
+            }
+        }
+    }
+
+    if (shadedPixels) *shadedPixels += shaded;
+}
+
+
+bool OcclusionBuffer::IsOccluded(FXMVECTOR center, float radius) const
+{
+    // Project the corners of the sphere's world-space bounding cube
+    auto clipCenter = XMVector3Transform(center, mViewProjection);
+    auto axisX = XMVectorScale(mViewProjection.r[0], radius);
+    auto axisY = XMVectorScale(mViewProjection.r[1], radius);
+    auto axisZ = XMVectorScale(mViewProjection.r[2], radius);
+
+    float minX = FLT_MAX, maxX = -FLT_MAX;
+    float minY = FLT_MAX, maxY = -FLT_MAX;
+    float minW = FLT_MAX;
+    for (int c = 0; c < 8; ++c) {
+        auto corner = clipCenter;
+        corner = (c & 1) ? XMVectorAdd(corner, axisX) : XMVectorSubtract(corner, axisX);
+        corner = (c & 2) ? XMVectorAdd(corner, axisY) : XMVectorSubtract(corner, axisY);
+        corner = (c & 4) ? XMVectorAdd(corner, axisZ) : XMVectorSubtract(corner, axisZ);
+
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, corner);
+        if (clip.w < OCCLUSION_MIN_W) return false;
+
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * mWidth;
+        float y = (0.5f - clip.y / clip.w * 0.5f) * mHeight;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        minW = std::min(minW, clip.w);
+    }
+
+    // Every pixel the bounds touch must hold something nearer than the nearest corner
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min((int)mWidth - 1, (int)std::floor(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min((int)mHeight - 1, (int)std::floor(maxY));
+    if (x0 > x1 || y0 > y1) return false;
+
+    const __m128 nearest = _mm_set1_ps(1.0f / minW);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i first = _mm_set1_epi32(x0);
+    const __m128i last = _mm_set1_epi32(x1);
+
+    for (int y = y0; y <= y1; ++y) {
+        const float* row = &mDepth[y * mWidth];
+        for (int x = x0 & ~3; x <= x1; x += 4) {
+            __m128i px = _mm_add_epi32(_mm_set1_epi32(x), lane);
+            __m128i inRect = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(px, first), _mm_cmpgt_epi32(px, last)),
+                                              _mm_set1_epi32(-1));
+            __m128 nearer = _mm_cmpgt_ps(_mm_loadu_ps(row + x), nearest);
+            // Any pixel in the rect that isn't covered by something nearer makes the sphere visible
+            if (_mm_movemask_ps(_mm_andnot_ps(nearer, _mm_castsi128_ps(inRect))) != 0) return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// Coarse CPU depth buffer for software occlusion culling. Occluder triangles are set up into
+// preallocated slots, rasterized tile by tile, and then bounding spheres are tested against the
+// result. Every stage works on independent slots/tiles/spheres so callers can spread them over
+// threads however they like; there are no platform dependencies beyond DirectXMath and SSE2.
+//
+// The buffer stores 1/w, which is linear in screen space and larger for nearer surfaces whatever
+// the projection's z mapping. Occluders must lie inside the geometry they stand in for.
+class OcclusionBuffer
+{
+public:
+    enum { TILE_WIDTH = 64 };
+    enum { TILE_HEIGHT = 32 };
+
+    // Width is rounded up to a multiple of 4 pixels
+    OcclusionBuffer(unsigned int width, unsigned int height);
+
+    unsigned int Width() const { return mWidth; }
+    unsigned int Height() const { return mHeight; }
+    unsigned int TileCount() const { return mTilesX * mTilesY; }
+
+    // Starts a frame: sets the view-projection and reserves triangleCount occluder triangle slots
+    void BeginFrame(DirectX::CXMMATRIX viewProjection, size_t triangleCount);
+
+    // Transforms and sets up one occluder's triangles into slots [firstTriangle, firstTriangle + triangleCount).
+    // Triangles crossing the near plane or degenerate in screen space are dropped, which only makes
+    // the buffer more conservative. cullBackFaces also drops those the renderers' default
+    // rasterizer state culls (counterclockwise on screen).
+    void SetupOccluder(size_t firstTriangle, DirectX::FXMMATRIX world, const DirectX::XMFLOAT3* vertices,
+                       const unsigned short* indices, size_t triangleCount, bool cullBackFaces = false);
+
+    // Clears and rasterizes all set-up triangles into one tile, in slot order. Call after all
+    // SetupOccluder calls. If shadedPixels is given, the pixels that passed a GREATER_EQUAL depth
+    // test on the way, as a GPU with early depth testing would shade them, are added to it.
+    void RasterizeTile(unsigned int tile, size_t* shadedPixels = nullptr);
+
+    // True if the sphere is entirely behind the rasterized occluders. Call after all tiles are done.
+    bool IsOccluded(DirectX::FXMVECTOR center, float radius) const;
+
+    // Depth of pixel (x, y) as 1/w, 0 where nothing was drawn
+    float Depth(unsigned int x, unsigned int y) const { return mDepth[y * mWidth + x]; }
+
+private:
+    // Edge functions are positive inside; depth is a plane in screen space
+    struct Triangle
+    {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, minY, maxX, maxY; // Inclusive pixel bounds
+        bool valid;
+    };
+
+    unsigned int mWidth;
+    unsigned int mHeight;
+    unsigned int mTilesX;
+    unsigned int mTilesY;
+
+    DirectX::XMMATRIX mViewProjection;
+    std::vector<Triangle> mTriangles;
+    std::vector<float> mDepth; // Row-major, mWidth floats per row
+};
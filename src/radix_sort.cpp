@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "radix_sort.h"
+
+#include <algorithm>
+
+
+// RADIX_BITS per pass: count per chunk in parallel, scan digit-major/chunk-minor, scatter in parallel
+void RadixSortHighBits(std::vector<uint64_t>* keys, std::vector<uint64_t>* scratch, unsigned int bitCount,
+                       JobSystem& jobSystem)
+{
+    enum { RADIX_BITS = 11 };
+    enum { RADIX = 1 << RADIX_BITS };
+    enum { CHUNK_SIZE = 16384 };
+
+    size_t count = keys->size();
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<unsigned int> counts(chunkCount * RADIX);
+    scratch->resize(count);
+
+    for (unsigned int shift = 32; shift < 32 + bitCount; shift += RADIX_BITS) {
+        auto src = keys->data();
+        auto dst = scratch->data();
+
+        std::fill(counts.begin(), counts.end(), 0);
+        jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+            auto chunkCounts = &counts[chunk * RADIX];
+            size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+            for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+                chunkCounts[(src[k] >> shift) & (RADIX - 1)]++;
+            }
+        }, 1);
+
+        unsigned int offset = 0;
+        for (unsigned int digit = 0; digit < RADIX; ++digit) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                auto countInChunk = counts[chunk * RADIX + digit];
+                counts[chunk * RADIX + digit] = offset;
+                offset += countInChunk;
+            }
+        }
+
+        jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+            auto offsets = &counts[chunk * RADIX];
+            size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+            for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+                dst[offsets[(src[k] >> shift) & (RADIX - 1)]++] = src[k];
+            }
+        }, 1);
+        keys->swap(*scratch);
+    }
+}
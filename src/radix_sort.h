@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "job_system.h"
+
+// Stable parallel LSD radix sort of 64-bit keys by bits [32, 32 + bitCount), for (key << 32 | index)
+// pairs. scratch is resized as needed and left holding garbage.
+void RadixSortHighBits(std::vector<uint64_t>* keys, std::vector<uint64_t>* scratch, unsigned int bitCount,
+                       JobSystem& jobSystem);
+
+// Spreads the low 10 bits of v out to every third bit, for 30-bit Morton keys
+inline uint32_t Part1By2(uint32_t v)
+{
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8))  & 0x0300F00F;
+    v = (v | (v << 4))  & 0x030C30C3;
+    v = (v | (v << 2))  & 0x09249249;
+    return v;
+}
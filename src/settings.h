@@ -16,8 +16,8 @@
 
 #pragma once
 
-#include "camera.h"
 #include "common_defines.h"
+#include "cpu_features.h"
 
 // Profiling
 #define ENABLE_VTUNE_TASK_PROFILING 1
@@ -45,6 +45,10 @@ enum { NUM_FRAMES_TO_BUFFER = 3 };
 // Also effectively max thread parallelism
 enum { NUM_SUBSETS = 4 };
 
+// CPU depth buffer for occlusion culling; coarse is fine since occluders are large on screen
+enum { OCCLUSION_BUFFER_WIDTH = 320 };
+enum { OCCLUSION_BUFFER_HEIGHT = 192 };
+
 // Buffer size for dynamic sprite data
 enum { MAX_SPRITE_VERTICES_PER_FRAME = 6 * 1024 };
 
@@ -75,6 +79,26 @@ struct Settings
     bool animate = true;                    // Animate asteroids
     bool allowTearing = false;              // Allow presented frames to tear
 
+    SimdLevel simdLevel = SIMD_LEVEL_AVX512; // Widest simulation kernel to use (clamped to CPU support)
+    bool closedFormMotion = false;          // Evaluate asteroid transforms from absolute time instead of integrating
+    bool cullAsteroids = true;              // Skip drawing asteroids outside the view frustum
+    bool gridCulling = true;                // Cull whole spatial grid cells before individual asteroids
+    bool occlusionCulling = false;          // Also skip asteroids hidden behind near ones (CPU depth buffer)
+    bool bucketDrawList = true;             // Group draws by subdiv level and texture
+    bool frontToBackDraws = false;          // Order draws (within each bucket) near to far by coarse view depth
+    unsigned int jobThreads = 0;            // Threads running parallel work, including the waiting one (0 = one per hardware thread)
+    bool asyncSimulation = false;           // Simulate a frame ahead on a separate thread while rendering
+    bool lodThresholdTable = false;         // Pick LOD by distance thresholds derived from render height and FOV
+    unsigned int lodTriangleBudget = 0;     // Adapt LOD to hold this many asteroid triangles per frame (0 = off)
+    float lodFrameTimeBudgetMs = 0.0f;      // Adapt LOD to hold this frame time (0 = off)
+    unsigned int simulationHz = 0;          // Step the simulation at a fixed rate and interpolate (0 = step by frame time)
+    bool amortizeFarUpdates = false;        // Fully update far asteroids only every amortizeInterval steps
+    unsigned int amortizeInterval = 4;      // Steps between full updates of far asteroids
+    unsigned int amortizeMaxSubdiv = 0;     // Asteroids at or below this subdiv level count as far
+    unsigned int resortFrames = 0;          // Re-sort asteroids by position in the background every N frames (0 = never)
+    bool collisions = false;                // Bounce apart asteroids whose bounding spheres overlap
+    bool gravity = false;                   // N-body gravity: a central mass plus the asteroids' own pull
+
     // D3D12-only:
     bool multithreadedRendering = true;     // Generate command lists on multiple threads
     bool submitRendering = true;            // Submit command lists onto the queue after generating them
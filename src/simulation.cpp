@@ -15,18 +15,66 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "simulation.h"
+#include "counter_rng.h"
+#include "job_system.h"
+#include "radix_sort.h"
+#include "simulation_simd.h"
 #include "settings.h"
-#include "texture.h"
-#include "util.h"
+#include "texture_data.h"
 
 #include <random>
+#include <array>
 #include <limits>
+#include <cfloat>
+#include <cmath>
 #include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <functional>
 #include <iostream>
-#include <ppl.h>
 
 using namespace DirectX;
 
+// Occluders must cover at least this much of the view (bounding radius / distance) to be worth
+// rasterizing; the largest MAX_OCCLUDERS of those are used
+static const float OCCLUDER_MIN_SIZE = 0.02f;
+enum { MAX_OCCLUDERS = 256 };
+
+// Asteroids per job in whole-field passes (construction, re-sorting, collisions)
+enum { SIM_FIELD_CHUNK = 4096 };
+
+// Slowest orbit a collision or gravity can leave an asteroid on, in radians per second. The
+// grid relies on orbits only running one way, so slower or reversed motion is rounded up to this
+// for the orbit parameters; gravity keeps the true velocity.
+static const float MIN_ORBIT_VELOCITY = 1e-3f;
+
+// The query BVH is rebuilt once refitting has grown its leaves' surface area by this much
+static const float QUERY_BVH_MAX_DEGRADATION = 1.5f;
+
+// Queries per job in the batched spatial queries
+enum { QUERY_CHUNK = 256 };
+
+// Barnes-Hut opening angle: tree nodes smaller than this times their distance are taken whole
+static const float GRAVITY_OPENING_ANGLE = 0.5f;
+
+// Total mass of the belt as a share of the central mass
+static const float GRAVITY_BELT_MASS_FRACTION = 0.05f;
+
+// If the simulation can't keep up, drop time rather than take ever more steps per frame
+enum { MAX_STEPS_PER_FRAME = 8 };
+
+// Closed-form angles are phase + velocity * (time - mPhaseEpoch) in float. Folding whole intervals
+// into the phases keeps that time under a minute, where float steps are a few microseconds.
+static const double PHASE_EPOCH_INTERVAL = 64.0;
+
+// Screen size (relative to distance) below which asteroids get the coarsest mesh; each doubling
+// above it adds a subdiv level. The LOD governor biases this when a budget is set.
+static const float MIN_SUBDIV_SIZE_LOG2 = std::log2f(0.0019f);
+
+// The same in projected radius, for settings.lodThresholdTable; about equal to the above at the
+// default window size and field of view
+static const float LOD_MIN_SUBDIV_PIXELS = 1.0f;
+
 static int const COLOR_SCHEMES[] = {
     156, 139, 113,  55,  49,  40,
     156, 139, 113,  58,  38,  14,
@@ -38,13 +86,24 @@ static int const COLOR_SCHEMES[] = {
 
 static int const NUM_COLOR_SCHEMES = (int) (sizeof(COLOR_SCHEMES) / (6 * sizeof(int)));
 
-static XMVECTOR RandomPointOnSphere(std::mt19937& rng)
+// Approximate SRGB->Linear for colors
+static const float* LinearColorSchemes()
 {
-    std::normal_distribution<float> dist;
+    static const auto table = [] {
+        std::array<float, NUM_COLOR_SCHEMES * 6> linear;
+        for (size_t i = 0; i < linear.size(); ++i) {
+            linear[i] = std::pow((float)COLOR_SCHEMES[i] / 255.0f, 2.2f);
+        }
+        return linear;
+    }();
+    return table.data();
+}
 
+static XMVECTOR RandomPointOnSphere(CounterRng& rng)
+{
     XMVECTOR r;
     for (;;) {
-        r = XMVectorSet(dist(rng), dist(rng), dist(rng), 0.0f);
+        r = XMVectorSet(rng.Normal(0.0f, 1.0f), rng.Normal(0.0f, 1.0f), rng.Normal(0.0f, 1.0f), 0.0f);
         auto d2 = XMVectorGetX(XMVector3LengthSq(r));
         if (d2 > std::numeric_limits<float>::min()) {
             return XMVector3Normalize(r);
@@ -53,24 +112,37 @@ static XMVECTOR RandomPointOnSphere(std::mt19937& rng)
     // Unreachable
 }
 
-// From http://guihaire.com/code/?p=1135
-static inline float VeryApproxLog2f(float x)
-{   
-    union { float f; uint32_t i; } ux;
-    ux.f = x;
-    return (float)ux.i * 1.1920928955078125e-7f - 126.94269504f;
-}
-
-
 AsteroidsSimulation::AsteroidsSimulation(unsigned int rngSeed, unsigned int asteroidCount,
                                          unsigned int meshInstanceCount, unsigned int subdivCount,
                                          unsigned int textureCount)
-    : mAsteroidStatic(asteroidCount)
-    , mAsteroidDynamic(asteroidCount)
+    : mSlotToId(asteroidCount)
+    , mScale(asteroidCount)
+    , mSpinVelocity(asteroidCount)
+    , mOrbitVelocity(asteroidCount)
+    , mSpinAxis(asteroidCount)
+    , mOrbitRadius(asteroidCount)
+    , mOrbitHeight(asteroidCount)
+    , mOrbitPhase(asteroidCount)
+    , mSpinPhase(asteroidCount)
+    , mColorScheme(asteroidCount)
+    , mMeshInstance(asteroidCount)
+    , mTextureIndex(asteroidCount)
+    , mColorSchemes(LinearColorSchemes())
+    , mWorld((asteroidCount + SIM_BLOCK_WIDTH - 1) / SIM_BLOCK_WIDTH)
+    , mSubdiv(asteroidCount)
+    , mAsteroidCount(asteroidCount)
+    , mSimdLevel(DetectSimdLevel())
+    , mCameraEye(XMVectorZero())
+    , mViewProjection(XMMatrixIdentity())
+    , mOcclusion(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT)
     , mIndexOffsets(subdivCount + 2) // Mesh subdivs are inclusive on both ends and need forward differencing for count
     , mSubdivCount(subdivCount)
 {
     std::mt19937 rng(rngSeed);
+    mDrawWorld = mWorld.data();
+    mMinSubdivSizeLog2 = MIN_SUBDIV_SIZE_LOG2;
+
+    std::cout << "Simulation SIMD support: " << SimdLevelName(mSimdLevel) << std::endl;
 
     // Create meshes
     std::cout
@@ -82,97 +154,910 @@ AsteroidsSimulation::AsteroidsSimulation(unsigned int rngSeed, unsigned int aste
 
     CreateTextures(textureCount, rng());
 
-    // Constants
-    std::normal_distribution<float> orbitRadiusDist(SIM_ORBIT_RADIUS, 0.6f * SIM_DISC_RADIUS);
-    std::normal_distribution<float> heightDist(0.0f, 0.4f);
-    std::uniform_real_distribution<float> angleDist(-XM_PI, XM_PI);
-    std::uniform_real_distribution<float> radialVelocityDist(5.0f, 15.0f);
-    std::uniform_real_distribution<float> spinVelocityDist(-2.0f, 2.0f);
-    std::normal_distribution<float> scaleDist(1.3f, 0.7f);
-    std::normal_distribution<float> colorSchemeDist(0, NUM_COLOR_SCHEMES - 1);
-    std::uniform_int_distribution<unsigned int> textureIndexDist(0, textureCount-1);
+    std::cout << "Mesh pool: " << (MeshPoolBytes() >> 10) << " KB, "
+              << ((mMeshes.vertices.size() * sizeof(Vertex) + mMeshes.indices.size() * sizeof(IndexType)) >> 10)
+              << " KB as full vertices" << std::endl;
+
+    // Vertices sit at radius times their direction's length; the directions are the flat
+    // subdivided icosahedron, so those lengths vary from vertex to vertex
+    std::vector<float> directionLength(mVertexCountPerMesh);
+    for (unsigned int v = 0; v < mVertexCountPerMesh; ++v) {
+        auto const& d = mMeshes.directions[v];
+        directionLength[v] = std::sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+    }
+
+    // Noise displacement pushes vertices past the unit sphere; bound all instances at once
+    for (size_t i = 0; i < mMeshes.vertices.size(); ++i) {
+        mMeshBoundingRadius = std::max(mMeshBoundingRadius, mMeshes.Radius(i) * directionLength[i % mVertexCountPerMesh]);
+    }
+    CreateOccluders(meshInstanceCount, directionLength);
+
+    assert(mSubdivCount <= MESH_MAX_SUBDIV_LEVELS); // Sizes SimulationStats::drawsPerSubdiv
+
+    assert(meshInstanceCount <= 0x10000 && textureCount <= 0x100); // Packed index widths
+    mRngSeed = rngSeed;
+    mMeshInstanceCount = meshInstanceCount;
+
+    // Every asteroid draws from its own counter-based stream, so they can be created in any order
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t chunkCount = (asteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(asteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            InitAsteroid(i);
+        }
+    });
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Created " << asteroidCount << " asteroids in " << elapsed.count() << " ms" << std::endl;
+
+    BuildGrid();
+}
 
-    auto instancesPerMesh = std::max(1U, asteroidCount / meshInstanceCount);
 
-    // Approximate SRGB->Linear for colors
-    float linearColorSchemes[NUM_COLOR_SCHEMES * 6];
-    for (int i = 0; i < ARRAYSIZE(linearColorSchemes); ++i) {
-        linearColorSchemes[i] = std::powf((float)COLOR_SCHEMES[i] / 255.0f, 2.2f);
+AsteroidsSimulation::~AsteroidsSimulation()
+{
+    if (mResortJob) {
+        JobSystem::Default().Wait(mResortJob);
     }
+}
+
+
+void AsteroidsSimulation::InitAsteroid(size_t i)
+{
+    CounterRng rng(mRngSeed, i);
+    mSlotToId[i] = (unsigned int)i;
 
-    // Create a torus of asteroids that spin around the ring
-    for (unsigned int i = 0; i < asteroidCount; ++i) {
-        auto scale = scaleDist(rng);
+    auto scale = rng.Normal(1.3f, 0.7f);
 #if SIM_USE_GAMMA_DIST_SCALE
-        scale = scale * 0.3f;
+    scale = scale * 0.3f;
 #endif
-        scale = std::max(scale, SIM_MIN_SCALE);
-        auto scaleMatrix = XMMatrixScaling(scale, scale, scale);
+    mScale[i] = PackHalf(std::max(scale, SIM_MIN_SCALE));
+    scale = Scale(i); // Everything downstream sees the stored value
+    auto scaleMatrix = XMMatrixScaling(scale, scale, scale);
+
+    auto orbitRadius = rng.Normal(SIM_ORBIT_RADIUS, 0.6f * SIM_DISC_RADIUS);
+    auto discPosY = float(SIM_DISC_RADIUS) * rng.Normal(0.0f, 0.4f);
+
+    auto disc = XMMatrixTranslation(orbitRadius, discPosY, 0.0f);
+
+    auto positionAngle = rng.Uniform(-XM_PI, XM_PI);
+    auto orbit = XMMatrixRotationY(positionAngle);
+
+    auto meshInstance = rng.UniformInt(mMeshInstanceCount); // Not i / count, so fields of any size agree
+
+    // Static data
+    mSpinVelocity[i] = PackHalf(rng.Uniform(-2.0f, 2.0f) / scale); // Smaller asteroids spin faster
+    mOrbitVelocity[i] = PackHalf(rng.Uniform(5.0f, 15.0f) / (scale * orbitRadius)); // Smaller asteroids go faster, and use arc length
+    mMeshInstance[i] = (uint16_t)meshInstance;
+
+    XMFLOAT3 spinAxis;
+    XMStoreFloat3(&spinAxis, RandomPointOnSphere(rng));
+    mSpinAxis[i] = PackOctahedral(spinAxis.x, spinAxis.y, spinAxis.z);
+
+    mOrbitRadius[i] = orbitRadius;
+    mOrbitHeight[i] = discPosY;
+    mOrbitPhase[i] = positionAngle;
+    mSpinPhase[i] = 0.0f;
+    mTextureIndex[i] = (uint8_t)rng.UniformInt(mTextureCount);
+    mColorScheme[i] = (uint8_t)(((int)std::abs(rng.Normal(0.0f, NUM_COLOR_SCHEMES - 1))) % NUM_COLOR_SCHEMES);
+
+    // Initialize dynamic data
+    mWorld[i / SIM_BLOCK_WIDTH].Store(i % SIM_BLOCK_WIDTH, scaleMatrix * disc * orbit);
+
+    assert(Scale(i) > 0.0f);
+    assert(OrbitVelocity(i) > 0.0f);
+}
+
+
+void AsteroidsSimulation::CreateOccluders(unsigned int meshInstanceCount, const std::vector<float>& directionLength)
+{
+    static_assert(sizeof(IndexType) == sizeof(unsigned short), "Occluder indices are 16-bit");
+
+    // Icosahedron LOD; it indexes the first vertices of each mesh instance
+    mOccluderIndices.assign(mMeshes.indices.begin() + mIndexOffsets[0], mMeshes.indices.begin() + mIndexOffsets[1]);
+    mOccluderVertexCount = 1 + *std::max_element(mOccluderIndices.begin(), mOccluderIndices.end());
+
+    // Triangles of the finest LOD are at least minRadius * cos(edge angle) from the center. Edges
+    // start at ~1.1 rad on the icosahedron and halve per level; a little extra covers flat-face
+    // subdivision being uneven.
+    float edgeAngle = 1.4f / (float)(1 << mSubdivCount);
+
+    mOccluderRadius.resize(meshInstanceCount);
+    mOccluderVertices.resize(meshInstanceCount * mOccluderVertexCount);
+    for (unsigned int m = 0; m < meshInstanceCount; ++m) {
+        // All levels' vertices, which only makes this smaller than the finest level alone
+        float minRadius = FLT_MAX;
+        for (unsigned int v = 0; v < mVertexCountPerMesh; ++v) {
+            minRadius = std::min(minRadius, mMeshes.Radius(m * mVertexCountPerMesh + v) * directionLength[v]);
+        }
+        mOccluderRadius[m] = minRadius * std::cos(edgeAngle);
+
+        // Points on the inscribed sphere; their convex hull stays inside it
+        for (unsigned int v = 0; v < mOccluderVertexCount; ++v) {
+            auto direction = XMVector3Normalize(XMLoadFloat3(&mMeshes.directions[v]));
+            XMStoreFloat3(&mOccluderVertices[m * mOccluderVertexCount + v], XMVectorScale(direction, mOccluderRadius[m]));
+        }
+    }
+}
+
+
+void AsteroidsSimulation::BuildGrid()
+{
+    std::vector<float> orbitVelocity(mAsteroidCount);
+    std::vector<float> boundingRadius(mAsteroidCount);
+    for (size_t i = 0; i < mAsteroidCount; ++i) {
+        orbitVelocity[i] = OrbitVelocity(i);
+        boundingRadius[i] = BoundingRadius(i);
+    }
+    mGridStale = false;
+    mGrid.Build(mAsteroidCount, mOrbitRadius.data(), mOrbitHeight.data(), mOrbitPhase.data(),
+                orbitVelocity.data(), boundingRadius.data(), GridTime());
+}
+
+
+void AsteroidsSimulation::Seek(double time)
+{
+    mTime = time;
+    RebasePhases(std::floor(mTime / PHASE_EPOCH_INTERVAL) * PHASE_EPOCH_INTERVAL);
+    for (size_t i = 0; i < mAsteroidCount; ++i) {
+        mWorld[i / SIM_BLOCK_WIDTH].Store(i % SIM_BLOCK_WIDTH, WorldAtTime(i, mTime));
+    }
+    std::fill(mSpinPending.begin(), mSpinPending.end(), 0.0f);
+    mGravityPosition.clear();
+    mGravityVelocity.clear();
+    mQueryBvhStale = true;
+
+    // Restart interpolation with the previous step behind the new time
+    if (mFixedStep > 0.0) {
+        mStepAccumulator = 0.0;
+        mInterpolation = 0.0f;
+        for (size_t i = 0; i < mAsteroidCount; ++i) {
+            mPrevWorld[i / SIM_BLOCK_WIDTH].Store(i % SIM_BLOCK_WIDTH, WorldAtTime(i, mTime - mFixedStep));
+        }
+        mRenderWorld = mPrevWorld;
+    }
+
+    BuildGrid();
+}
+
+
+void AsteroidsSimulation::SetFixedStep(double fixedStep)
+{
+    // Entering fixed-step mode (or changing rate) restarts interpolation from the current state
+    mFixedStep = fixedStep;
+    mStepAccumulator = 0.0;
+    mStepsThisFrame = 0;
+    mInterpolation = 1.0f;
+    if (mFixedStep > 0.0) {
+        mPrevWorld = mWorld;
+        mRenderWorld = mWorld;
+        mDrawWorld = mRenderWorld.data();
+    } else {
+        std::vector<AsteroidTransformBlock>().swap(mPrevWorld);
+        std::vector<AsteroidTransformBlock>().swap(mRenderWorld);
+        mDrawWorld = mWorld.data();
+    }
+}
+
+
+void AsteroidsSimulation::RebasePhases(double epoch)
+{
+    // Angles are advanced in double and wrapped before narrowing, so the phases stay within 2pi
+    double elapsed = epoch - mPhaseEpoch;
+    size_t chunkCount = (mAsteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            mOrbitPhase[i] = (float)std::fmod((double)mOrbitPhase[i] + (double)OrbitVelocity(i) * elapsed, (double)XM_2PI);
+            mSpinPhase[i] = (float)std::fmod((double)mSpinPhase[i] + (double)SpinVelocity(i) * elapsed, (double)XM_2PI);
+        }
+    });
+    mGrid.ShiftTime(elapsed);
+    mPhaseEpoch = epoch;
+}
+
+
+DirectX::XMMATRIX AsteroidsSimulation::WorldAtTime(size_t i, double time) const
+{
+    // Equivalent to accumulating spin * world * orbit from the initial transform, since rotations
+    // about a fixed axis compose by adding angles and the scale is uniform
+    auto scale = XMMatrixScaling(Scale(i), Scale(i), Scale(i));
+    float epochTime = (float)(time - mPhaseEpoch);
+    auto spin = XMMatrixRotationNormal(SpinAxis(i), mSpinPhase[i] + SpinVelocity(i) * epochTime);
+    auto disc = XMMatrixTranslation(mOrbitRadius[i], mOrbitHeight[i], 0.0f);
+    auto orbit = XMMatrixRotationY(mOrbitPhase[i] + OrbitVelocity(i) * epochTime);
+    return scale * spin * disc * orbit;
+}
+
+
+size_t AsteroidsSimulation::UpdateBytesPerAsteroid(const Settings& settings)
+{
+    size_t depthKeyBytes = settings.frontToBackDraws ? sizeof(unsigned char) : 0;
+    if (settings.closedFormMotion) {
+        // Scale, spin/orbit velocities, spin axis, radius, height and both phases; transform written
+        return sizeof(uint16_t) * 3 + sizeof(uint32_t) + sizeof(float) * 4 +
+               sizeof(AsteroidTransformBlock) / SIM_BLOCK_WIDTH + sizeof(unsigned char) + depthKeyBytes;
+    }
+
+    bool animate = settings.animate;
+    size_t transformBytes = animate ? sizeof(AsteroidTransformBlock) / SIM_BLOCK_WIDTH // Full transform
+                                    : sizeof(float) * 3;                                // Position only
+    size_t parameterBytes = animate ? sizeof(uint16_t) * 3 + sizeof(uint32_t) // Scale, spin/orbit velocities and spin axis
+                                    : sizeof(uint16_t);                       // Scale
+    return transformBytes + parameterBytes + sizeof(unsigned char) + depthKeyBytes; // Subdiv (and depth key) output
+}
+
+
+size_t AsteroidsSimulation::StaticBytesPerAsteroid()
+{
+    return sizeof(uint16_t) * 3 + sizeof(uint32_t) + // Scale, velocities, spin axis
+           sizeof(float) * 4 +                       // Closed-form motion parameters
+           sizeof(uint8_t) * 2 + sizeof(uint16_t);   // Color scheme, texture, mesh instance
+}
+
+
+void AsteroidsSimulation::BeginFrame(float frameTime, FXMVECTOR cameraEye, CXMMATRIX viewProjection,
+                                     const Settings& settings)
+{
+    // The last Cull's triangle count goes with the frame time just measured
+    mLodGovernor.Update(settings, frameTime, mLastFrameStats.triangles);
+    mMinSubdivSizeLog2 = MIN_SUBDIV_SIZE_LOG2 + mLodGovernor.State().bias;
+
+    mLodThresholdTable = settings.lodThresholdTable;
+    if (mLodThresholdTable) {
+        // Pixels per unit of size at unit distance: half the render height times the projection's
+        // Y scale, 1 / tan(fovY / 2), which for a rigid view is the length of the view-projection's
+        // Y column
+        XMFLOAT4X4 vp;
+        XMStoreFloat4x4(&vp, viewProjection);
+        float yScale = std::sqrt(vp._12 * vp._12 + vp._22 * vp._22 + vp._32 * vp._32);
+        float pixelsPerUnit = 0.5f * (float)settings.renderHeight * yScale;
+        float minSubdivSizeLog2 = std::log2(LOD_MIN_SUBDIV_PIXELS / pixelsPerUnit) + mLodGovernor.State().bias;
+
+        // Subdiv k needs size / distance >= 2^(min + k), i.e. distance^2 <= size^2 * 4^-(min + k)
+        for (unsigned int k = 1; k <= mSubdivCount; ++k) {
+            mLodDistanceSqThresholds[k - 1] = std::exp2(-2.0f * (minSubdivSizeLog2 + k));
+        }
+    }
+
+    // A finished background re-sort goes in before anything reads this frame's slots
+    if (mResortJob && mResortReady.load(std::memory_order_acquire)) {
+        JobSystem::Default().Wait(mResortJob);
+        mResortJob = nullptr;
+        ApplyResort();
+    }
+    if (settings.resortFrames > 0 && !mResortJob && ++mFramesSinceResort >= settings.resortFrames) {
+        mFramesSinceResort = 0;
+        ComputeResortKeys();
+        auto& jobSystem = JobSystem::Default();
+        if (jobSystem.ThreadCount() == 1) {
+            // Nobody would pick the job up
+            RadixSortHighBits(&mResortKeys, &mResortScratch, 30, jobSystem);
+            ApplyResort();
+        } else {
+            mResortReady = false;
+            mResortJob = jobSystem.Create([this, &jobSystem]() {
+                // Stable, so equal keys keep slot order
+                RadixSortHighBits(&mResortKeys, &mResortScratch, 30, jobSystem);
+                mResortReady.store(true, std::memory_order_release);
+            });
+            jobSystem.Submit(mResortJob);
+        }
+    }
+
+    // Turning amortization off drops any banked spin; those asteroids are all but invisible
+    mAmortizeInterval = settings.amortizeFarUpdates ? std::max(1u, settings.amortizeInterval) : 1;
+    mAmortizeMaxSubdiv = settings.amortizeMaxSubdiv;
+    if (mAmortizeInterval > 1 && mSpinPending.empty()) {
+        mSpinPending.assign(mAsteroidCount, 0.0f);
+    } else if (mAmortizeInterval == 1 && !mSpinPending.empty()) {
+        std::vector<float>().swap(mSpinPending);
+    }
+    // Update refreshes the keys; amortized far asteroids sort last until their first full update
+    if (settings.frontToBackDraws && mDepthKey.empty()) {
+        mDepthKey.assign(mAsteroidCount, (unsigned char)(DEPTH_KEY_COUNT - 1));
+    } else if (!settings.frontToBackDraws && !mDepthKey.empty()) {
+        std::vector<unsigned char>().swap(mDepthKey);
+    }
+
+    for (auto& counts : mUpdateCounts) {
+        for (auto& count : counts) count = 0;
+    }
+    mQueryBvhStale = true;
 
-        auto orbitRadius = orbitRadiusDist(rng);
-        auto discPosY = float(SIM_DISC_RADIUS) * heightDist(rng);
+    double fixedStep = settings.simulationHz > 0 ? 1.0 / settings.simulationHz : 0.0;
+    if (fixedStep != mFixedStep) {
+        SetFixedStep(fixedStep);
+    }
+
+    if (mFixedStep > 0.0) {
+        mStepAccumulator += settings.animate ? frameTime : 0.0;
+        mStepsThisFrame = (unsigned int)std::min(mStepAccumulator / mFixedStep, (double)MAX_STEPS_PER_FRAME);
+        mStepAccumulator = std::min(mStepAccumulator - mStepsThisFrame * mFixedStep, mFixedStep);
+        mInterpolation = (float)(mStepAccumulator / mFixedStep);
+        for (unsigned int s = 0; s < mStepsThisFrame; ++s) {
+            mTime += mFixedStep; // Step by step so the result only depends on the count
+        }
+        mFrameTime = (float)(mStepsThisFrame * mFixedStep);
+    } else {
+        mFrameTime = settings.animate ? frameTime : 0.0f;
+        mTime += mFrameTime;
+    }
+    mUpdatePass += mUpdatePasses;
+    mUpdatePasses = (mFixedStep > 0.0) ? mStepsThisFrame : 1;
+
+    mCameraEye = cameraEye;
+    mViewProjection = viewProjection;
+    mFrustum = ExtractFrustum(viewProjection);
 
-        auto disc = XMMatrixTranslation(orbitRadius, discPosY, 0.0f);
+    // Epochs sit on a fixed grid, so runs that reach the same time fold the same way
+    double epoch = std::floor(mTime / PHASE_EPOCH_INTERVAL) * PHASE_EPOCH_INTERVAL;
+    if (epoch != mPhaseEpoch) {
+        RebasePhases(epoch);
+    }
+
+    // Culling sees the rendered transforms, which trail mTime in fixed-step mode
+    mGrid.Advance(GridTime());
+}
+
+
+void AsteroidsSimulation::Update(const Settings& settings, size_t startIndex, size_t count)
+{
+    size_t last = count ? startIndex + count : mAsteroidCount;
 
-        auto positionAngle = angleDist(rng);
-        auto orbit = XMMatrixRotationY(positionAngle);
+    if (mFixedStep == 0.0) {
+        UpdateTransforms(settings, mTime, mFrameTime, mUpdatePass, mAmortizeInterval, startIndex, last);
+        return;
+    }
 
-        auto meshInstance = (unsigned int)(i / instancesPerMesh); // Vcache friendly ordering
+    // Integration has to take every step; closed-form only needs the last two
+    unsigned int firstStep = settings.closedFormMotion ? std::max(mStepsThisFrame, 2u) - 2 : 0;
+    for (unsigned int s = firstStep; s < mStepsThisFrame; ++s) {
+        if (s + 1 == mStepsThisFrame) {
+            for (size_t i = startIndex; i < last; ++i) {
+                mPrevWorld[i / SIM_BLOCK_WIDTH].Store(i % SIM_BLOCK_WIDTH, mWorld[i / SIM_BLOCK_WIDTH].Load(i % SIM_BLOCK_WIDTH));
+            }
+        }
+        double stepTime = mTime - (mStepsThisFrame - 1 - s) * mFixedStep;
+        // Far asteroids are carried along from the last step, so after skipping steps they need a full update
+        unsigned int interval = (s == firstStep && firstStep > 0) ? 1 : mAmortizeInterval;
+        UpdateTransforms(settings, stepTime, (float)mFixedStep, mUpdatePass + s, interval, startIndex, last);
+    }
 
-        // Static data
-        mAsteroidStatic[i].spinVelocity = spinVelocityDist(rng) / scale; // Smaller asteroids spin faster
-        mAsteroidStatic[i].orbitVelocity = radialVelocityDist(rng) / (scale * orbitRadius); // Smaller asteroids go faster, and use arc length
-        mAsteroidStatic[i].vertexStart = mVertexCountPerMesh * meshInstance;
-        mAsteroidStatic[i].spinAxis = XMVector3Normalize(RandomPointOnSphere(rng));
-        mAsteroidStatic[i].scale = scale;
-        mAsteroidStatic[i].textureIndex = textureIndexDist(rng);
+    InterpolateTransforms(startIndex, last);
+}
 
-        auto colorScheme = ((int)abs(colorSchemeDist(rng))) % NUM_COLOR_SCHEMES;
-        auto c = linearColorSchemes + 6 * colorScheme;
-        mAsteroidStatic[i].surfaceColor = XMFLOAT3(c[0], c[1], c[2]);
-        mAsteroidStatic[i].deepColor    = XMFLOAT3(c[3], c[4], c[5]);
 
-        // Initialize dynamic data
-        mAsteroidDynamic[i].world = scaleMatrix * disc * orbit;
+void AsteroidsSimulation::InterpolateTransforms(size_t first, size_t last)
+{
+    // Blending matrices elementwise shrinks rotations very slightly mid-step; at simulation rates
+    // that's invisible and much cheaper than rebuilding them from angles.
+    float t = mInterpolation;
+    for (size_t i = first; i < last; ++i) {
+        auto block = i / SIM_BLOCK_WIDTH;
+        auto lane = i % SIM_BLOCK_WIDTH;
+        auto prev = &mPrevWorld[block];
+        auto curr = &mWorld[block];
+        auto render = &mRenderWorld[block];
+        for (int e = 0; e < 12; ++e) {
+            render->m[e][lane] = prev->m[e][lane] + t * (curr->m[e][lane] - prev->m[e][lane]);
+        }
 
-        assert(mAsteroidStatic[i].scale > 0.0f);
-        assert(mAsteroidStatic[i].orbitVelocity > 0.0f);
+        // LOD from where the asteroid is drawn
+        mSubdiv[i] = PickSubdiv(i, render->LoadPosition(lane));
+        if (!mDepthKey.empty()) {
+            mDepthKey[i] = PickDepthKey(render->LoadPosition(lane));
+        }
     }
 }
 
 
-void AsteroidsSimulation::Update(float frameTime, DirectX::XMVECTOR cameraEye, const Settings& settings,
-                                 size_t startIndex, size_t count)
+void AsteroidsSimulation::Cull(const Settings& settings, AsteroidDrawList* drawList)
+{
+    drawList->clear();
+    mLastFrameStats = SimulationStats();
+
+    if (!settings.cullAsteroids) {
+        for (size_t i = 0; i < mAsteroidCount; ++i) {
+            drawList->indices.push_back((unsigned int)i);
+        }
+    } else if (settings.gridCulling) {
+        if (mGridStale) {
+            BuildGrid();
+        }
+        mCullCandidates.clear();
+        mLastFrameStats.grid = mGrid.Cull(mFrustum, &drawList->indices, &mCullCandidates);
+        for (auto i : mCullCandidates) {
+            if (SphereInFrustum(mFrustum, World(i).r[3], BoundingRadius(i))) {
+                drawList->indices.push_back(i);
+            }
+        }
+    } else {
+        CullFlat(0, mAsteroidCount, drawList);
+    }
+
+    if (settings.cullAsteroids && settings.occlusionCulling) {
+        CullOccluded(drawList);
+    }
+
+    // Stable, so buckets keep the depth order within them
+    if (settings.frontToBackDraws && !mDepthKey.empty()) {
+        SortDrawList(drawList, DEPTH_KEY_COUNT, [this](unsigned int i) { return mDepthKey[i]; }, nullptr);
+    }
+    if (settings.bucketDrawList) {
+        SortDrawList(drawList, DrawBucketCount(), [this](unsigned int i) { return DrawBucket(i); }, &drawList->bucketOffsets);
+    }
+
+    for (auto i : drawList->indices) {
+        mLastFrameStats.drawsPerSubdiv[mSubdiv[i]]++;
+    }
+    for (unsigned int subdiv = 0; subdiv <= mSubdivCount; ++subdiv) {
+        mLastFrameStats.triangles += mLastFrameStats.drawsPerSubdiv[subdiv] * (SubdivIndexCount(subdiv) / 3);
+    }
+    mLastFrameStats.lodGovernor = mLodGovernor.State();
+    for (unsigned int subdiv = 0; subdiv <= mSubdivCount; ++subdiv) {
+        mLastFrameStats.asteroidsPerSubdiv[subdiv] = mUpdateCounts[0][subdiv];
+        mLastFrameStats.updatesPerSubdiv[subdiv] = mUpdateCounts[1][subdiv];
+    }
+    mLastFrameStats.collisionTests = mCollisionTests;
+    mLastFrameStats.collisionContacts = mCollisionContacts;
+    mLastFrameStats.collisionMs = mCollisionMs;
+    mLastFrameStats.gravityInteractions = mGravityInteractions;
+    mLastFrameStats.gravityBuildMs = mGravityBuildMs;
+    mLastFrameStats.gravityMs = mGravityMs;
+
+    drawList->culledCount = (unsigned int)(mAsteroidCount - drawList->indices.size());
+    mLastFrameStats.simulationSteps = mStepsThisFrame;
+    mLastFrameStats.visible = (unsigned int)drawList->indices.size();
+    mLastFrameStats.culled = drawList->culledCount;
+}
+
+
+void AsteroidsSimulation::CaptureFrame(SimulationFrame* frame) const
+{
+    auto& indices = frame->drawList.indices;
+    frame->world.resize(indices.size());
+    frame->subdiv.resize(indices.size());
+    for (size_t k = 0; k < indices.size(); ++k) {
+        auto i = indices[k];
+        auto block = &mDrawWorld[i / SIM_BLOCK_WIDTH];
+        auto lane = i % SIM_BLOCK_WIDTH;
+        auto world = &frame->world[k]._11;
+        for (int e = 0; e < 12; ++e) {
+            world[e] = block->m[e][lane];
+        }
+        frame->subdiv[k] = mSubdiv[i];
+        indices[k] = mSlotToId[i];
+    }
+    frame->stats = mLastFrameStats;
+}
+
+
+void AsteroidsSimulation::UpdateTransforms(const Settings& settings, double time, float frameTime,
+                                           unsigned int pass, unsigned int interval, size_t first, size_t last)
 {
     bool animate = settings.animate;
+    bool closedForm = settings.closedFormMotion;
+
+    // Band counts for this range; published once at the end
+    unsigned int counts[2][MESH_MAX_SUBDIV_LEVELS + 1] = {};
+    auto publishCounts = [&]() {
+        if (mAmortizeInterval == 1) return;
+        for (unsigned int subdiv = 0; subdiv <= mSubdivCount; ++subdiv) {
+            mUpdateCounts[0][subdiv] += counts[0][subdiv];
+            mUpdateCounts[1][subdiv] += counts[1][subdiv];
+        }
+    };
+
+    auto simdLevel = std::min(mSimdLevel, settings.simdLevel);
+    if (simdLevel == SIMD_LEVEL_SCALAR) {
+        UpdateScalar(animate, closedForm, time, frameTime, pass, interval, first, last, counts);
+        publishCounts();
+        return;
+    }
+
+    // Ranges need not be block aligned; partial blocks at either end take the scalar path.
+    // Another thread may own the rest of those blocks so we can't touch their other lanes.
+    size_t firstBlock = (first + SIM_BLOCK_WIDTH - 1) / SIM_BLOCK_WIDTH;
+    size_t lastBlock = last / SIM_BLOCK_WIDTH;
+    if (firstBlock >= lastBlock) {
+        UpdateScalar(animate, closedForm, time, frameTime, pass, interval, first, last, counts);
+        publishCounts();
+        return;
+    }
+
+    UpdateScalar(animate, closedForm, time, frameTime, pass, interval, first, firstBlock * SIM_BLOCK_WIDTH, counts);
+
+    SimUpdateKernelArgs args = {};
+    args.world             = mWorld.data();
+    args.subdiv            = mSubdiv.data();
+    args.depthKey          = mDepthKey.empty() ? nullptr : mDepthKey.data();
+    args.scale             = mScale.data();
+    args.spinVelocity      = mSpinVelocity.data();
+    args.orbitVelocity     = mOrbitVelocity.data();
+    args.spinAxis          = mSpinAxis.data();
+    args.orbitRadius       = mOrbitRadius.data();
+    args.orbitHeight       = mOrbitHeight.data();
+    args.orbitPhase        = mOrbitPhase.data();
+    args.spinPhase         = mSpinPhase.data();
+    args.firstBlock        = firstBlock;
+    args.lastBlock         = lastBlock;
+    args.frameTime         = frameTime;
+    args.time              = (float)(time - mPhaseEpoch);
+    args.minSubdivSizeLog2 = mMinSubdivSizeLog2;
+    args.lodDistanceSqThresholds = mLodThresholdTable ? mLodDistanceSqThresholds : nullptr;
+    args.subdivCount       = mSubdivCount;
+    args.animate           = animate;
+    args.closedForm        = closedForm;
+    args.spinPending       = mSpinPending.empty() ? nullptr : mSpinPending.data();
+    args.amortizePass      = pass;
+    args.amortizeInterval  = interval;
+    args.amortizeMaxSubdiv = mAmortizeMaxSubdiv;
+    args.asteroidCounts    = mAmortizeInterval > 1 ? counts[0] : nullptr;
+    args.updateCounts      = counts[1];
+    XMStoreFloat3(&args.cameraEye, mCameraEye);
+
+    // No 16-wide kernel yet; a block is 8 wide so AVX-512 machines use the AVX2 kernel
+    if (simdLevel >= SIMD_LEVEL_AVX2) {
+        SimUpdateKernelAVX2(args);
+    } else {
+        SimUpdateKernelSSE41(args);
+    }
+
+    UpdateScalar(animate, closedForm, time, frameTime, pass, interval, lastBlock * SIM_BLOCK_WIDTH, last, counts);
+    publishCounts();
+}
+
+
+void AsteroidsSimulation::UpdateScalar(bool animate, bool closedForm, double time, float frameTime,
+                                       unsigned int pass, unsigned int interval, size_t first, size_t last,
+                                       unsigned int counts[2][MESH_MAX_SUBDIV_LEVELS + 1])
+{
+    for (size_t i = first; i < last; ++i) {
+        auto block = &mWorld[i / SIM_BLOCK_WIDTH];
+        auto lane = i % SIM_BLOCK_WIDTH;
+
+        if (mAmortizeInterval > 1) {
+            // Same round robin as the SIMD kernels: whole blocks take their turn together
+            auto subdiv = mSubdiv[i];
+            bool skip = interval > 1 && subdiv <= mAmortizeMaxSubdiv && (i / SIM_BLOCK_WIDTH + pass) % interval != 0;
+            counts[0][subdiv]++;
+            counts[1][subdiv] += !skip;
+            if (skip) {
+                // Small-angle orbit step: sin a ~ a, cos a ~ 1 - a^2/2; spin waits for the full update
+                if (frameTime != 0.0f) {
+                    float s = OrbitVelocity(i) * frameTime;
+                    float c = 1.0f - (s * s) * 0.5f;
+                    for (int r = 0; r < 4; ++r) {
+                        float x = block->m[3*r+0][lane];
+                        float z = block->m[3*r+2][lane];
+                        block->m[3*r+0][lane] = z * s + x * c;
+                        block->m[3*r+2][lane] = z * c - x * s;
+                    }
+                }
+                mSpinPending[i] += frameTime;
+                continue;
+            }
+        }
+
+        float spinTime = frameTime;
+        if (!mSpinPending.empty()) {
+            spinTime = frameTime + mSpinPending[i];
+            mSpinPending[i] = 0.0f;
+        }
 
-    // TODO: This constant should really depend on resolution and/or be configurable...
-    static const float minSubdivSizeLog2 = std::log2f(0.0019f);
+        XMVECTOR position;
+        if (closedForm) {
+            auto world = WorldAtTime(i, time);
+            block->Store(lane, world);
+            position = world.r[3];
+        } else if (animate) {
+            auto orbit = XMMatrixRotationY(OrbitVelocity(i) * frameTime);
+            auto spin = XMMatrixRotationNormal(SpinAxis(i), SpinVelocity(i) * spinTime);
+            auto world = spin * block->Load(lane) * orbit;
+            block->Store(lane, world);
+            position = world.r[3];
+        } else {
+            position = block->LoadPosition(lane);
+        }
+
+        mSubdiv[i] = PickSubdiv(i, position);
+        if (!mDepthKey.empty()) {
+            mDepthKey[i] = PickDepthKey(position);
+        }
+    }
+}
+
+
+unsigned char AsteroidsSimulation::PickSubdiv(size_t i, FXMVECTOR position) const
+{
+    if (mLodThresholdTable) {
+        // A few compares against this frame's thresholds; no transcendentals
+        float distanceSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(mCameraEye, position)));
+        float scale = Scale(i);
+        float scaleSq = scale * scale;
+        unsigned int subdiv = 0;
+        for (unsigned int k = 0; k < mSubdivCount; ++k) {
+            subdiv += (distanceSq <= scaleSq * mLodDistanceSqThresholds[k]);
+        }
+        return (unsigned char)subdiv;
+    }
+
+    // Pick LOD based on approx screen area - can be very approximate
+    auto distanceToEyeRcp = XMVectorGetX(XMVector3ReciprocalLengthEst(XMVectorSubtract(mCameraEye, position)));
+    // Add one subdiv for each factor of 2 past min
+    auto relativeScreenSizeLog2 = VeryApproxLog2f(Scale(i) * distanceToEyeRcp);
+    float subdivFloat = std::max(0.0f, relativeScreenSizeLog2 - mMinSubdivSizeLog2);
+    return (unsigned char)std::min(mSubdivCount, (unsigned int)subdivFloat);
+}
+
+
+unsigned char AsteroidsSimulation::PickDepthKey(FXMVECTOR position) const
+{
+    return DepthKey(XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(mCameraEye, position))));
+}
+
+
+void AsteroidsSimulation::CullOccluded(AsteroidDrawList* drawList)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto& indices = drawList->indices;
+
+    // Occluders: the largest on screen among those drawn at the finest LOD, which is the one
+    // the occluder radius was fitted inside
+    mOccluderCandidates.clear();
+    for (auto i : indices) {
+        if (mSubdiv[i] != mSubdivCount) continue;
+        auto distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(World(i).r[3], mCameraEye)));
+        auto size = Scale(i) * mOccluderRadius[mMeshInstance[mSlotToId[i]]] / distance;
+        if (size > OCCLUDER_MIN_SIZE) {
+            mOccluderCandidates.push_back(std::make_pair(size, i));
+        }
+    }
+    if (mOccluderCandidates.size() > MAX_OCCLUDERS) {
+        std::nth_element(mOccluderCandidates.begin(), mOccluderCandidates.begin() + MAX_OCCLUDERS,
+                         mOccluderCandidates.end(), std::greater<std::pair<float, unsigned int>>());
+        mOccluderCandidates.resize(MAX_OCCLUDERS);
+    }
+
+    auto occluderCount = (unsigned int)mOccluderCandidates.size();
+    auto trianglesPerOccluder = mOccluderIndices.size() / 3;
+    mOcclusion.BeginFrame(mViewProjection, occluderCount * trianglesPerOccluder);
+
+    jobs::parallel_for(0u, occluderCount, [&](unsigned int o) {
+        auto i = mOccluderCandidates[o].second;
+        auto mesh = mMeshInstance[mSlotToId[i]];
+        mOcclusion.SetupOccluder(o * trianglesPerOccluder, World(i), &mOccluderVertices[mesh * mOccluderVertexCount],
+                                 mOccluderIndices.data(), trianglesPerOccluder);
+    });
 
-    size_t last = count ? startIndex + count : mAsteroidDynamic.size();
-    for (size_t i = startIndex; i < last; ++i) {
-        const AsteroidStatic& staticData = mAsteroidStatic[i];
-        AsteroidDynamic& dynamicData = mAsteroidDynamic[i];
+    jobs::parallel_for(0u, mOcclusion.TileCount(), [&](unsigned int tile) {
+        mOcclusion.RasterizeTile(tile);
+    });
 
-        if (animate) {
-            auto orbit = XMMatrixRotationY(staticData.orbitVelocity * frameTime);
-            auto spin = XMMatrixRotationNormal(staticData.spinAxis, staticData.spinVelocity * frameTime);
-            dynamicData.world = spin * dynamicData.world * orbit;
+    // Test in chunks so threads don't share cache lines of the flags, then compact in order
+    enum { CHUNK_SIZE = 1024 };
+    size_t count = indices.size();
+    mOccluded.resize(count);
+    jobs::parallel_for(size_t(0), (count + CHUNK_SIZE - 1) / CHUNK_SIZE, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            auto i = indices[k];
+            mOccluded[k] = mOcclusion.IsOccluded(World(i).r[3], BoundingRadius(i));
         }
+    });
 
-        // Pick LOD based on approx screen area - can be very approximate
-        auto position = dynamicData.world.r[3];
-        auto distanceToEyeRcp = XMVectorGetX(XMVector3ReciprocalLengthEst(XMVectorSubtract(cameraEye, position)));
-        // Add one subdiv for each factor of 2 past min
-        auto relativeScreenSizeLog2 = VeryApproxLog2f(staticData.scale * distanceToEyeRcp);
-        float subdivFloat = std::max(0.0f, relativeScreenSizeLog2 - minSubdivSizeLog2);
-        auto subdiv = std::min(mSubdivCount, (unsigned int)subdivFloat);
+    size_t visible = 0;
+    for (size_t k = 0; k < count; ++k) {
+        if (!mOccluded[k]) indices[visible++] = indices[k];
+    }
+    indices.resize(visible);
+
+    mLastFrameStats.occluders = occluderCount;
+    mLastFrameStats.occluded = (unsigned int)(count - visible);
+    mLastFrameStats.occlusionMs = 1000.0f * std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+template <typename KeyFn>
+void AsteroidsSimulation::SortDrawList(AsteroidDrawList* drawList, unsigned int bucketCount, KeyFn key,
+                                       std::vector<unsigned int>* bucketOffsets)
+{
+    // Stable counting sort: count per chunk in parallel, scan bucket-major/chunk-minor, scatter in parallel
+    enum { CHUNK_SIZE = 4096 };
+    auto& indices = drawList->indices;
+    size_t count = indices.size();
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    mBucketCounts.assign(chunkCount * bucketCount, 0);
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        auto counts = &mBucketCounts[chunk * bucketCount];
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            counts[key(indices[k])]++;
+        }
+    });
 
-        // TODO: Ignore/cull/force lowest subdiv if offscreen?
-        
-        dynamicData.indexStart = mIndexOffsets[subdiv];
-        dynamicData.indexCount = mIndexOffsets[subdiv+1] - dynamicData.indexStart;
+    if (bucketOffsets) bucketOffsets->resize(bucketCount + 1);
+    unsigned int offset = 0;
+    for (unsigned int b = 0; b < bucketCount; ++b) {
+        if (bucketOffsets) (*bucketOffsets)[b] = offset;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            auto countInChunk = mBucketCounts[chunk * bucketCount + b];
+            mBucketCounts[chunk * bucketCount + b] = offset;
+            offset += countInChunk;
+        }
     }
+    if (bucketOffsets) (*bucketOffsets)[bucketCount] = offset;
+
+    mBucketScratch.resize(count);
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        auto offsets = &mBucketCounts[chunk * bucketCount];
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            auto i = indices[k];
+            mBucketScratch[offsets[key(i)]++] = i;
+        }
+    });
+    std::swap(indices, mBucketScratch);
+}
+
+
+void AsteroidsSimulation::CullFlat(size_t first, size_t last, AsteroidDrawList* drawList)
+{
+    // Groups of 4 lanes inside a block are tested together straight from the SoA position
+    // elements; anything not covered by a whole group in this range is tested one by one.
+    size_t firstGroup = std::min(last, (first + 3) & ~size_t(3));
+    size_t lastGroup = std::max(firstGroup, last & ~size_t(3));
+
+    for (size_t i = first; i < firstGroup; ++i) {
+        if (SphereInFrustum(mFrustum, World(i).r[3], BoundingRadius(i))) {
+            drawList->indices.push_back((unsigned int)i);
+        }
+    }
+
+    XMVECTOR planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+        planeX[p] = XMVectorSplatX(mFrustum.planes[p]);
+        planeY[p] = XMVectorSplatY(mFrustum.planes[p]);
+        planeZ[p] = XMVectorSplatZ(mFrustum.planes[p]);
+        planeW[p] = XMVectorSplatW(mFrustum.planes[p]);
+    }
+    auto meshRadius = XMVectorReplicate(mMeshBoundingRadius);
+
+    for (size_t i = firstGroup; i < lastGroup; i += 4) {
+        auto m = mDrawWorld[i / SIM_BLOCK_WIDTH].m;
+        auto lane = i % SIM_BLOCK_WIDTH;
+        auto x = XMLoadFloat4((const XMFLOAT4*)&m[ 9][lane]);
+        auto y = XMLoadFloat4((const XMFLOAT4*)&m[10][lane]);
+        auto z = XMLoadFloat4((const XMFLOAT4*)&m[11][lane]);
+        auto negRadius = XMVectorNegate(XMVectorMultiply(UnpackHalf4(&mScale[i]), meshRadius));
+
+        auto inside = XMVectorTrueInt();
+        for (int p = 0; p < 6; ++p) {
+            auto d = XMVectorMultiplyAdd(z, planeZ[p], XMVectorMultiplyAdd(y, planeY[p], XMVectorMultiplyAdd(x, planeX[p], planeW[p])));
+            inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(d, negRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (unsigned int l = 0; l < 4; ++l) {
+            if (mask & (1 << l)) drawList->indices.push_back((unsigned int)(i + l));
+        }
+    }
+
+    for (size_t i = lastGroup; i < last; ++i) {
+        if (SphereInFrustum(mFrustum, World(i).r[3], BoundingRadius(i))) {
+            drawList->indices.push_back((unsigned int)i);
+        }
+    }
+}
+
+
+void AsteroidsSimulation::ComputeResortKeys()
+{
+    // The belt's extent (orbit radius and height are normal; this is about 6 sigma), quantized
+    // to 10 bits per axis. Stragglers clamp to the edge.
+    const float horizontal = SIM_ORBIT_RADIUS + 3.5f * SIM_DISC_RADIUS;
+    const float vertical = 2.5f * SIM_DISC_RADIUS;
+    auto quantize = [](float v, float extent) {
+        return (uint32_t)std::min(std::max((v + extent) * (1023.0f / (2.0f * extent)), 0.0f), 1023.0f);
+    };
+
+    mResortKeys.resize(mAsteroidCount);
+    size_t chunkCount = (mAsteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            auto m = mWorld[i / SIM_BLOCK_WIDTH].m;
+            auto lane = i % SIM_BLOCK_WIDTH;
+            uint32_t key = Part1By2(quantize(m[ 9][lane], horizontal)) |
+                           Part1By2(quantize(m[10][lane], vertical)) << 1 |
+                           Part1By2(quantize(m[11][lane], horizontal)) << 2;
+            mResortKeys[i] = (uint64_t)key << 32 | i;
+        }
+    });
+}
+
+
+// Gathers stream into the new slot order: slot i takes what was in slot order[i]
+template <typename T>
+static void PermuteStream(std::vector<T>* stream, const std::vector<unsigned int>& order)
+{
+    if (stream->empty()) return;
+    std::vector<T> permuted(stream->size());
+    size_t count = order.size();
+    size_t chunkCount = (count + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(count, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            permuted[i] = (*stream)[order[i]];
+        }
+    });
+    stream->swap(permuted);
+}
+
+static void PermuteStream(std::vector<AsteroidTransformBlock>* stream, const std::vector<unsigned int>& order)
+{
+    if (stream->empty()) return;
+    std::vector<AsteroidTransformBlock> permuted(stream->size());
+    size_t count = order.size();
+    size_t chunkCount = (count + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobs::parallel_for(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(count, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            auto src = &(*stream)[order[i] / SIM_BLOCK_WIDTH];
+            auto dst = &permuted[i / SIM_BLOCK_WIDTH];
+            for (int e = 0; e < 12; ++e) {
+                dst->m[e][i % SIM_BLOCK_WIDTH] = src->m[e][order[i] % SIM_BLOCK_WIDTH];
+            }
+        }
+    });
+    stream->swap(permuted);
+}
+
+
+void AsteroidsSimulation::ApplyResort()
+{
+    std::vector<unsigned int> order(mAsteroidCount);
+    for (size_t i = 0; i < mAsteroidCount; ++i) {
+        order[i] = (unsigned int)mResortKeys[i];
+    }
+
+    PermuteStream(&mSlotToId, order);
+    PermuteStream(&mScale, order);
+    PermuteStream(&mSpinVelocity, order);
+    PermuteStream(&mOrbitVelocity, order);
+    PermuteStream(&mSpinAxis, order);
+    PermuteStream(&mOrbitRadius, order);
+    PermuteStream(&mOrbitHeight, order);
+    PermuteStream(&mOrbitPhase, order);
+    PermuteStream(&mSpinPhase, order);
+    PermuteStream(&mWorld, order);
+    PermuteStream(&mPrevWorld, order);
+    PermuteStream(&mRenderWorld, order);
+    PermuteStream(&mSubdiv, order);
+    PermuteStream(&mDepthKey, order);
+    mBroadphase = CollisionBroadphase();
+    PermuteStream(&mSpinPending, order);
+    PermuteStream(&mGravityPosition, order);
+    PermuteStream(&mGravityVelocity, order);
+    mQueryBvh = SphereBvh();
+    mQueryBvhStale = true;
+    mDrawWorld = mFixedStep > 0.0 ? mRenderWorld.data() : mWorld.data();
+
+    BuildGrid();
+}
+
+
+void AsteroidsSimulation::Resort()
+{
+    if (mResortJob) {
+        JobSystem::Default().Wait(mResortJob);
+        mResortJob = nullptr;
+    }
+    ComputeResortKeys();
+    RadixSortHighBits(&mResortKeys, &mResortScratch, 30, JobSystem::Default());
+    ApplyResort();
 }
 
 
@@ -181,11 +1066,10 @@ void AsteroidsSimulation::CreateTextures(unsigned int textureCount, unsigned int
     mTextureDim = TEXTURE_DIM;
     mTextureCount = textureCount;
     mTextureArraySize = 3;
-    {
-        DWORD msbIndex = 0;
-        auto result = _BitScanReverse(&msbIndex, mTextureDim);
-        assert(result); // Should only fail if mTextureDim = 0
-        mTextureMipLevels = msbIndex + 1;
+    assert(mTextureDim > 0);
+    mTextureMipLevels = 0; // Full chain: one level per bit up to the highest set one
+    for (auto dim = mTextureDim; dim > 0; dim >>= 1) {
+        ++mTextureMipLevels;
     }
 
     assert((mTextureDim & (mTextureDim-1)) == 0); // Must be pow2 currently; we don't handle wacky mip chains
@@ -195,10 +1079,10 @@ void AsteroidsSimulation::CreateTextures(unsigned int textureCount, unsigned int
         << mTextureDim << "x" << mTextureDim << " textures..." << std::endl;
     
     // Allocate space
-    UINT texelSizeInBytes = 4; // RGBA8
-    UINT extraSpaceForMips = 2;
-    UINT totalTextureSizeInBytes = texelSizeInBytes * mTextureDim * mTextureDim * mTextureArraySize * extraSpaceForMips;
-    totalTextureSizeInBytes = Align(totalTextureSizeInBytes, 64U); // Avoid false sharing
+    unsigned int texelSizeInBytes = 4; // RGBA8
+    unsigned int extraSpaceForMips = 2;
+    unsigned int totalTextureSizeInBytes = texelSizeInBytes * mTextureDim * mTextureDim * mTextureArraySize * extraSpaceForMips;
+    totalTextureSizeInBytes = (totalTextureSizeInBytes + 63) & ~63U; // Avoid false sharing
 
     mTextureDataBuffer.resize(totalTextureSizeInBytes * textureCount);
     mTextureSubresources.resize(mTextureArraySize * mTextureMipLevels * textureCount);
@@ -210,24 +1094,24 @@ void AsteroidsSimulation::CreateTextures(unsigned int textureCount, unsigned int
         for (auto &i : rngSeeds) i = seeds();
     }
 
-    concurrency::parallel_for(UINT(0), textureCount, [&](UINT t) {
+    jobs::parallel_for(0U, textureCount, [&](unsigned int t) {
         std::mt19937 rng(rngSeeds[t]);
         auto randomNoise = std::uniform_real_distribution<float>(0.0f, 10000.0f);
         auto randomNoiseScale = std::uniform_real_distribution<float>(100, 150);
         auto randomPersistence = std::normal_distribution<float>(0.9f, 0.2f);
 
-        BYTE* data = mTextureDataBuffer.data() + t * totalTextureSizeInBytes;
-        for (UINT a = 0; a < mTextureArraySize; ++a) {
-            for (UINT m = 0; m < mTextureMipLevels; ++m) {
+        uint8_t* data = mTextureDataBuffer.data() + t * totalTextureSizeInBytes;
+        for (unsigned int a = 0; a < mTextureArraySize; ++a) {
+            for (unsigned int m = 0; m < mTextureMipLevels; ++m) {
                 auto width  = mTextureDim >> m;
                 auto height = mTextureDim >> m;
 
-                D3D11_SUBRESOURCE_DATA initialData = {};
-                initialData.pSysMem = data;
-                initialData.SysMemPitch = width * texelSizeInBytes;
-                mTextureSubresources[SubresourceIndex(t, a, m)] = initialData;
+                TextureSubresource subresource = {};
+                subresource.data = data;
+                subresource.rowPitch = width * texelSizeInBytes;
+                mTextureSubresources[SubresourceIndex(t, a, m)] = subresource;
 
-                data += initialData.SysMemPitch * height;
+                data += subresource.rowPitch * height;
             }
         }
 
@@ -236,7 +1120,7 @@ void AsteroidsSimulation::CreateTextures(unsigned int textureCount, unsigned int
         float persistence = randomPersistence(rng);
         float strength = 1.5f;
 
-        for (UINT a = 0; a < mTextureArraySize; ++a) {
+        for (unsigned int a = 0; a < mTextureArraySize; ++a) {
             float redScale   = 255.0f;
             float greenScale = 255.0f;
             float blueScale  = 255.0f;
@@ -254,3 +1138,372 @@ void AsteroidsSimulation::CreateTextures(unsigned int textureCount, unsigned int
         }
     }); // parallel_for
 }
+
+
+void AsteroidsSimulation::Collide(const Settings& settings, JobSystem& jobSystem)
+{
+    mCollisionTests = 0;
+    mCollisionContacts = 0;
+    mCollisionMs = 0.0f;
+    if (!settings.collisions) {
+        if (mBroadphase.Count() > 0) {
+            mBroadphase = CollisionBroadphase();
+            std::vector<XMFLOAT3>().swap(mCollisionCenters);
+            std::vector<XMFLOAT3>().swap(mCollisionVelocities);
+            std::vector<unsigned char>().swap(mCollided);
+        }
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (mBroadphase.Count() != mAsteroidCount) {
+        std::vector<float> boundingRadius(mAsteroidCount);
+        for (size_t i = 0; i < mAsteroidCount; ++i) {
+            boundingRadius[i] = BoundingRadius(i);
+        }
+        mBroadphase.Reset(mAsteroidCount, boundingRadius.data());
+    }
+
+    // Centers and velocities as of mTime; rotating about Y at w moves (x, y, z) at w * (z, 0, -x).
+    // Under gravity the orbits only approximate the motion, which has its own velocities.
+    bool gravity = !mGravityVelocity.empty();
+    mCollisionCenters.resize(mAsteroidCount);
+    mCollisionVelocities.resize(mAsteroidCount);
+    mCollided.resize(mAsteroidCount);
+    size_t chunkCount = (mAsteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            auto block = &mWorld[i / SIM_BLOCK_WIDTH];
+            auto lane = i % SIM_BLOCK_WIDTH;
+            XMFLOAT3 center(block->m[9][lane], block->m[10][lane], block->m[11][lane]);
+            float orbitVelocity = OrbitVelocity(i);
+            mCollisionCenters[i] = center;
+            mCollisionVelocities[i] = gravity ? mGravityVelocity[i]
+                                              : XMFLOAT3(orbitVelocity * center.z, 0.0f, -orbitVelocity * center.x);
+        }
+    }, 1);
+    mBroadphase.Build(mCollisionCenters.data(), jobSystem);
+
+    // Every asteroid gathers its own contacts and only writes its own state. Going in hash order
+    // keeps neighboring queries on the same buckets.
+    std::atomic<uint64_t> tests{ 0 };
+    std::atomic<unsigned int> contacts{ 0 };
+    std::atomic<unsigned int> moved{ 0 };
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        uint64_t chunkTests = 0;
+        unsigned int chunkContacts = 0;
+        unsigned int chunkMoved = 0;
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t k = chunk * SIM_FIELD_CHUNK; k < last; ++k) {
+            auto i = mBroadphase.SphereInOrder(k);
+            mCollided[i] = RespondToCollisions(i, &chunkTests, &chunkContacts);
+            chunkMoved += mCollided[i];
+        }
+        tests += chunkTests;
+        contacts += chunkContacts;
+        moved += chunkMoved;
+    }, 1);
+
+    // The grid predicts sector crossings from the orbits, so it has to follow every change. Once
+    // much of the field has changed, starting over beats moving asteroids one by one; without
+    // grid culling, or if gravity already has it rebuilt, it waits until the grid is next needed.
+    if (!settings.gridCulling || mGridStale) {
+        mGridStale = mGridStale || moved > 0;
+    } else if (moved > mAsteroidCount / 8) {
+        BuildGrid();
+    } else if (moved > 0) {
+        for (size_t i = 0; i < mAsteroidCount; ++i) {
+            if (mCollided[i]) {
+                mGrid.Move((unsigned int)i, mOrbitRadius[i], mOrbitHeight[i], mOrbitPhase[i], OrbitVelocity(i), GridTime());
+            }
+        }
+        mGrid.UpdateBounds();
+    }
+
+    mCollisionTests = tests;
+    mCollisionContacts = contacts;
+    mCollisionMs = 1000.0f * std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+bool AsteroidsSimulation::RespondToCollisions(unsigned int i, uint64_t* tests, unsigned int* contacts)
+{
+    auto center = XMLoadFloat3(&mCollisionCenters[i]);
+    auto velocity = XMLoadFloat3(&mCollisionVelocities[i]);
+    float radius = mBroadphase.Radius(i);
+    float mass = radius * radius * radius;
+
+    auto separation = XMVectorZero();
+    auto impulse = XMVectorZero();
+    bool collided = false;
+    *tests += mBroadphase.ForEachOverlap(i, [&](unsigned int j) {
+        collided = true;
+        *contacts += (j > i);
+
+        auto offset = XMVectorSubtract(XMLoadFloat3(&mCollisionCenters[j]), center);
+        float distance = XMVectorGetX(XMVector3Length(offset));
+        // Coincident centers still need opposite normals for the two sides
+        auto normal = distance > 0.0f ? XMVectorScale(offset, 1.0f / distance) : XMVectorSet(j > i ? 1.0f : -1.0f, 0.0f, 0.0f, 0.0f);
+
+        float otherRadius = mBroadphase.Radius(j);
+        float share = otherRadius * otherRadius * otherRadius / (mass + otherRadius * otherRadius * otherRadius);
+        separation = XMVectorSubtract(separation, XMVectorScale(normal, share * (radius + otherRadius - distance)));
+
+        float approach = XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat3(&mCollisionVelocities[j]), velocity), normal));
+        if (approach < 0.0f) {
+            impulse = XMVectorAdd(impulse, XMVectorScale(normal, 2.0f * share * approach));
+        }
+    });
+    if (!collided) return false;
+
+    XMFLOAT3 p, v;
+    XMStoreFloat3(&p, XMVectorAdd(center, separation));
+    XMStoreFloat3(&v, XMVectorAdd(velocity, impulse));
+    SetMotion(i, p, v);
+    if (!mGravityVelocity.empty()) {
+        mGravityPosition[i] = p;
+        mGravityVelocity[i] = v;
+    }
+    return true;
+}
+
+
+void AsteroidsSimulation::SetMotion(unsigned int i, const XMFLOAT3& p, const XMFLOAT3& v)
+{
+    float radiusSq = std::max(p.x * p.x + p.z * p.z, 1e-6f);
+    float orbitVelocity = (v.x * p.z - v.z * p.x) / radiusSq;
+    mOrbitVelocity[i] = PackHalf(std::max(orbitVelocity, MIN_ORBIT_VELOCITY));
+
+    // Same orbit angle at mTime as the new position, so closed-form motion carries on from it;
+    // like the other phases it is the angle at mPhaseEpoch
+    double angle = std::atan2(-p.z, p.x);
+    mOrbitRadius[i] = std::sqrt(radiusSq);
+    mOrbitHeight[i] = p.y;
+    mOrbitPhase[i] = (float)std::fmod(angle - (double)OrbitVelocity(i) * (mTime - mPhaseEpoch), (double)XM_2PI);
+
+    auto block = &mWorld[i / SIM_BLOCK_WIDTH];
+    auto lane = i % SIM_BLOCK_WIDTH;
+    block->m[ 9][lane] = p.x;
+    block->m[10][lane] = p.y;
+    block->m[11][lane] = p.z;
+}
+
+
+void AsteroidsSimulation::StartGravity()
+{
+    mGravityPosition.resize(mAsteroidCount);
+    mGravityVelocity.resize(mAsteroidCount);
+    for (size_t i = 0; i < mAsteroidCount; ++i) {
+        auto block = &mWorld[i / SIM_BLOCK_WIDTH];
+        auto lane = i % SIM_BLOCK_WIDTH;
+        mGravityPosition[i] = XMFLOAT3(block->m[9][lane], block->m[10][lane], block->m[11][lane]);
+    }
+
+    // The central mass that keeps the median asteroid's period on a circular orbit (w^2 r^3 = GM),
+    // and a belt mass and softening (about an asteroid's size) to go with it
+    std::vector<float> centralGM(mAsteroidCount);
+    double beltMass = 0.0, boundingRadius = 0.0;
+    for (size_t i = 0; i < mAsteroidCount; ++i) {
+        auto const& p = mGravityPosition[i];
+        float radius = std::sqrt(p.x * p.x + p.z * p.z);
+        float orbitVelocity = OrbitVelocity(i);
+        centralGM[i] = orbitVelocity * orbitVelocity * radius * radius * radius;
+        float scale = Scale(i);
+        beltMass += scale * scale * scale;
+        boundingRadius += BoundingRadius(i);
+    }
+    std::nth_element(centralGM.begin(), centralGM.begin() + mAsteroidCount / 2, centralGM.end());
+    mCentralGM = centralGM[mAsteroidCount / 2];
+    mBeltG = (float)(GRAVITY_BELT_MASS_FRACTION * mCentralGM / std::max(beltMass, 1e-6));
+    float softening = (float)(boundingRadius / std::max<size_t>(mAsteroidCount, 1));
+    mGravitySofteningSq = softening * softening;
+
+    // Circular orbits about the central mass, whose pull at height h is weaker than in the plane
+    for (unsigned int i = 0; i < mAsteroidCount; ++i) {
+        auto const& p = mGravityPosition[i];
+        float distanceSq = p.x * p.x + p.y * p.y + p.z * p.z + mGravitySofteningSq;
+        float orbitVelocity = std::sqrt(mCentralGM / (distanceSq * std::sqrt(distanceSq)));
+        mGravityVelocity[i] = XMFLOAT3(orbitVelocity * p.z, 0.0f, -orbitVelocity * p.x);
+        SetMotion(i, mGravityPosition[i], mGravityVelocity[i]);
+    }
+    mGridStale = true;
+}
+
+
+void AsteroidsSimulation::Gravitate(const Settings& settings, JobSystem& jobSystem)
+{
+    mGravityInteractions = 0;
+    mGravityBuildMs = 0.0f;
+    mGravityMs = 0.0f;
+    if (!settings.gravity) {
+        if (!mGravityPosition.empty()) {
+            mGravityTree = GravityTree();
+            std::vector<XMFLOAT3>().swap(mGravityPosition);
+            std::vector<XMFLOAT3>().swap(mGravityVelocity);
+            std::vector<float>().swap(mGravityMass);
+        }
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (mGravityPosition.size() != mAsteroidCount) {
+        StartGravity();
+    }
+    float dt = mFrameTime;
+    if (dt <= 0.0f) return;
+
+    size_t chunkCount = (mAsteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    mGravityMass.resize(mAsteroidCount);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            float scale = Scale(i);
+            mGravityMass[i] = mBeltG * scale * scale * scale;
+        }
+    }, 1);
+    mGravityTree.Build(mAsteroidCount, mGravityPosition.data(), mGravityMass.data(), jobSystem);
+    mGravityBuildMs = 1000.0f * std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Semi-implicit Euler: kick with the pull at the old positions, then drift. The tree has its
+    // own copy of the positions, so each asteroid moves as soon as it's done, and going in tree
+    // order keeps neighboring walks on the same nodes.
+    std::atomic<uint64_t> interactions{ 0 };
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        uint64_t chunkInteractions = 0;
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t k = chunk * SIM_FIELD_CHUNK; k < last; ++k) {
+            auto i = mGravityTree.BodyInOrder(k);
+            auto p = XMLoadFloat3(&mGravityPosition[i]);
+            auto a = mGravityTree.AccelerationInOrder(k, GRAVITY_OPENING_ANGLE, mGravitySofteningSq, &chunkInteractions);
+
+            // The central mass sits at the origin
+            float invDistance = 1.0f / std::sqrt(XMVectorGetX(XMVector3LengthSq(p)) + mGravitySofteningSq);
+            a = XMVectorSubtract(a, XMVectorScale(p, mCentralGM * invDistance * invDistance * invDistance));
+
+            auto v = XMVectorAdd(XMLoadFloat3(&mGravityVelocity[i]), XMVectorScale(a, dt));
+            p = XMVectorAdd(p, XMVectorScale(v, dt));
+            XMStoreFloat3(&mGravityVelocity[i], v);
+            XMStoreFloat3(&mGravityPosition[i], p);
+            SetMotion(i, mGravityPosition[i], mGravityVelocity[i]);
+        }
+        interactions += chunkInteractions;
+    }, 1);
+
+    // Every orbit changed, so the grid starts over when it's next needed
+    mGridStale = true;
+
+    mGravityInteractions = interactions;
+    mGravityMs = 1000.0f * std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+void AsteroidsSimulation::PrepareQueries(JobSystem& jobSystem)
+{
+    if (!mQueryBvhStale) return;
+
+    mQueryCenters.resize(mAsteroidCount);
+    size_t chunkCount = (mAsteroidCount + SIM_FIELD_CHUNK - 1) / SIM_FIELD_CHUNK;
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(mAsteroidCount, (chunk + 1) * SIM_FIELD_CHUNK);
+        for (size_t i = chunk * SIM_FIELD_CHUNK; i < last; ++i) {
+            auto block = &mDrawWorld[i / SIM_BLOCK_WIDTH];
+            auto lane = i % SIM_BLOCK_WIDTH;
+            mQueryCenters[i] = XMFLOAT3(block->m[9][lane], block->m[10][lane], block->m[11][lane]);
+        }
+    }, 1);
+
+    if (mQueryBvh.Count() != mAsteroidCount || mQueryBvh.Degradation() > QUERY_BVH_MAX_DEGRADATION) {
+        std::vector<float> boundingRadius(mAsteroidCount);
+        for (size_t i = 0; i < mAsteroidCount; ++i) {
+            boundingRadius[i] = BoundingRadius(i);
+        }
+        mQueryBvh.Build(mAsteroidCount, mQueryCenters.data(), boundingRadius.data(), jobSystem);
+    } else {
+        mQueryBvh.Refit(mQueryCenters.data(), jobSystem);
+    }
+    mQueryBvhStale = false;
+}
+
+
+void AsteroidsSimulation::Raycast(const AsteroidRay* rays, size_t count, AsteroidRayHit* hits, JobSystem& jobSystem)
+{
+    PrepareQueries(jobSystem);
+
+    size_t chunkCount = (count + QUERY_CHUNK - 1) / QUERY_CHUNK;
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(count, (chunk + 1) * QUERY_CHUNK);
+        for (size_t q = chunk * QUERY_CHUNK; q < last; ++q) {
+            auto const& ray = rays[q];
+            hits[q].asteroid = NO_ASTEROID;
+            hits[q].distance = ray.maxDistance;
+            mQueryBvh.Raycast(XMLoadFloat3(&ray.origin), XMLoadFloat3(&ray.direction), ray.maxDistance,
+                              &hits[q].asteroid, &hits[q].distance);
+        }
+    }, 1);
+}
+
+
+void AsteroidsSimulation::QuerySpheres(const XMFLOAT4* spheres, size_t count, AsteroidQueryResults* results,
+                                       JobSystem& jobSystem)
+{
+    PrepareQueries(jobSystem);
+
+    // Each job gathers its queries' results on its own, offsets relative to its first; they're
+    // then concatenated in query order
+    size_t chunkCount = (count + QUERY_CHUNK - 1) / QUERY_CHUNK;
+    std::vector<std::vector<unsigned int>> chunkAsteroids(chunkCount);
+    results->offsets.resize(count + 1);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        auto& asteroids = chunkAsteroids[chunk];
+        size_t last = std::min<size_t>(count, (chunk + 1) * QUERY_CHUNK);
+        for (size_t q = chunk * QUERY_CHUNK; q < last; ++q) {
+            results->offsets[q] = (unsigned int)asteroids.size();
+            mQueryBvh.Overlap(XMLoadFloat4(&spheres[q]), spheres[q].w, &asteroids);
+        }
+    }, 1);
+
+    std::vector<unsigned int> chunkStart(chunkCount);
+    unsigned int total = 0;
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        chunkStart[chunk] = total;
+        total += (unsigned int)chunkAsteroids[chunk].size();
+    }
+    results->offsets[count] = total;
+    results->asteroids.resize(total);
+    results->distances.clear();
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t last = std::min<size_t>(count, (chunk + 1) * QUERY_CHUNK);
+        for (size_t q = chunk * QUERY_CHUNK; q < last; ++q) {
+            results->offsets[q] += chunkStart[chunk];
+        }
+        std::copy(chunkAsteroids[chunk].begin(), chunkAsteroids[chunk].end(), results->asteroids.begin() + chunkStart[chunk]);
+    }, 1);
+}
+
+
+void AsteroidsSimulation::QueryNearest(const XMFLOAT3* points, size_t count, unsigned int k,
+                                       AsteroidQueryResults* results, JobSystem& jobSystem)
+{
+    PrepareQueries(jobSystem);
+
+    // Every query finds the same number, so the results go straight to their place
+    unsigned int found = (unsigned int)std::min<size_t>(k, mAsteroidCount);
+    results->offsets.resize(count + 1);
+    results->asteroids.resize(count * found);
+    results->distances.resize(count * found);
+    size_t chunkCount = (count + QUERY_CHUNK - 1) / QUERY_CHUNK;
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        std::vector<std::pair<float, unsigned int>> nearest;
+        size_t last = std::min<size_t>(count, (chunk + 1) * QUERY_CHUNK);
+        for (size_t q = chunk * QUERY_CHUNK; q < last; ++q) {
+            mQueryBvh.Nearest(XMLoadFloat3(&points[q]), found, &nearest);
+            results->offsets[q] = (unsigned int)(q * found);
+            for (unsigned int n = 0; n < found; ++n) {
+                results->distances[q * found + n] = nearest[n].first;
+                results->asteroids[q * found + n] = nearest[n].second;
+            }
+        }
+    }, 1);
+    results->offsets[count] = (unsigned int)(count * found);
+}
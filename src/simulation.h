@@ -16,45 +16,299 @@
 
 #pragma once
 
-#include <d3d11.h> // For D3D11_SUBRESOURCE_DATA
 #include <DirectXMath.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
 #include <random>
 
+#include "asteroid_packing.h"
+#include "collision.h"
+#include "cpu_features.h"
+#include "frustum.h"
+#include "gravity.h"
+#include "job_system.h"
+#include "lod_governor.h"
 #include "mesh.h"
+#include "occlusion.h"
 #include "settings.h"
+#include "spatial_grid.h"
+#include "sphere_bvh.h"
+#include "texture_data.h"
 
-// We may want to ISPC-ify this down the road and just let it own the data structure in AoSoA format or similar
-// For now we'll just do the dumb thing and see if it's fast enough
-struct AsteroidDynamic
+// Width of the AoSoA blocks used for per-asteroid transforms; matches an 8-wide float SIMD register
+enum { SIM_BLOCK_WIDTH = 8 };
+
+// Affine world transforms for SIM_BLOCK_WIDTH consecutive asteroids.
+// m[e][lane] holds element e of the 4x3 (row vector, translation in the last row) matrix,
+// so a SIMD kernel can load the same element of a whole block with a single load.
+struct AsteroidTransformBlock
 {
-    DirectX::XMMATRIX world;
-    // These depend on chosen subdiv level, hence are not constant
-    unsigned int indexStart;
-    unsigned int indexCount;
+    float m[12][SIM_BLOCK_WIDTH];
+
+    DirectX::XMMATRIX Load(size_t lane) const
+    {
+        return DirectX::XMMATRIX(
+            m[0][lane], m[ 1][lane], m[ 2][lane], 0.0f,
+            m[3][lane], m[ 4][lane], m[ 5][lane], 0.0f,
+            m[6][lane], m[ 7][lane], m[ 8][lane], 0.0f,
+            m[9][lane], m[10][lane], m[11][lane], 1.0f);
+    }
+
+    DirectX::XMVECTOR LoadPosition(size_t lane) const
+    {
+        return DirectX::XMVectorSet(m[9][lane], m[10][lane], m[11][lane], 1.0f);
+    }
+
+    void Store(size_t lane, DirectX::FXMMATRIX world)
+    {
+        DirectX::XMFLOAT4X3 w;
+        DirectX::XMStoreFloat4x3(&w, world);
+        for (size_t e = 0; e < 12; ++e) {
+            m[e][lane] = (&w._11)[e];
+        }
+    }
 };
 
-struct AsteroidStatic
+// From http://guihaire.com/code/?p=1135
+inline float VeryApproxLog2f(float x)
 {
-    DirectX::XMFLOAT3 surfaceColor;
-    DirectX::XMFLOAT3 deepColor;
-    DirectX::XMVECTOR spinAxis;
-    float scale;
-    float spinVelocity;
-    float orbitVelocity;
-    unsigned int vertexStart;
-    unsigned int textureIndex;
+    union { float f; uint32_t i; } ux;
+    ux.f = x;
+    return (float)ux.i * 1.1920928955078125e-7f - 126.94269504f;
+}
+
+// Coarse front-to-back sort key: the exponent and top 3 mantissa bits of the squared distance
+// to the eye, so 16 keys per doubling of distance. Key 0 is everything within 1 unit, key 255
+// everything past 2^16.
+enum { DEPTH_KEY_COUNT = 256 };
+enum { DEPTH_KEY_BIAS = 127 << 3 };
+inline unsigned char DepthKey(float distanceSq)
+{
+    union { float f; uint32_t i; } ux;
+    ux.f = distanceSq;
+    int key = (int)(ux.i >> 20) - DEPTH_KEY_BIAS;
+    return (unsigned char)(key < 0 ? 0 : (key > 255 ? 255 : key));
+}
+
+// Asteroids to draw this frame
+struct AsteroidDrawList
+{
+    std::vector<unsigned int> indices;
+    unsigned int culledCount = 0;
+
+    // Only filled when bucketed: bucket b (see AsteroidsSimulation::DrawBucket) is
+    // indices[bucketOffsets[b], bucketOffsets[b+1])
+    std::vector<unsigned int> bucketOffsets;
+
+    void clear()
+    {
+        indices.clear();
+        culledCount = 0;
+        bucketOffsets.clear();
+    }
+};
+
+// Per-frame counters from the last Cull
+struct SimulationStats
+{
+    unsigned int visible = 0;
+    unsigned int culled = 0;
+    GridCullStats grid;
+    unsigned int occluders = 0;     // Asteroids rasterized into the occlusion buffer
+    unsigned int occluded = 0;      // Asteroids inside the frustum but hidden (included in culled)
+    float occlusionMs = 0.0f;       // Occluder selection, rasterization and occludee tests
+    unsigned int drawsPerSubdiv[MESH_MAX_SUBDIV_LEVELS + 1] = {};
+    unsigned int triangles = 0;     // Asteroid triangles in the draw list
+    LodGovernorState lodGovernor;   // As of the frame's BeginFrame
+    unsigned int simulationSteps = 0; // Fixed steps taken this frame (fixed-step mode only)
+
+    // With settings.amortizeFarUpdates, summed over the frame's steps: asteroids per subdiv band
+    // (as of their last full update) and how many of them got a full update
+    unsigned int asteroidsPerSubdiv[MESH_MAX_SUBDIV_LEVELS + 1] = {};
+    unsigned int updatesPerSubdiv[MESH_MAX_SUBDIV_LEVELS + 1] = {};
+
+    // With settings.collisions, from the frame's Collide
+    uint64_t collisionTests = 0;    // Sphere pairs tested, each pair once from either side
+    unsigned int collisionContacts = 0; // Overlapping pairs
+    float collisionMs = 0.0f;       // Broadphase build and responses
+
+    // With settings.gravity, from the frame's Gravitate
+    uint64_t gravityInteractions = 0; // Bodies and tree nodes summed over all asteroids
+    float gravityBuildMs = 0.0f;    // Octree build
+    float gravityMs = 0.0f;         // Build, traversals and integration
+};
+
+// Spatial queries (see AsteroidsSimulation::Raycast and friends). Asteroids are reported as slots.
+enum : unsigned int { NO_ASTEROID = 0xFFFFFFFF };
+
+struct AsteroidRay
+{
+    DirectX::XMFLOAT3 origin;
+    DirectX::XMFLOAT3 direction; // Normalized
+    float maxDistance;
+};
+
+struct AsteroidRayHit
+{
+    unsigned int asteroid;       // NO_ASTEROID on a miss
+    float distance;              // Along the ray to the bounding sphere; 0 if the ray starts inside
+};
+
+// Results of a batch of queries: query q found asteroids[offsets[q], offsets[q + 1]), and for
+// nearest-neighbor queries their surface distances in the same positions of distances
+struct AsteroidQueryResults
+{
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> asteroids;
+    std::vector<float> distances;
+};
+
+// Everything the renderers read from a simulated frame that changes per frame, so that it stays
+// valid while the simulation moves on to the next one (see SimulationThread)
+struct SimulationFrame
+{
+    AsteroidDrawList drawList;
+    std::vector<DirectX::XMFLOAT4X3> world; // Parallel to drawList.indices
+    std::vector<unsigned char> subdiv;      // Parallel to drawList.indices
+    SimulationStats stats;
 };
 
 class AsteroidsSimulation
 {
 private:
-    // NOTE: Memory could be optimized further for efficient cache traversal, etc.
-    std::vector<AsteroidStatic> mAsteroidStatic;
-    std::vector<AsteroidDynamic> mAsteroidDynamic;
+    // Asteroid state is stored as a structure of arrays so that each pass over the field only
+    // pulls the streams it reads into cache. See UpdateBytesPerAsteroid() for the Update footprint.
+    //
+    // The simulation streams are indexed by slot, which Resort reassigns so that neighbors in
+    // space are neighbors in memory. The draw data stays indexed by asteroid id (creation order),
+    // which is what captured draw lists hold, so the renderers never see the reordering.
+    std::vector<unsigned int> mSlotToId;
+
+    // Static, read by every Update. Packed (see asteroid_packing.h); use the accessors below.
+    std::vector<uint16_t> mScale;         // fp16
+    std::vector<uint16_t> mSpinVelocity;  // fp16
+    std::vector<uint16_t> mOrbitVelocity; // fp16
+    std::vector<uint32_t> mSpinAxis;      // Octahedral, 2x snorm16
+
+    // Static, closed-form motion parameters (see Settings::closedFormMotion)
+    std::vector<float> mOrbitRadius;
+    std::vector<float> mOrbitHeight;
+    std::vector<float> mOrbitPhase;       // Angles at mPhaseEpoch
+    std::vector<float> mSpinPhase;
 
-    Mesh mMeshes;
+    // Static, only read when recording draws; by asteroid id
+    std::vector<uint8_t> mColorScheme;    // Surface and deep colors are one of a few fixed pairs
+    std::vector<uint16_t> mMeshInstance;  // Vertex start is mMeshInstance * mVertexCountPerMesh
+    std::vector<uint8_t> mTextureIndex;
+    const float* mColorSchemes;           // Linear surface then deep color, per scheme
+
+    // Dynamic. With closed-form motion the transforms are a pure function of mTime and the
+    // static parameters, so mWorld is only an output cache for the renderers, not state.
+    std::vector<AsteroidTransformBlock> mWorld; // AoSoA, SIM_BLOCK_WIDTH asteroids per entry
+    std::vector<unsigned char> mSubdiv;         // Depends on distance to the camera, hence not constant
+    std::vector<unsigned char> mDepthKey;       // Set alongside mSubdiv with settings.frontToBackDraws, else empty
+
+    size_t mAsteroidCount;
+    unsigned int mRngSeed;          // Asteroid i's initial state is drawn from stream (mRngSeed, i)
+    unsigned int mMeshInstanceCount;
+    SimdLevel mSimdLevel; // Best level the CPU supports
+
+    double mTime = 0.0;       // Absolute simulation time
+    double mPhaseEpoch = 0.0; // Time the orbit and spin phases are angles at; see RebasePhases
+    float mFrameTime = 0.0f;  // Step taken by the last BeginFrame
+
+    // Fixed-step mode (settings.simulationHz > 0): mWorld advances in whole steps and the renderers
+    // see mRenderWorld, blended between the last two steps. Otherwise they see mWorld directly.
+    double mFixedStep = 0.0;
+    double mStepAccumulator = 0.0;
+    unsigned int mStepsThisFrame = 0;
+    float mInterpolation = 1.0f;
+    std::vector<AsteroidTransformBlock> mPrevWorld;
+    std::vector<AsteroidTransformBlock> mRenderWorld;
+    const AsteroidTransformBlock* mDrawWorld = nullptr;
+
+    // Far update amortization (settings.amortizeFarUpdates): in each step, only one in
+    // mAmortizeInterval transform blocks fully updates its far asteroids, round robin. The others
+    // just carry their far asteroids along the orbit with a cheap small-angle rotation and bank
+    // the spin time in mSpinPending until their turn.
+    unsigned int mAmortizeInterval = 1;
+    unsigned int mAmortizeMaxSubdiv = 0;
+    unsigned int mUpdatePass = 0;         // Steps taken before this frame's
+    unsigned int mUpdatePasses = 0;       // Steps taken this frame
+    std::vector<float> mSpinPending;      // Empty unless amortizing
+    std::atomic<unsigned int> mUpdateCounts[2][MESH_MAX_SUBDIV_LEVELS + 1] = {}; // See SimulationStats
+
+    // Background re-sort (settings.resortFrames): Morton keys of the positions, paired with their
+    // slots, are sorted by a job and applied at the first BeginFrame after it finishes
+    std::vector<uint64_t> mResortKeys;
+    std::vector<uint64_t> mResortScratch;
+    JobSystem::Job* mResortJob = nullptr;
+    std::atomic<bool> mResortReady{ false };
+    unsigned int mFramesSinceResort = 0;
+
+    // Collisions (settings.collisions). The broadphase holds the bounding radii by slot, so a
+    // re-sort empties it and the next Collide starts over.
+    CollisionBroadphase mBroadphase;
+    std::vector<DirectX::XMFLOAT3> mCollisionCenters;
+    std::vector<DirectX::XMFLOAT3> mCollisionVelocities;
+    std::vector<unsigned char> mCollided;
+    uint64_t mCollisionTests = 0;
+    unsigned int mCollisionContacts = 0;
+    float mCollisionMs = 0.0f;
+
+    // N-body gravity (settings.gravity): positions and velocities by slot, integrated under a
+    // central mass plus the belt's own attraction through a Barnes-Hut tree. Empty while off.
+    GravityTree mGravityTree;
+    std::vector<DirectX::XMFLOAT3> mGravityPosition;
+    std::vector<DirectX::XMFLOAT3> mGravityVelocity;
+    std::vector<float> mGravityMass;    // Scratch; scale cubed times the belt's G
+    float mCentralGM = 0.0f;
+    float mBeltG = 0.0f;
+    float mGravitySofteningSq = 0.0f;
+    uint64_t mGravityInteractions = 0;
+    float mGravityBuildMs = 0.0f;
+    float mGravityMs = 0.0f;
+
+    LodGovernor mLodGovernor;
+    float mMinSubdivSizeLog2 = 0.0f;
+
+    // With settings.lodThresholdTable: asteroid i gets subdiv level k or finer when its squared
+    // distance is at most Scale(i)^2 * mLodDistanceSqThresholds[k-1]
+    bool mLodThresholdTable = false;
+    float mLodDistanceSqThresholds[MESH_MAX_SUBDIV_LEVELS] = {};
+
+    // View for the current frame, set by BeginFrame
+    DirectX::XMVECTOR mCameraEye;
+    DirectX::XMMATRIX mViewProjection;
+    Frustum mFrustum;
+    float mMeshBoundingRadius = 0.0f; // Over all mesh instances, before asteroid scale
+
+    // Spatial queries run on a BVH over the bounding spheres as drawn. BeginFrame marks it stale
+    // and the next query refits it, or rebuilds it if it has degraded or the slots changed.
+    SphereBvh mQueryBvh;
+    std::vector<DirectX::XMFLOAT3> mQueryCenters;
+    bool mQueryBvhStale = true;
+
+    AsteroidGrid mGrid;
+    bool mGridStale = false; // Orbits changed by gravity, or by collisions while grid culling was off
+    std::vector<unsigned int> mCullCandidates;
+
+    // Occluders are the mesh's icosahedron LOD with its vertices pulled in to a radius that is
+    // inside the finest LOD, so they never cover anything the real asteroid doesn't
+    OcclusionBuffer mOcclusion;
+    std::vector<DirectX::XMFLOAT3> mOccluderVertices; // Per mesh instance
+    std::vector<unsigned short> mOccluderIndices;
+    unsigned int mOccluderVertexCount = 0;
+    std::vector<float> mOccluderRadius;               // Per mesh instance, before asteroid scale
+    std::vector<std::pair<float, unsigned int>> mOccluderCandidates;
+    std::vector<unsigned char> mOccluded;
+
+    std::vector<unsigned int> mBucketCounts; // Per chunk of the draw list, per sort key
+    std::vector<unsigned int> mBucketScratch;
+    SimulationStats mLastFrameStats;
+
+    RadialMesh mMeshes;
     std::vector<unsigned int> mIndexOffsets;
     unsigned int mSubdivCount;
     unsigned int mVertexCountPerMesh;
@@ -63,8 +317,8 @@ private:
     unsigned int mTextureCount;
     unsigned int mTextureArraySize;
     unsigned int mTextureMipLevels;
-    std::vector<BYTE> mTextureDataBuffer;
-    std::vector<D3D11_SUBRESOURCE_DATA> mTextureSubresources;
+    std::vector<uint8_t> mTextureDataBuffer;
+    std::vector<TextureSubresource> mTextureSubresources;
 
     unsigned int SubresourceIndex(unsigned int texture, unsigned int arrayElement = 0, unsigned int mip = 0)
     {
@@ -72,23 +326,175 @@ private:
     }
 
     void CreateTextures(unsigned int textureCount, unsigned int rngSeed);
+    void InitAsteroid(size_t i); // O(1) and independent of every other asteroid
+
+    // Amortization applies when interval > 1; pass numbers the step for the round robin
+    void UpdateTransforms(const Settings& settings, double time, float frameTime,
+                          unsigned int pass, unsigned int interval, size_t first, size_t last);
+    void UpdateScalar(bool animate, bool closedForm, double time, float frameTime,
+                      unsigned int pass, unsigned int interval, size_t first, size_t last,
+                      unsigned int counts[2][MESH_MAX_SUBDIV_LEVELS + 1]);
+    unsigned char PickSubdiv(size_t i, DirectX::FXMVECTOR position) const;
+    unsigned char PickDepthKey(DirectX::FXMVECTOR position) const;
+    void InterpolateTransforms(size_t first, size_t last);
+    void SetFixedStep(double fixedStep);
+    // Relative to mPhaseEpoch, like the phases the grid bins with
+    double GridTime() const { return mTime - (1.0 - mInterpolation) * mFixedStep - mPhaseEpoch; }
+    void RebasePhases(double epoch);
+    void BuildGrid();
+    void CullFlat(size_t first, size_t last, AsteroidDrawList* drawList);
+    void CreateOccluders(unsigned int meshInstanceCount, const std::vector<float>& directionLength);
+    void CullOccluded(AsteroidDrawList* drawList);
+    // Stable counting sort of the draw list by key(i) in [0, bucketCount); optionally returns the
+    // bucket ranges, as for AsteroidDrawList::bucketOffsets
+    template <typename KeyFn>
+    void SortDrawList(AsteroidDrawList* drawList, unsigned int bucketCount, KeyFn key, std::vector<unsigned int>* bucketOffsets);
+    void ComputeResortKeys();
+    void ApplyResort();
+    bool RespondToCollisions(unsigned int i, uint64_t* tests, unsigned int* contacts);
+    // Moves asteroid i to position p with velocity v: the world translation and the orbit that
+    // passes through p at mTime, at the angular speed of v about Y
+    void SetMotion(unsigned int i, const DirectX::XMFLOAT3& p, const DirectX::XMFLOAT3& v);
+    void StartGravity();
     
 public:
     AsteroidsSimulation(unsigned int rngSeed, unsigned int asteroidCount,
                         unsigned int meshInstanceCount, unsigned int subdivCount,
                         unsigned int textureCount);
+    ~AsteroidsSimulation();
 
-    const Mesh* Meshes() { return &mMeshes; }
-    const D3D11_SUBRESOURCE_DATA* TextureData(unsigned int textureIndex)
+    const RadialMesh* Meshes() { return &mMeshes; }
+    size_t MeshPoolBytes() const
+    {
+        return mMeshes.directions.size() * sizeof(mMeshes.directions[0]) +
+               mMeshes.radiusScale.size() * sizeof(mMeshes.radiusScale[0]) +
+               mMeshes.vertices.size() * sizeof(mMeshes.vertices[0]) +
+               mMeshes.indices.size() * sizeof(mMeshes.indices[0]);
+    }
+    // Array slices times mip levels, in D3D subresource order
+    const TextureSubresource* TextureData(unsigned int textureIndex)
     {
         return mTextureSubresources.data() + SubresourceIndex(textureIndex);
     }
+    unsigned int TextureSubresourceCount() const { return mTextureArraySize * mTextureMipLevels; }
+
+    size_t AsteroidCount() const { return mAsteroidCount; }
+    unsigned int SubdivCount() const { return mSubdivCount; }
+    const unsigned int* IndexOffsets() const { return mIndexOffsets.data(); }
 
-    const AsteroidStatic* StaticData() const { return mAsteroidStatic.data(); }
-    const AsteroidDynamic* DynamicData() const { return mAsteroidDynamic.data(); }
+    // Per-asteroid accessors for the render paths
+    DirectX::XMMATRIX World(size_t i) const { return mDrawWorld[i / SIM_BLOCK_WIDTH].Load(i % SIM_BLOCK_WIDTH); }
+    unsigned int Subdiv(size_t i) const { return mSubdiv[i]; }
+    unsigned int IndexStart(size_t i) const { return SubdivIndexStart(mSubdiv[i]); }
+    unsigned int IndexCount(size_t i) const { return SubdivIndexCount(mSubdiv[i]); }
+    unsigned int SubdivIndexStart(unsigned int subdiv) const { return mIndexOffsets[subdiv]; }
+    unsigned int SubdivIndexCount(unsigned int subdiv) const { return mIndexOffsets[subdiv + 1] - mIndexOffsets[subdiv]; }
+    // Per-asteroid accessors take slots, except the draw data ones, which take ids
+    unsigned int AsteroidId(size_t i) const { return mSlotToId[i]; }
+    unsigned int VertexStart(size_t id) const { return mMeshInstance[id] * mVertexCountPerMesh; }
+    unsigned int VertexCountPerMesh() const { return mVertexCountPerMesh; }
+    float RadiusScale(size_t id) const { return mMeshes.radiusScale[mMeshInstance[id]]; }
+    unsigned int TextureIndex(size_t id) const { return mTextureIndex[id]; }
+
+    // Draw list buckets group asteroids by subdiv level, finest (nearest) first, then texture
+    unsigned int DrawBucketCount() const { return (mSubdivCount + 1) * mTextureCount; }
+    unsigned int DrawBucket(size_t i) const { return (mSubdivCount - mSubdiv[i]) * mTextureCount + mTextureIndex[mSlotToId[i]]; }
+
+    // Decoded static parameters
+    DirectX::XMFLOAT3 SurfaceColor(size_t id) const { auto c = mColorSchemes + 6 * mColorScheme[id]; return DirectX::XMFLOAT3(c[0], c[1], c[2]); }
+    DirectX::XMFLOAT3 DeepColor(size_t id) const { auto c = mColorSchemes + 6 * mColorScheme[id]; return DirectX::XMFLOAT3(c[3], c[4], c[5]); }
+    float Scale(size_t i) const { return UnpackHalf(mScale[i]); }
+    float SpinVelocity(size_t i) const { return UnpackHalf(mSpinVelocity[i]); }
+    float OrbitVelocity(size_t i) const { return UnpackHalf(mOrbitVelocity[i]); }
+    DirectX::XMVECTOR SpinAxis(size_t i) const { return UnpackOctahedral(mSpinAxis[i]); }
+
+    // Bytes of static per-asteroid state, all streams
+    static size_t StaticBytesPerAsteroid();
+
+    // Transform at an arbitrary time under the closed-form motion model
+    DirectX::XMMATRIX WorldAtTime(size_t i, double time) const;
+
+    SimdLevel SupportedSimdLevel() const { return mSimdLevel; }
+
+    // Bytes of asteroid state read or written per asteroid by Update
+    static size_t UpdateBytesPerAsteroid(const Settings& settings);
+
+    double Time() const { return mTime; }
+
+    // Transform at Time(); differs from World in fixed-step mode, which renders between steps
+    DirectX::XMMATRIX SimulatedWorld(size_t i) const { return mWorld[i / SIM_BLOCK_WIDTH].Load(i % SIM_BLOCK_WIDTH); }
+
+    // Jumps to an absolute simulation time. Transforms are reset to their closed-form values so
+    // integrated motion continues from there too, and gravity restarts from circular orbits.
+    void Seek(double time);
+
+    // Bounding sphere radius of asteroid i, centered on its position
+    float BoundingRadius(size_t i) const { return Scale(i) * mMeshBoundingRadius; }
+
+    // Advances simulation time and captures the view used for LOD and culling; call once per
+    // frame before any of that frame's Update calls. With settings.simulationHz the frame time
+    // is accumulated and consumed in whole steps, so results depend only on the step count.
+    void BeginFrame(float frameTime, DirectX::FXMVECTOR cameraEye, DirectX::CXMMATRIX viewProjection,
+                    const Settings& settings);
+
+    // Counters from the most recent Cull
+    SimulationStats LastFrameStats() const { return mLastFrameStats; }
 
     // Can optionall provide a range of asteroids to update; count = 0 => to the end
     // This is useful for multithreading
-    void Update(float frameTime, DirectX::XMVECTOR cameraEye, const Settings& settings,
-                size_t startIndex = 0, size_t count = 0);
+    // Whole transform blocks inside the range use the widest kernel allowed by settings.simdLevel
+    void Update(const Settings& settings, size_t startIndex = 0, size_t count = 0);
+
+    // Fills drawList with the asteroids to draw this frame: all of them, or only those intersecting
+    // the view frustum if settings.cullAsteroids. Call once all of the frame's Updates are done.
+    // settings.gridCulling rejects/accepts whole cells of the spatial grid before testing
+    // individual asteroids; otherwise every asteroid is tested. settings.occlusionCulling then
+    // also drops asteroids hidden behind the nearest large ones. settings.bucketDrawList sorts
+    // the result by DrawBucket so draws sharing an index range and texture are consecutive.
+    // settings.frontToBackDraws sorts by the depth keys from Update first, so the list (or each
+    // bucket of it) runs near to far and the GPU's depth test rejects more of the far pixels.
+    void Cull(const Settings& settings, AsteroidDrawList* drawList);
+
+    // Copies the transforms and subdiv levels of frame->drawList's asteroids, and the stats of the
+    // last Cull, into frame, and replaces the draw list's slots with asteroid ids
+    void CaptureFrame(SimulationFrame* frame) const;
+
+    // Reorders the slots along a Morton curve through the asteroids' current positions, so that
+    // culling, Update and the draw list walk memory coherently. Runs synchronously; see
+    // settings.resortFrames for the periodic background version.
+    void Resort();
+
+    // With settings.collisions, finds the asteroids whose bounding spheres overlap and bounces them
+    // apart: each pair is separated in proportion to mass (scale cubed) and swaps its approaching
+    // velocity along the contact normal, as an elastic collision would. Asteroids only move along
+    // circular orbits, so the result is folded back into a new orbit radius, height and speed and
+    // any radial or vertical velocity is dropped. Call after the frame's Updates and before Cull.
+    void Collide(const Settings& settings, JobSystem& jobSystem = JobSystem::Default());
+
+    // With settings.gravity, moves the asteroids under the gravity of a central mass and of each
+    // other, approximated by a Barnes-Hut octree rebuilt every frame, over the time the frame's
+    // BeginFrame advanced. Turning it on starts every asteroid on a circular orbit about the
+    // central mass, which is sized to keep the belt's typical orbital period. Orbits then need
+    // not be circular; the orbit parameters follow each asteroid's position and angular speed
+    // so Update, culling and collisions carry on from it. Call after the frame's Updates and
+    // before Collide.
+    void Gravitate(const Settings& settings, JobSystem& jobSystem = JobSystem::Default());
+
+    // Spatial queries against the asteroids' bounding spheres as drawn (see World), each batch
+    // answered in parallel. Call them between frames, not during Update or Cull. The slots
+    // returned stay valid until the next re-sort.
+    //
+    // The nearest sphere hit by each ray
+    void Raycast(const AsteroidRay* rays, size_t count, AsteroidRayHit* hits,
+                 JobSystem& jobSystem = JobSystem::Default());
+    // The asteroids overlapping each sphere (center and radius), in no particular order
+    void QuerySpheres(const DirectX::XMFLOAT4* spheres, size_t count, AsteroidQueryResults* results,
+                      JobSystem& jobSystem = JobSystem::Default());
+    // The k asteroids (or all, if fewer) whose surfaces are nearest each point, nearest first
+    void QueryNearest(const DirectX::XMFLOAT3* points, size_t count, unsigned int k, AsteroidQueryResults* results,
+                      JobSystem& jobSystem = JobSystem::Default());
+
+    // Brings the query BVH up to date with the frame. The queries do this themselves; calling it
+    // first just separates its cost from theirs.
+    void PrepareQueries(JobSystem& jobSystem = JobSystem::Default());
 };
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "simulation_simd_kernel.h"
+
+#include <immintrin.h>
+
+using namespace DirectX;
+
+namespace {
+
+// Thin wrappers so SimUpdateKernel can be written once for 4 and 8 lanes
+struct SSE41
+{
+    enum { WIDTH = 4 };
+    typedef __m128 F;
+    typedef __m128i I;
+
+    static F Set1(float v)                { return _mm_set1_ps(v); }
+    static F Load(const float* p)         { return _mm_loadu_ps(p); }
+    static void Store(float* p, F v)      { _mm_storeu_ps(p, v); }
+    static F Add(F a, F b)                { return _mm_add_ps(a, b); }
+    static F Sub(F a, F b)                { return _mm_sub_ps(a, b); }
+    static F Mul(F a, F b)                { return _mm_mul_ps(a, b); }
+    static F MulAdd(F a, F b, F c)        { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F Max(F a, F b)                { return _mm_max_ps(a, b); }
+    static F Div(F a, F b)                { return _mm_div_ps(a, b); }
+    static F Sqrt(F v)                    { return _mm_sqrt_ps(v); }
+    static F Abs(F v)                     { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+    static F CopySign(F magnitude, F sign) { return _mm_or_ps(magnitude, _mm_and_ps(_mm_set1_ps(-0.0f), sign)); }
+    static F RsqrtEst(F v)                { return _mm_rsqrt_ps(v); }
+    static F BitsToFloat(F v)             { return _mm_cvtepi32_ps(_mm_castps_si128(v)); }
+    static I Truncate(F v)                { return _mm_cvttps_epi32(v); }
+    static I Min(I a, I b)                { return _mm_min_epi32(a, b); }
+    static I Set1i(int v)                 { return _mm_set1_epi32(v); }
+    static I CountLessEqual(I n, F a, F b) { return _mm_sub_epi32(n, _mm_castps_si128(_mm_cmple_ps(a, b))); }
+    static void SinCos(F* s, F* c, F v)   { XMVectorSinCos(s, c, v); }
+
+    static I LoadShorts(const uint16_t* p) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+    static I LoadInts(const uint32_t* p)   { return _mm_loadu_si128((const __m128i*)p); }
+    static I And(I a, int mask)            { return _mm_and_si128(a, _mm_set1_epi32(mask)); }
+    static I ShiftLeft(I v, int n)         { return _mm_slli_epi32(v, n); }
+    static I ShiftRightArith(I v, int n)   { return _mm_srai_epi32(v, n); }
+    static F IntToFloat(I v)               { return _mm_cvtepi32_ps(v); }
+    static F AsFloat(I v)                  { return _mm_castsi128_ps(v); }
+    static I AsInt(F v)                    { return _mm_castps_si128(v); }
+    static I Subi(I a, I b)                { return _mm_sub_epi32(a, b); }
+
+    static void StoreBytes(unsigned char* p, I v)
+    {
+        v = _mm_packus_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        *(int*)p = _mm_cvtsi128_si32(v);
+    }
+};
+
+} // namespace
+
+
+void SimUpdateKernelSSE41(const SimUpdateKernelArgs& args)
+{
+    SimUpdateKernel<SSE41>(args);
+}
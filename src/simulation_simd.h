@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct AsteroidTransformBlock;
+
+// Inputs/outputs for the batched Update kernels. Kernels process whole transform blocks
+// [firstBlock, lastBlock); the stream pointers are indexed by asteroid, not by block.
+struct SimUpdateKernelArgs
+{
+    AsteroidTransformBlock* world;
+    unsigned char* subdiv;
+    unsigned char* depthKey;       // See DepthKey; null = not wanted
+    const uint16_t* scale;         // fp16
+    const uint16_t* spinVelocity;  // fp16
+    const uint16_t* orbitVelocity; // fp16
+    const uint32_t* spinAxis;      // Octahedral
+    const float* orbitRadius;
+    const float* orbitHeight;
+    const float* orbitPhase;
+    const float* spinPhase;
+
+    size_t firstBlock;
+    size_t lastBlock;
+
+    float frameTime;
+    float time;                    // Since AsteroidsSimulation::mPhaseEpoch
+    DirectX::XMFLOAT3 cameraEye;
+    float minSubdivSizeLog2;
+    const float* lodDistanceSqThresholds; // See AsteroidsSimulation::PickSubdiv; null = use minSubdivSizeLog2
+    unsigned int subdivCount;
+    bool animate;
+    bool closedForm;
+
+    // Far update amortization; see AsteroidsSimulation::UpdateTransforms. A group of lanes is only
+    // carried along cheaply if all of its lanes are far, otherwise all of them get a full update.
+    float* spinPending;              // Null unless amortizing
+    unsigned int amortizePass;
+    unsigned int amortizeInterval;   // 1 = every asteroid gets a full update
+    unsigned int amortizeMaxSubdiv;
+    unsigned int* asteroidCounts;    // Per subdiv, as of the last full update; null = don't count
+    unsigned int* updateCounts;      // Per subdiv, full updates
+};
+
+// Both produce the same transforms as the scalar path up to float rounding (the sin/cos
+// polynomials and summation order differ slightly). LOD picks match the scalar path except
+// for asteroids whose approximate log2 screen size (or exact distance, with the threshold
+// table) lands within rounding of a subdiv boundary.
+void SimUpdateKernelSSE41(const SimUpdateKernelArgs& args);
+void SimUpdateKernelAVX2(const SimUpdateKernelArgs& args);
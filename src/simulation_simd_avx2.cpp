@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+// Built with /arch:AVX2 (-mavx2 elsewhere) so the 128-bit instructions in here are VEX encoded
+// too and never pay for AVX/SSE transitions. Nothing here may call DirectXMath or other inline
+// code with external linkage either: the linker could keep this unit's AVX2 copy of it for
+// callers on CPUs without AVX2.
+
+#include "simulation_simd_kernel.h"
+
+#include <immintrin.h>
+
+using namespace DirectX;
+
+namespace {
+
+struct AVX2
+{
+    enum { WIDTH = 8 };
+    typedef __m256 F;
+    typedef __m256i I;
+
+    static F Set1(float v)                { return _mm256_set1_ps(v); }
+    static F Load(const float* p)         { return _mm256_loadu_ps(p); }
+    static void Store(float* p, F v)      { _mm256_storeu_ps(p, v); }
+    static F Add(F a, F b)                { return _mm256_add_ps(a, b); }
+    static F Sub(F a, F b)                { return _mm256_sub_ps(a, b); }
+    static F Mul(F a, F b)                { return _mm256_mul_ps(a, b); }
+    static F MulAdd(F a, F b, F c)        { return _mm256_add_ps(_mm256_mul_ps(a, b), c); } // Unfused, as in the scalar path
+    static F Max(F a, F b)                { return _mm256_max_ps(a, b); }
+    static F Div(F a, F b)                { return _mm256_div_ps(a, b); }
+    static F Sqrt(F v)                    { return _mm256_sqrt_ps(v); }
+    static F Abs(F v)                     { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+    static F CopySign(F magnitude, F sign) { return _mm256_or_ps(magnitude, _mm256_and_ps(_mm256_set1_ps(-0.0f), sign)); }
+    static F RsqrtEst(F v)                { return _mm256_rsqrt_ps(v); }
+    static F BitsToFloat(F v)             { return _mm256_cvtepi32_ps(_mm256_castps_si256(v)); }
+    static I Truncate(F v)                { return _mm256_cvttps_epi32(v); }
+    static I Min(I a, I b)                { return _mm256_min_epi32(a, b); }
+    static I Set1i(int v)                 { return _mm256_set1_epi32(v); }
+    static I CountLessEqual(I n, F a, F b) { return _mm256_sub_epi32(n, _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ))); }
+
+    static void SinCos(F* s, F* c, F v)
+    {
+        // XMVectorSinCos widened to 8 lanes: reduce to [-pi, pi], reflect into [-pi/2, pi/2],
+        // then the same polynomials
+        F x = Sub(v, Mul(_mm256_round_ps(Mul(v, Set1(XM_1DIV2PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), Set1(XM_2PI)));
+        F sign = _mm256_and_ps(x, Set1(-0.0f));
+        F reflected = Sub(_mm256_or_ps(Set1(XM_PI), sign), x);
+        F inRange = _mm256_cmp_ps(Abs(x), Set1(XM_PIDIV2), _CMP_LE_OQ);
+        x = _mm256_blendv_ps(reflected, x, inRange);
+        F cosSign = _mm256_blendv_ps(Set1(-1.0f), Set1(1.0f), inRange);
+        F x2 = Mul(x, x);
+
+        F r = MulAdd(Set1(-2.3889859e-08f), x2, Set1(2.7525562e-06f));
+        r = MulAdd(r, x2, Set1(-0.00019840874f));
+        r = MulAdd(r, x2, Set1(0.0083333310f));
+        r = MulAdd(r, x2, Set1(-0.16666667f));
+        *s = Mul(MulAdd(r, x2, Set1(1.0f)), x);
+
+        r = MulAdd(Set1(-2.6051615e-07f), x2, Set1(2.4760495e-05f));
+        r = MulAdd(r, x2, Set1(-0.0013888378f));
+        r = MulAdd(r, x2, Set1(0.041666638f));
+        r = MulAdd(r, x2, Set1(-0.5f));
+        *c = Mul(MulAdd(r, x2, Set1(1.0f)), cosSign);
+    }
+
+    static I LoadShorts(const uint16_t* p) { return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+    static I LoadInts(const uint32_t* p)   { return _mm256_loadu_si256((const __m256i*)p); }
+    static I And(I a, int mask)            { return _mm256_and_si256(a, _mm256_set1_epi32(mask)); }
+    static I ShiftLeft(I v, int n)         { return _mm256_slli_epi32(v, n); }
+    static I ShiftRightArith(I v, int n)   { return _mm256_srai_epi32(v, n); }
+    static F IntToFloat(I v)               { return _mm256_cvtepi32_ps(v); }
+    static F AsFloat(I v)                  { return _mm256_castsi256_ps(v); }
+    static I AsInt(F v)                    { return _mm256_castps_si256(v); }
+    static I Subi(I a, I b)                { return _mm256_sub_epi32(a, b); }
+
+    static void StoreBytes(unsigned char* p, I v)
+    {
+        auto lo = _mm256_castsi256_si128(v);
+        auto hi = _mm256_extracti128_si256(v, 1);
+        auto v16 = _mm_packus_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(v16, v16));
+    }
+};
+
+} // namespace
+
+
+void SimUpdateKernelAVX2(const SimUpdateKernelArgs& args)
+{
+    SimUpdateKernel<AVX2>(args);
+}
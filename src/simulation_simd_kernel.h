@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+// The Update kernel, written once against a lane wrapper V (see SSE41 in simulation_simd.cpp).
+// Each instruction set instantiates it in its own translation unit, built with matching code
+// generation flags; everything here has internal linkage so those copies are never merged.
+
+#include "simulation_simd.h"
+#include "simulation.h"
+
+namespace {
+
+// Decoders for the packed static streams, matching UnpackHalf and UnpackOctahedral bit for bit
+template <typename V>
+typename V::F LoadHalf(const uint16_t* p)
+{
+    auto h = V::LoadShorts(p);
+    auto magnitude = V::Mul(V::AsFloat(V::ShiftLeft(V::And(h, 0x7FFF), 13)), V::Set1(5.192296858534828e33f));
+    return V::CopySign(magnitude, V::AsFloat(V::ShiftLeft(h, 16)));
+}
+
+template <typename V>
+void LoadOctahedral(const uint32_t* p, typename V::F* x, typename V::F* y, typename V::F* z)
+{
+    typedef typename V::F F;
+    auto packed = V::LoadInts(p);
+    F u = V::Mul(V::IntToFloat(V::ShiftRightArith(V::ShiftLeft(packed, 16), 16)), V::Set1(1.0f / 32767.0f));
+    F v = V::Mul(V::IntToFloat(V::ShiftRightArith(packed, 16)), V::Set1(1.0f / 32767.0f));
+    F w = V::Sub(V::Sub(V::Set1(1.0f), V::Abs(u)), V::Abs(v));
+    F t = V::Max(V::Sub(V::Set1(0.0f), w), V::Set1(0.0f));
+    u = V::Sub(u, V::CopySign(t, u));
+    v = V::Sub(v, V::CopySign(t, v));
+    F length = V::Sqrt(V::MulAdd(w, w, V::MulAdd(v, v, V::Mul(u, u))));
+    *x = V::Div(u, length);
+    *y = V::Div(v, length);
+    *z = V::Div(w, length);
+}
+
+// Rotation by the given angle about a unit axis, laid out as XMMatrixRotationNormal
+template <typename V>
+void SpinRotation(typename V::F spin[3][3], typename V::F x, typename V::F y, typename V::F z,
+                  typename V::F sinAngle, typename V::F cosAngle)
+{
+    typedef typename V::F F;
+    F t = V::Sub(V::Set1(1.0f), cosAngle);
+    F tx = V::Mul(t, x), ty = V::Mul(t, y), tz = V::Mul(t, z);
+    F sx = V::Mul(sinAngle, x), sy = V::Mul(sinAngle, y), sz = V::Mul(sinAngle, z);
+    F txy = V::Mul(tx, y), tyz = V::Mul(ty, z), tzx = V::Mul(tz, x);
+
+    spin[0][0] = V::MulAdd(tx, x, cosAngle); spin[0][1] = V::Add(txy, sz);            spin[0][2] = V::Sub(tzx, sy);
+    spin[1][0] = V::Sub(txy, sz);            spin[1][1] = V::MulAdd(ty, y, cosAngle); spin[1][2] = V::Add(tyz, sx);
+    spin[2][0] = V::Add(tzx, sy);            spin[2][1] = V::Sub(tyz, sx);            spin[2][2] = V::MulAdd(tz, z, cosAngle);
+}
+
+// Stores row r of the 3x3 part of the transform after applying the orbit (rotation about Y, so only x/z change)
+template <typename V>
+void StoreOrbitedRow(float (*m)[SIM_BLOCK_WIDTH], size_t lane, int r,
+                     typename V::F x, typename V::F y, typename V::F z,
+                     typename V::F orbitSin, typename V::F orbitCos)
+{
+    V::Store(&m[3*r+0][lane], V::MulAdd(z, orbitSin, V::Mul(x, orbitCos)));
+    V::Store(&m[3*r+1][lane], y);
+    V::Store(&m[3*r+2][lane], V::Sub(V::Mul(z, orbitCos), V::Mul(x, orbitSin)));
+}
+
+template <typename V>
+void SimUpdateKernel(const SimUpdateKernelArgs& args)
+{
+    typedef typename V::F F;
+    typedef typename V::I I;
+
+    const F zero          = V::Set1(0.0f);
+    const F frameTime     = V::Set1(args.frameTime);
+    const F time          = V::Set1(args.time);
+    const F eyeX          = V::Set1(args.cameraEye.x);
+    const F eyeY          = V::Set1(args.cameraEye.y);
+    const F eyeZ          = V::Set1(args.cameraEye.z);
+    const F log2Scale     = V::Set1(1.1920928955078125e-7f); // See VeryApproxLog2f
+    const F log2Bias      = V::Set1(126.94269504f);
+    const F minSubdivLog2 = V::Set1(args.minSubdivSizeLog2);
+    const I maxSubdiv     = V::Set1i((int)args.subdivCount);
+    const I depthKeyBias  = V::Set1i(DEPTH_KEY_BIAS);
+
+    F distanceSqThresholds[MESH_MAX_SUBDIV_LEVELS];
+    if (args.lodDistanceSqThresholds) {
+        for (unsigned int k = 0; k < args.subdivCount; ++k) {
+            distanceSqThresholds[k] = V::Set1(args.lodDistanceSqThresholds[k]);
+        }
+    }
+
+    for (size_t b = args.firstBlock; b < args.lastBlock; ++b) {
+        auto m = args.world[b].m;
+
+        bool offTurn = args.amortizeInterval > 1 && (b + args.amortizePass) % args.amortizeInterval != 0;
+
+        for (size_t lane = 0; lane < SIM_BLOCK_WIDTH; lane += V::WIDTH) {
+            size_t i = b * SIM_BLOCK_WIDTH + lane;
+
+            bool skip = offTurn;
+            for (int l = 0; l < V::WIDTH && skip; ++l) {
+                skip = args.subdiv[i + l] <= args.amortizeMaxSubdiv;
+            }
+            if (args.asteroidCounts) {
+                for (int l = 0; l < V::WIDTH; ++l) {
+                    args.asteroidCounts[args.subdiv[i + l]]++;
+                    args.updateCounts[args.subdiv[i + l]] += !skip;
+                }
+            }
+            if (skip) {
+                // Small-angle orbit step, as in UpdateScalar; spin waits for the full update
+                if (args.frameTime != 0.0f) {
+                    F s = V::Mul(LoadHalf<V>(args.orbitVelocity + i), frameTime);
+                    F c = V::Sub(V::Set1(1.0f), V::Mul(V::Mul(s, s), V::Set1(0.5f)));
+                    for (int r = 0; r < 4; ++r) {
+                        StoreOrbitedRow<V>(m, lane, r, V::Load(&m[3*r+0][lane]), V::Load(&m[3*r+1][lane]),
+                                           V::Load(&m[3*r+2][lane]), s, c);
+                    }
+                }
+                V::Store(args.spinPending + i, V::Add(V::Load(args.spinPending + i), frameTime));
+                continue;
+            }
+
+            F spinTime = frameTime;
+            if (args.spinPending) {
+                spinTime = V::Add(frameTime, V::Load(args.spinPending + i));
+                V::Store(args.spinPending + i, zero);
+            }
+
+            F px, py, pz;
+            F x, y, z;
+            LoadOctahedral<V>(args.spinAxis + i, &x, &y, &z);
+
+            if (args.closedForm) {
+                // world = scale * spin(t) * translate(radius, height, 0) * orbit(t)
+                F orbitSin, orbitCos, spinSin, spinCos;
+                V::SinCos(&orbitSin, &orbitCos, V::MulAdd(LoadHalf<V>(args.orbitVelocity + i), time, V::Load(args.orbitPhase + i)));
+                V::SinCos(&spinSin,  &spinCos,  V::MulAdd(LoadHalf<V>(args.spinVelocity + i), time, V::Load(args.spinPhase  + i)));
+
+                F spin[3][3];
+                SpinRotation<V>(spin, x, y, z, spinSin, spinCos);
+
+                F scale = LoadHalf<V>(args.scale + i);
+                for (int r = 0; r < 3; ++r) {
+                    StoreOrbitedRow<V>(m, lane, r, V::Mul(spin[r][0], scale), V::Mul(spin[r][1], scale),
+                                       V::Mul(spin[r][2], scale), orbitSin, orbitCos);
+                }
+
+                F radius = V::Load(args.orbitRadius + i);
+                px = V::Mul(radius, orbitCos);
+                py = V::Load(args.orbitHeight + i);
+                pz = V::Sub(zero, V::Mul(radius, orbitSin));
+                V::Store(&m[ 9][lane], px);
+                V::Store(&m[10][lane], py);
+                V::Store(&m[11][lane], pz);
+            } else {
+                px = V::Load(&m[ 9][lane]);
+                py = V::Load(&m[10][lane]);
+                pz = V::Load(&m[11][lane]);
+
+                if (args.animate) {
+                    F orbitSin, orbitCos, spinSin, spinCos;
+                    V::SinCos(&orbitSin, &orbitCos, V::Mul(LoadHalf<V>(args.orbitVelocity + i), frameTime));
+                    V::SinCos(&spinSin,  &spinCos,  V::Mul(LoadHalf<V>(args.spinVelocity + i), spinTime));
+
+                    F spin[3][3];
+                    SpinRotation<V>(spin, x, y, z, spinSin, spinCos);
+
+                    F w[9];
+                    for (int e = 0; e < 9; ++e) w[e] = V::Load(&m[e][lane]);
+
+                    // world = spin * world * orbit
+                    for (int r = 0; r < 3; ++r) {
+                        F ax = V::MulAdd(spin[r][2], w[6], V::MulAdd(spin[r][1], w[3], V::Mul(spin[r][0], w[0])));
+                        F ay = V::MulAdd(spin[r][2], w[7], V::MulAdd(spin[r][1], w[4], V::Mul(spin[r][0], w[1])));
+                        F az = V::MulAdd(spin[r][2], w[8], V::MulAdd(spin[r][1], w[5], V::Mul(spin[r][0], w[2])));
+                        StoreOrbitedRow<V>(m, lane, r, ax, ay, az, orbitSin, orbitCos);
+                    }
+
+                    F newX = V::MulAdd(pz, orbitSin, V::Mul(px, orbitCos));
+                    F newZ = V::Sub(V::Mul(pz, orbitCos), V::Mul(px, orbitSin));
+                    px = newX;
+                    pz = newZ;
+                    V::Store(&m[ 9][lane], px);
+                    V::Store(&m[11][lane], pz);
+                }
+            }
+
+            // Pick LOD based on approx screen area; same math as the scalar path
+            F dx = V::Sub(eyeX, px);
+            F dy = V::Sub(eyeY, py);
+            F dz = V::Sub(eyeZ, pz);
+            F distanceSq = V::MulAdd(dz, dz, V::MulAdd(dy, dy, V::Mul(dx, dx)));
+            if (args.depthKey) {
+                // Same bits as DepthKey; the byte packing saturates to [0, 255]
+                V::StoreBytes(args.depthKey + i, V::Subi(V::ShiftRightArith(V::AsInt(distanceSq), 20), depthKeyBias));
+            }
+            if (args.lodDistanceSqThresholds) {
+                F scale = LoadHalf<V>(args.scale + i);
+                F scaleSq = V::Mul(scale, scale);
+                I subdiv = V::Set1i(0);
+                for (unsigned int k = 0; k < args.subdivCount; ++k) {
+                    subdiv = V::CountLessEqual(subdiv, distanceSq, V::Mul(scaleSq, distanceSqThresholds[k]));
+                }
+                V::StoreBytes(args.subdiv + i, subdiv);
+                continue;
+            }
+            F relativeScreenSize = V::Mul(LoadHalf<V>(args.scale + i), V::RsqrtEst(distanceSq));
+            F relativeScreenSizeLog2 = V::Sub(V::Mul(V::BitsToFloat(relativeScreenSize), log2Scale), log2Bias);
+            F subdivFloat = V::Max(zero, V::Sub(relativeScreenSizeLog2, minSubdivLog2));
+            V::StoreBytes(args.subdiv + i, V::Min(maxSubdiv, V::Truncate(subdivFloat)));
+        }
+    }
+}
+
+} // namespace
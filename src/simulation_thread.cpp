@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simulation_thread.h"
+#include "job_system.h"
+#include "profile.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+// Update granularity when spread across threads; a multiple of SIM_BLOCK_WIDTH
+enum { SIM_UPDATE_CHUNK = 4096 };
+
+
+SimulationThread::SimulationThread(AsteroidsSimulation* asteroids)
+    : mAsteroids(asteroids)
+    , mCurrent(&mInlineFrame)
+{
+}
+
+
+SimulationThread::~SimulationThread()
+{
+    if (mThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mInputMutex);
+            mQuit = true;
+        }
+        mInputPosted.notify_one();
+        mThread.join();
+    }
+}
+
+
+const SimulationFrame& SimulationThread::Simulate(float frameTime, FXMVECTOR cameraEye, CXMMATRIX viewProjection,
+                                                  const Settings& settings, bool parallelUpdate)
+{
+    Input input;
+    input.frameTime = frameTime;
+    XMStoreFloat3(&input.cameraEye, cameraEye);
+    XMStoreFloat4x4(&input.viewProjection, viewProjection);
+    input.settings = settings;
+    input.parallelUpdate = parallelUpdate;
+
+    // Switching modes: the thread has to be idle before the simulation is touched here again, and
+    // whatever it published before is stale by the time async mode comes back. The first async
+    // frame is simulated inline and shown until the thread publishes.
+    if (!settings.asyncSimulation || !mAsync) {
+        if (mAsync) {
+            WaitForIdle();
+        }
+        mAsyncFrames.Acquire();
+
+        SimulateFrame(input, &mInlineFrame);
+        mCurrent = &mInlineFrame;
+        mAsync = settings.asyncSimulation;
+        return *mCurrent;
+    }
+
+    if (!mThread.joinable()) {
+        mThread = std::thread(&SimulationThread::Run, this);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mInputMutex);
+        if (mInputPending) {
+            input.frameTime += mInput.frameTime;
+        }
+        mInput = input;
+        mInputPending = true;
+    }
+    mInputPosted.notify_one();
+
+    if (mAsyncFrames.Acquire()) {
+        mCurrent = &mAsyncFrames.ReadBuffer();
+    }
+    return *mCurrent;
+}
+
+
+void SimulationThread::SimulateFrame(const Input& input, SimulationFrame* frame)
+{
+    auto const& settings = input.settings;
+    mAsteroids->BeginFrame(input.frameTime, XMLoadFloat3(&input.cameraEye), XMLoadFloat4x4(&input.viewProjection),
+                           settings);
+
+    size_t count = mAsteroids->AsteroidCount();
+    size_t chunkCount = (count + SIM_UPDATE_CHUNK - 1) / SIM_UPDATE_CHUNK;
+    auto updateChunk = [&](size_t chunk) {
+        size_t start = chunk * SIM_UPDATE_CHUNK;
+        ProfileBeginSimUpdate();
+        mAsteroids->Update(settings, start, std::min<size_t>(SIM_UPDATE_CHUNK, count - start));
+        ProfileEndSimUpdate();
+    };
+
+    if (input.parallelUpdate) {
+        jobs::parallel_for<size_t>(0, chunkCount, updateChunk);
+    } else {
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            updateChunk(chunk);
+        }
+    }
+
+    mAsteroids->Gravitate(settings);
+    mAsteroids->Collide(settings);
+    mAsteroids->Cull(settings, &frame->drawList);
+    mAsteroids->CaptureFrame(frame);
+}
+
+
+void SimulationThread::Run()
+{
+    for (;;) {
+        Input input;
+        {
+            std::unique_lock<std::mutex> lock(mInputMutex);
+            mInputPosted.wait(lock, [this]() { return mInputPending || mQuit; });
+            if (mQuit) {
+                return;
+            }
+            input = mInput;
+            mInputPending = false;
+            mBusy = true;
+        }
+
+        SimulateFrame(input, mAsyncFrames.WriteBuffer());
+        mAsyncFrames.Publish();
+
+        {
+            std::lock_guard<std::mutex> lock(mInputMutex);
+            mBusy = false;
+        }
+        mIdle.notify_all();
+    }
+}
+
+
+void SimulationThread::WaitForIdle()
+{
+    std::unique_lock<std::mutex> lock(mInputMutex);
+    mIdle.wait(lock, [this]() { return !mInputPending && !mBusy; });
+}
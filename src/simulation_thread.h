@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "settings.h"
+#include "simulation.h"
+#include "triple_buffer.h"
+
+// Runs the per-frame simulation (BeginFrame, Update, Cull) for the renderers, either inline or one
+// frame ahead on its own thread, and hands them the result as a SimulationFrame.
+class SimulationThread
+{
+public:
+    explicit SimulationThread(AsteroidsSimulation* asteroids);
+    ~SimulationThread();
+
+    // The renderers may read the static per-asteroid data at any time; everything else goes
+    // through Simulate while the thread is running
+    AsteroidsSimulation* Asteroids() const { return mAsteroids; }
+
+    // Simulates a frame and returns what to draw. Without settings.asyncSimulation this is the
+    // frame just simulated. With it, the inputs are handed to the simulation thread and the newest
+    // frame it has finished is returned without waiting, so drawing trails input by a frame.
+    // parallelUpdate splits Update across the job system workers. The result is valid until the
+    // next call.
+    const SimulationFrame& Simulate(float frameTime, DirectX::FXMVECTOR cameraEye,
+                                    DirectX::CXMMATRIX viewProjection, const Settings& settings,
+                                    bool parallelUpdate);
+
+    // Stats of the frame last returned by Simulate
+    SimulationStats LastFrameStats() const { return mCurrent->stats; }
+
+private:
+    struct Input
+    {
+        float frameTime;
+        DirectX::XMFLOAT3 cameraEye;
+        DirectX::XMFLOAT4X4 viewProjection;
+        Settings settings;
+        bool parallelUpdate;
+    };
+
+    void SimulateFrame(const Input& input, SimulationFrame* frame);
+    void Run();
+    void WaitForIdle();
+
+    AsteroidsSimulation* mAsteroids;
+
+    SimulationFrame mInlineFrame;
+    TripleBuffer<SimulationFrame> mAsyncFrames;
+    const SimulationFrame* mCurrent;
+    bool mAsync = false;
+
+    // Inputs for the next frame; frame times of frames the thread didn't get to add up.
+    // Only the thread waits on these; the render thread just posts.
+    std::thread mThread;
+    std::mutex mInputMutex;
+    std::condition_variable mInputPosted;
+    std::condition_variable mIdle;
+    Input mInput;
+    bool mInputPending = false;
+    bool mBusy = false;
+    bool mQuit = false;
+};
@@ -0,0 +1,325 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "spatial_grid.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+
+using namespace DirectX;
+
+static_assert(GRID_SECTORS * GRID_HEIGHT_BANDS <= 0x10000, "Cell index must fit in 16 bits");
+
+// Integrated motion can wander a little from the angle predicted by orbitVelocity * time
+static const float GRID_DRIFT_MARGIN = 1.0f;
+
+// Orbit angle in [0, 2pi); a negative radius just puts the asteroid on the far side of the axis
+static double WrapAngle(double angle, float orbitRadius)
+{
+    if (orbitRadius < 0.0f) angle += XM_PI;
+    angle = std::fmod(angle, (double)XM_2PI);
+    if (angle < 0.0) angle += XM_2PI;
+    return angle;
+}
+
+void AsteroidGrid::Build(size_t count, const float* orbitRadius, const float* orbitHeight,
+                         const float* orbitPhase, const float* orbitVelocity, const float* boundingRadius,
+                         double time)
+{
+    mSectorAngle = XM_2PI / GRID_SECTORS;
+
+    float minHeight = FLT_MAX;
+    float maxHeight = -FLT_MAX;
+    for (size_t i = 0; i < count; ++i) {
+        minHeight = std::min(minHeight, orbitHeight[i]);
+        maxHeight = std::max(maxHeight, orbitHeight[i]);
+    }
+    mMinHeight = minHeight;
+    mBandHeight = std::max((maxHeight - minHeight) / GRID_HEIGHT_BANDS, FLT_MIN);
+
+    mCells.assign(GRID_SECTORS * GRID_HEIGHT_BANDS, Cell());
+    for (auto& cell : mCells) {
+        cell.minRadius = FLT_MAX;
+        cell.maxRadius = 0.0f;
+        cell.minHeight = FLT_MAX;
+        cell.maxHeight = -FLT_MAX;
+        cell.maxBoundingRadius = 0.0f;
+        cell.boundsDirty = true;
+    }
+    mSectorBounds.resize(GRID_SECTORS);
+    mSectorCount.assign(GRID_SECTORS, 0);
+
+    mCell.resize(count);
+    mSlot.resize(count);
+    mRadius.resize(count);
+    mHeight.resize(count);
+    mBoundingRadius.resize(count);
+    mSectorPeriod.resize(count);
+    mGeneration.assign(count, 0);
+    mCrossings.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(orbitVelocity[i] > 0.0f);
+
+        double angle = (double)orbitPhase[i] + (double)orbitVelocity[i] * time;
+        auto cell = CellAt(angle, orbitRadius[i], orbitHeight[i]);
+
+        mRadius[i] = std::abs(orbitRadius[i]);
+        mHeight[i] = orbitHeight[i];
+        mBoundingRadius[i] = boundingRadius[i];
+        mSectorPeriod[i] = mSectorAngle / (double)orbitVelocity[i];
+        Insert((unsigned int)i, cell);
+
+        mCrossings[i] = NextCrossing((unsigned int)i, angle, orbitRadius[i], orbitVelocity[i], time);
+    }
+    std::make_heap(mCrossings.begin(), mCrossings.end(), std::greater<Crossing>());
+
+    UpdateBounds();
+}
+
+
+void AsteroidGrid::Move(unsigned int index, float orbitRadius, float orbitHeight, float orbitPhase,
+                        float orbitVelocity, double time)
+{
+    assert(orbitVelocity > 0.0f);
+
+    double angle = (double)orbitPhase + (double)orbitVelocity * time;
+    Remove(index);
+    mRadius[index] = std::abs(orbitRadius);
+    mHeight[index] = orbitHeight;
+    mSectorPeriod[index] = mSectorAngle / (double)orbitVelocity;
+    Insert(index, CellAt(angle, orbitRadius, orbitHeight));
+
+    mGeneration[index]++;
+    mCrossings.push_back(NextCrossing(index, angle, orbitRadius, orbitVelocity, time));
+    std::push_heap(mCrossings.begin(), mCrossings.end(), std::greater<Crossing>());
+
+    // Stale crossings would otherwise pile up as long as asteroids keep moving
+    if (mCrossings.size() > 2 * mCell.size()) {
+        mCrossings.erase(std::remove_if(mCrossings.begin(), mCrossings.end(), [this](const Crossing& crossing) {
+            return crossing.generation != mGeneration[crossing.index];
+        }), mCrossings.end());
+        std::make_heap(mCrossings.begin(), mCrossings.end(), std::greater<Crossing>());
+    }
+}
+
+
+unsigned int AsteroidGrid::CellAt(double angle, float orbitRadius, float orbitHeight) const
+{
+    angle = WrapAngle(angle, orbitRadius);
+    auto sector = std::min((unsigned int)(angle / mSectorAngle), (unsigned int)GRID_SECTORS - 1);
+    auto band = std::min((unsigned int)std::max(0.0f, (orbitHeight - mMinHeight) / mBandHeight), (unsigned int)GRID_HEIGHT_BANDS - 1);
+    return sector * GRID_HEIGHT_BANDS + band;
+}
+
+
+AsteroidGrid::Crossing AsteroidGrid::NextCrossing(unsigned int index, double angle, float orbitRadius,
+                                                  float orbitVelocity, double time) const
+{
+    unsigned int sector = mCell[index] / GRID_HEIGHT_BANDS;
+    Crossing crossing;
+    crossing.time = time + ((sector + 1) * (double)mSectorAngle - WrapAngle(angle, orbitRadius)) / (double)orbitVelocity;
+    crossing.index = index;
+    crossing.generation = mGeneration[index];
+    return crossing;
+}
+
+
+void AsteroidGrid::ShiftTime(double elapsed)
+{
+    // The same offset on every crossing keeps the heap ordered
+    for (auto& crossing : mCrossings) {
+        crossing.time -= elapsed;
+    }
+}
+
+
+void AsteroidGrid::Advance(double time)
+{
+    while (!mCrossings.empty() && mCrossings.front().time <= time) {
+        std::pop_heap(mCrossings.begin(), mCrossings.end(), std::greater<Crossing>());
+        auto& crossing = mCrossings.back();
+        auto i = crossing.index;
+        if (crossing.generation != mGeneration[i]) {
+            mCrossings.pop_back();
+            continue;
+        }
+
+        unsigned int sector = mCell[i] / GRID_HEIGHT_BANDS;
+        unsigned int band = mCell[i] % GRID_HEIGHT_BANDS;
+        sector = (sector + 1) % GRID_SECTORS;
+        Remove(i);
+        Insert(i, sector * GRID_HEIGHT_BANDS + band);
+
+        crossing.time += mSectorPeriod[i];
+        std::push_heap(mCrossings.begin(), mCrossings.end(), std::greater<Crossing>());
+    }
+
+    UpdateBounds();
+}
+
+
+void AsteroidGrid::Insert(unsigned int index, unsigned int cellIndex)
+{
+    auto cell = &mCells[cellIndex];
+    mCell[index] = (unsigned short)cellIndex;
+    mSlot[index] = (unsigned int)cell->members.size();
+    cell->members.push_back(index);
+    mSectorCount[cellIndex / GRID_HEIGHT_BANDS]++;
+
+    auto radius = mRadius[index];
+    auto height = mHeight[index];
+    auto boundingRadius = mBoundingRadius[index];
+    if (radius < cell->minRadius || radius > cell->maxRadius || height < cell->minHeight || height > cell->maxHeight ||
+        boundingRadius > cell->maxBoundingRadius) {
+        cell->minRadius = std::min(cell->minRadius, radius);
+        cell->maxRadius = std::max(cell->maxRadius, radius);
+        cell->minHeight = std::min(cell->minHeight, height);
+        cell->maxHeight = std::max(cell->maxHeight, height);
+        cell->maxBoundingRadius = std::max(cell->maxBoundingRadius, boundingRadius);
+        cell->boundsDirty = true;
+    }
+}
+
+
+void AsteroidGrid::Remove(unsigned int index)
+{
+    auto cellIndex = mCell[index];
+    auto cell = &mCells[cellIndex];
+    auto slot = mSlot[index];
+
+    // Swap with the last member to keep the list dense
+    auto last = cell->members.back();
+    cell->members[slot] = last;
+    mSlot[last] = slot;
+    cell->members.pop_back();
+    mSectorCount[cellIndex / GRID_HEIGHT_BANDS]--;
+}
+
+
+void AsteroidGrid::UpdateBounds()
+{
+    for (unsigned int sector = 0; sector < GRID_SECTORS; ++sector) {
+        auto cells = &mCells[sector * GRID_HEIGHT_BANDS];
+
+        bool sectorDirty = false;
+        for (unsigned int band = 0; band < GRID_HEIGHT_BANDS; ++band) {
+            sectorDirty = sectorDirty || cells[band].boundsDirty;
+        }
+        if (!sectorDirty) continue;
+
+        float angle0 = sector * mSectorAngle;
+        float angle1 = angle0 + mSectorAngle;
+
+        XMVECTOR sectorMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR sectorMax = XMVectorReplicate(-FLT_MAX);
+        for (unsigned int band = 0; band < GRID_HEIGHT_BANDS; ++band) {
+            auto cell = &cells[band];
+            cell->boundsDirty = false;
+            if (cell->minRadius > cell->maxRadius) {
+                // Nothing has been here yet; leave it out of the sector bounds
+                cell->bounds.center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+                cell->bounds.extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+                continue;
+            }
+
+            // Box around the annular sector: both edges at both radii, plus any axis crossings
+            XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+            XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+            auto addAngle = [&](float angle) {
+                float c = std::cos(angle);
+                float s = -std::sin(angle); // RotationY takes +x towards -z
+                for (float r : { cell->minRadius, cell->maxRadius }) {
+                    auto p = XMVectorSet(r * c, 0.0f, r * s, 0.0f);
+                    boxMin = XMVectorMin(boxMin, p);
+                    boxMax = XMVectorMax(boxMax, p);
+                }
+            };
+            addAngle(angle0);
+            addAngle(angle1);
+            for (int k = 1; k < 4; ++k) {
+                float axisAngle = k * XM_PIDIV2;
+                if (axisAngle > angle0 && axisAngle < angle1) addAngle(axisAngle);
+            }
+
+            float y0 = std::min(mMinHeight + band * mBandHeight, cell->minHeight);
+            float y1 = std::max(mMinHeight + (band + 1) * mBandHeight, cell->maxHeight);
+            boxMin = XMVectorSetY(boxMin, y0);
+            boxMax = XMVectorSetY(boxMax, y1);
+
+            auto margin = XMVectorReplicate(cell->maxBoundingRadius + GRID_DRIFT_MARGIN);
+            boxMin = XMVectorSubtract(boxMin, margin);
+            boxMax = XMVectorAdd(boxMax, margin);
+
+            XMStoreFloat3(&cell->bounds.center, XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f));
+            XMStoreFloat3(&cell->bounds.extents, XMVectorScale(XMVectorSubtract(boxMax, boxMin), 0.5f));
+            sectorMin = XMVectorMin(sectorMin, boxMin);
+            sectorMax = XMVectorMax(sectorMax, boxMax);
+        }
+
+        auto sectorBounds = &mSectorBounds[sector];
+        XMStoreFloat3(&sectorBounds->center, XMVectorScale(XMVectorAdd(sectorMin, sectorMax), 0.5f));
+        XMStoreFloat3(&sectorBounds->extents, XMVectorScale(XMVectorSubtract(sectorMax, sectorMin), 0.5f));
+    }
+}
+
+
+GridCullStats AsteroidGrid::Cull(const Frustum& frustum, std::vector<unsigned int>* accepted,
+                                 std::vector<unsigned int>* candidates) const
+{
+    GridCullStats stats;
+
+    for (unsigned int sector = 0; sector < GRID_SECTORS; ++sector) {
+        if (mSectorCount[sector] == 0) continue;
+
+        auto cells = &mCells[sector * GRID_HEIGHT_BANDS];
+        auto sectorBounds = &mSectorBounds[sector];
+        auto sectorTest = BoxInFrustum(frustum, XMLoadFloat3(&sectorBounds->center), XMLoadFloat3(&sectorBounds->extents));
+        if (sectorTest == FRUSTUM_OUTSIDE) {
+            stats.cellsRejected++;
+            continue;
+        }
+        if (sectorTest == FRUSTUM_INSIDE) {
+            stats.cellsAccepted++;
+            for (unsigned int band = 0; band < GRID_HEIGHT_BANDS; ++band) {
+                accepted->insert(accepted->end(), cells[band].members.begin(), cells[band].members.end());
+            }
+            continue;
+        }
+
+        for (unsigned int band = 0; band < GRID_HEIGHT_BANDS; ++band) {
+            auto cell = &cells[band];
+            if (cell->members.empty()) continue;
+
+            auto test = BoxInFrustum(frustum, XMLoadFloat3(&cell->bounds.center), XMLoadFloat3(&cell->bounds.extents));
+            if (test == FRUSTUM_OUTSIDE) {
+                stats.cellsRejected++;
+            } else if (test == FRUSTUM_INSIDE) {
+                stats.cellsAccepted++;
+                accepted->insert(accepted->end(), cell->members.begin(), cell->members.end());
+            } else {
+                stats.cellsPartial++;
+                candidates->insert(candidates->end(), cell->members.begin(), cell->members.end());
+            }
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "frustum.h"
+
+// Coarse binning of the asteroid torus for culling: angular sectors around the Y axis, each split
+// into height bands. Sectors are tested first and only straddling sectors look at their bands.
+enum { GRID_SECTORS = 128 };
+enum { GRID_HEIGHT_BANDS = 8 };
+
+struct GridCullStats
+{
+    unsigned int cellsAccepted = 0;
+    unsigned int cellsRejected = 0;
+    unsigned int cellsPartial = 0;
+};
+
+class AsteroidGrid
+{
+public:
+    // (Re)bins all asteroids at the given time. Asteroid i is at angle orbitPhase[i] + orbitVelocity[i] * t
+    // around Y, orbitRadius[i] from the axis and orbitHeight[i] up, with the given bounding sphere radius.
+    // Orbit velocities must be positive.
+    void Build(size_t count, const float* orbitRadius, const float* orbitHeight,
+               const float* orbitPhase, const float* orbitVelocity, const float* boundingRadius,
+               double time);
+
+    // Moves asteroids that crossed into the next sector since the last Build/Advance.
+    // Cost is proportional to the number of crossings, not the asteroid count.
+    void Advance(double time);
+
+    // Re-bins one asteroid whose orbit changed (see Build) at the given time, which must be that of
+    // the last Build/Advance. Call UpdateBounds before the next Cull.
+    void Move(unsigned int index, float orbitRadius, float orbitHeight, float orbitPhase, float orbitVelocity,
+              double time);
+    void UpdateBounds();
+
+    // Moves the time origin elapsed later, for when the orbit phases have been advanced by that
+    // much; later times are passed relative to the new origin
+    void ShiftTime(double elapsed);
+
+    // Appends the members of cells entirely inside the frustum to accepted and those of cells
+    // straddling it to candidates (which still need a per-asteroid test)
+    GridCullStats Cull(const Frustum& frustum, std::vector<unsigned int>* accepted,
+                       std::vector<unsigned int>* candidates) const;
+
+private:
+    struct Bounds
+    {
+        DirectX::XMFLOAT3 center;
+        DirectX::XMFLOAT3 extents;
+    };
+
+    // Radial, height and bounding sphere extents only ever grow as asteroids pass through, which
+    // keeps the cell bounds conservative without rescanning members on removal. Heights normally
+    // stay inside the band; Move can push them out.
+    struct Cell
+    {
+        std::vector<unsigned int> members;
+        float minRadius;
+        float maxRadius;
+        float minHeight;
+        float maxHeight;
+        float maxBoundingRadius;
+        bool boundsDirty;
+        Bounds bounds;
+    };
+
+    // Moving an asteroid leaves its old crossing in the heap; the generation tells them apart
+    struct Crossing
+    {
+        double time;
+        unsigned int index;
+        unsigned int generation;
+        bool operator>(const Crossing& other) const { return time > other.time; }
+    };
+
+    unsigned int CellAt(double angle, float orbitRadius, float orbitHeight) const;
+    Crossing NextCrossing(unsigned int index, double angle, float orbitRadius, float orbitVelocity, double time) const;
+    void Insert(unsigned int index, unsigned int cell);
+    void Remove(unsigned int index);
+
+    float mSectorAngle = 0.0f;
+    float mMinHeight = 0.0f;
+    float mBandHeight = 0.0f;
+
+    std::vector<Cell> mCells;             // Sector-major: sector * GRID_HEIGHT_BANDS + band
+    std::vector<Bounds> mSectorBounds;
+    std::vector<unsigned int> mSectorCount;
+
+    // Per asteroid
+    std::vector<unsigned short> mCell;
+    std::vector<unsigned int> mSlot;      // Position in its cell's members
+    std::vector<float> mRadius;
+    std::vector<float> mHeight;
+    std::vector<float> mBoundingRadius;
+    std::vector<double> mSectorPeriod;    // Time to cross one sector
+    std::vector<unsigned int> mGeneration;
+
+    std::vector<Crossing> mCrossings;     // Min-heap on time
+};
@@ -0,0 +1,355 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "sphere_bvh.h"
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// Deep enough for a tree over 2^31 leaves with both children of every level pending
+enum { BVH_MAX_STACK = 64 };
+
+
+float SphereBvh::SurfaceArea(const Box& box)
+{
+    float x = box.hi.x - box.lo.x, y = box.hi.y - box.lo.y, z = box.hi.z - box.lo.z;
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+
+float SphereBvh::DistanceSq(const XMFLOAT3& point, const Box& box)
+{
+    float x = std::max(std::max(box.lo.x - point.x, point.x - box.hi.x), 0.0f);
+    float y = std::max(std::max(box.lo.y - point.y, point.y - box.hi.y), 0.0f);
+    float z = std::max(std::max(box.lo.z - point.z, point.z - box.hi.z), 0.0f);
+    return x * x + y * y + z * z;
+}
+
+
+float SphereBvh::CenterDistanceSq(const XMFLOAT3& point, const Box& box)
+{
+    float x = 0.5f * (box.lo.x + box.hi.x) - point.x;
+    float y = 0.5f * (box.lo.y + box.hi.y) - point.y;
+    float z = 0.5f * (box.lo.z + box.hi.z) - point.z;
+    return x * x + y * y + z * z;
+}
+
+
+void SphereBvh::Build(size_t count, const XMFLOAT3* centers, const float* radius, JobSystem& jobSystem)
+{
+    enum { CHUNK_SIZE = 4096 };
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    mKeys.resize(count);
+    mSpheres.resize(count);
+    mLeafCount = (count + LEAF_SIZE - 1) / LEAF_SIZE;
+    mLeafCapacity = 1;
+    while (mLeafCapacity < mLeafCount) mLeafCapacity *= 2;
+    mLeafArea = mBuildLeafArea = 0.0f;
+    if (count == 0) {
+        mNodes.clear();
+        return;
+    }
+
+    // Bounding box of the centers, from per-chunk bounds
+    std::vector<Box> chunkBounds(chunkCount);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        auto lo = XMVectorReplicate(FLT_MAX);
+        auto hi = XMVectorReplicate(-FLT_MAX);
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; ++i) {
+            auto c = XMLoadFloat3(&centers[i]);
+            lo = XMVectorMin(lo, c);
+            hi = XMVectorMax(hi, c);
+        }
+        XMStoreFloat3(&chunkBounds[chunk].lo, lo);
+        XMStoreFloat3(&chunkBounds[chunk].hi, hi);
+    }, 1);
+    auto lo = XMLoadFloat3(&chunkBounds[0].lo);
+    auto hi = XMLoadFloat3(&chunkBounds[0].hi);
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        lo = XMVectorMin(lo, XMLoadFloat3(&chunkBounds[chunk].lo));
+        hi = XMVectorMax(hi, XMLoadFloat3(&chunkBounds[chunk].hi));
+    }
+    XMFLOAT3 origin, extent;
+    XMStoreFloat3(&origin, lo);
+    XMStoreFloat3(&extent, XMVectorSubtract(hi, lo));
+    // Cubic cells, so the curve's locality doesn't depend on the field's proportions
+    float scale = (float)(1 << MORTON_BITS) / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f));
+
+    // Members are in index order and the sort is stable, so the order only depends on the centers
+    auto quantize = [scale](float v, float lo) {
+        return (uint32_t)std::min(std::max((v - lo) * scale, 0.0f), (float)((1 << MORTON_BITS) - 1));
+    };
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; ++i) {
+            auto c = centers[i];
+            uint32_t key = Part1By2(quantize(c.x, origin.x)) |
+                           Part1By2(quantize(c.y, origin.y)) << 1 |
+                           Part1By2(quantize(c.z, origin.z)) << 2;
+            mKeys[i] = (uint64_t)key << 32 | i;
+        }
+    }, 1);
+    RadixSortHighBits(&mKeys, &mScratch, 3 * MORTON_BITS, jobSystem);
+
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        size_t end = std::min(count, (chunk + 1) * CHUNK_SIZE);
+        for (size_t k = chunk * CHUNK_SIZE; k < end; ++k) {
+            mSpheres[k].w = radius[(unsigned int)mKeys[k]];
+        }
+    }, 1);
+    mNodes.resize(2 * mLeafCapacity - 1);
+    Refit(centers, jobSystem);
+    mBuildLeafArea = mLeafArea;
+}
+
+
+void SphereBvh::Refit(const XMFLOAT3* centers, JobSystem& jobSystem)
+{
+    if (mSpheres.empty()) return;
+
+    size_t count = mSpheres.size();
+    size_t chunkCount = (mLeafCapacity + REFIT_CHUNK - 1) / REFIT_CHUNK;
+    mChunkArea.resize(chunkCount);
+    jobSystem.ParallelFor(size_t(0), chunkCount, [&](size_t chunk) {
+        float area = 0.0f;
+        size_t end = std::min(mLeafCapacity, (chunk + 1) * REFIT_CHUNK);
+        for (size_t leaf = chunk * REFIT_CHUNK; leaf < end; ++leaf) {
+            auto lo = XMVectorReplicate(FLT_MAX);
+            auto hi = XMVectorReplicate(-FLT_MAX);
+            for (size_t k = leaf * LEAF_SIZE; k < std::min(count, (leaf + 1) * LEAF_SIZE); ++k) {
+                auto c = centers[(unsigned int)mKeys[k]];
+                float r = mSpheres[k].w;
+                mSpheres[k] = XMFLOAT4(c.x, c.y, c.z, r);
+                lo = XMVectorMin(lo, XMVectorSet(c.x - r, c.y - r, c.z - r, 0.0f));
+                hi = XMVectorMax(hi, XMVectorSet(c.x + r, c.y + r, c.z + r, 0.0f));
+            }
+            auto& box = mNodes[LeafNode(leaf)];
+            XMStoreFloat3(&box.lo, lo);
+            XMStoreFloat3(&box.hi, hi);
+            area += leaf < mLeafCount ? SurfaceArea(box) : 0.0f;
+        }
+        mChunkArea[chunk] = area;
+    }, 1);
+
+    mLeafArea = 0.0f;
+    for (auto area : mChunkArea) {
+        mLeafArea += area;
+    }
+
+    // Then each level from the bottom up; the level of width w starts at node w - 1
+    for (size_t width = mLeafCapacity / 2; width > 0; width /= 2) {
+        jobSystem.ParallelFor(size_t(0), (width + REFIT_CHUNK - 1) / REFIT_CHUNK, [&](size_t chunk) {
+            size_t end = width - 1 + std::min(width, (chunk + 1) * REFIT_CHUNK);
+            for (size_t n = width - 1 + chunk * REFIT_CHUNK; n < end; ++n) {
+                auto const& a = mNodes[2 * n + 1];
+                auto const& b = mNodes[2 * n + 2];
+                auto& box = mNodes[n];
+                box.lo = XMFLOAT3(std::min(a.lo.x, b.lo.x), std::min(a.lo.y, b.lo.y), std::min(a.lo.z, b.lo.z));
+                box.hi = XMFLOAT3(std::max(a.hi.x, b.hi.x), std::max(a.hi.y, b.hi.y), std::max(a.hi.z, b.hi.z));
+            }
+        }, 1);
+    }
+}
+
+
+bool SphereBvh::Raycast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+                        unsigned int* hit, float* distance) const
+{
+    if (mSpheres.empty()) return false;
+
+    XMFLOAT3 o, d, invD;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&d, direction);
+    // Axis-parallel rays get infinite slabs, which the min/max below handle
+    XMStoreFloat3(&invD, XMVectorReciprocal(direction));
+
+    float best = maxDistance;
+    size_t bestK = mSpheres.size();
+
+    // Distance along the ray to where it enters the box, or FLT_MAX if it misses or enters past best
+    auto entry = [&](const Box& box) {
+        if (box.lo.x > box.hi.x) return FLT_MAX; // Empty
+        float tx0 = (box.lo.x - o.x) * invD.x, tx1 = (box.hi.x - o.x) * invD.x;
+        float ty0 = (box.lo.y - o.y) * invD.y, ty1 = (box.hi.y - o.y) * invD.y;
+        float tz0 = (box.lo.z - o.z) * invD.z, tz1 = (box.hi.z - o.z) * invD.z;
+        float t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), best));
+        return t0 <= t1 ? t0 : FLT_MAX;
+    };
+
+    size_t stack[BVH_MAX_STACK];
+    float stackEntry[BVH_MAX_STACK];
+    unsigned int depth = 0;
+    stack[depth] = 0;
+    stackEntry[depth++] = entry(mNodes[0]);
+    while (depth > 0) {
+        --depth;
+        auto n = stack[depth];
+        if (stackEntry[depth] > best) continue;
+
+        if (n >= LeafNode(0)) {
+            size_t leaf = n - LeafNode(0);
+            for (size_t k = leaf * LEAF_SIZE; k < std::min(mSpheres.size(), (leaf + 1) * LEAF_SIZE); ++k) {
+                auto const& s = mSpheres[k];
+                float ox = o.x - s.x, oy = o.y - s.y, oz = o.z - s.z;
+                float b = ox * d.x + oy * d.y + oz * d.z;
+                float c = ox * ox + oy * oy + oz * oz - s.w * s.w;
+                float t;
+                if (c <= 0.0f) {
+                    t = 0.0f; // Inside
+                } else {
+                    float discriminant = b * b - c;
+                    if (b > 0.0f || discriminant < 0.0f) continue;
+                    t = -b - std::sqrt(discriminant);
+                }
+                if (t < best || (t == best && k < bestK)) {
+                    best = t;
+                    bestK = k;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top
+        float t0 = entry(mNodes[2 * n + 1]);
+        float t1 = entry(mNodes[2 * n + 2]);
+        size_t near = 2 * n + 1, far = 2 * n + 2;
+        if (t1 < t0) {
+            std::swap(near, far);
+            std::swap(t0, t1);
+        }
+        if (t1 != FLT_MAX) {
+            stack[depth] = far;
+            stackEntry[depth++] = t1;
+        }
+        if (t0 != FLT_MAX) {
+            stack[depth] = near;
+            stackEntry[depth++] = t0;
+        }
+    }
+
+    if (bestK == mSpheres.size()) return false;
+    *hit = (unsigned int)mKeys[bestK];
+    *distance = best;
+    return true;
+}
+
+
+void SphereBvh::Overlap(FXMVECTOR center, float radius, std::vector<unsigned int>* result) const
+{
+    if (mSpheres.empty()) return;
+
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, center);
+    size_t stack[BVH_MAX_STACK];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        auto n = stack[--depth];
+        if (DistanceSq(p, mNodes[n]) > radius * radius) continue;
+
+        if (n >= LeafNode(0)) {
+            size_t leaf = n - LeafNode(0);
+            for (size_t k = leaf * LEAF_SIZE; k < std::min(mSpheres.size(), (leaf + 1) * LEAF_SIZE); ++k) {
+                auto const& s = mSpheres[k];
+                float dx = s.x - p.x, dy = s.y - p.y, dz = s.z - p.z;
+                float r = radius + s.w;
+                if (dx * dx + dy * dy + dz * dz < r * r) {
+                    result->push_back((unsigned int)mKeys[k]);
+                }
+            }
+            continue;
+        }
+        stack[depth++] = 2 * n + 2;
+        stack[depth++] = 2 * n + 1;
+    }
+}
+
+
+void SphereBvh::Nearest(FXMVECTOR point, unsigned int k, std::vector<std::pair<float, unsigned int>>* result) const
+{
+    result->clear();
+    if (mSpheres.empty() || k == 0) return;
+
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, point);
+
+    // Max-heap of the best k so far as (distance, position in Morton order), so ties break the
+    // same way whatever order the leaves are visited in
+    auto& best = *result;
+    auto bound = [&]() { return best.size() < k ? FLT_MAX : best.front().first; };
+
+    // Spheres lie inside their boxes, so the distance to a box is a lower bound for their
+    // surfaces, except from inside the box, where a sphere can be nearer than 0
+    auto lowerBound = [&](const Box& box) {
+        float distanceSq = DistanceSq(p, box);
+        return distanceSq > 0.0f ? std::sqrt(distanceSq) : -FLT_MAX;
+    };
+
+    size_t stack[BVH_MAX_STACK];
+    float stackBound[BVH_MAX_STACK];
+    unsigned int depth = 0;
+    stack[depth] = 0;
+    stackBound[depth++] = lowerBound(mNodes[0]);
+    while (depth > 0) {
+        --depth;
+        auto n = stack[depth];
+        if (stackBound[depth] > bound()) continue;
+
+        if (n >= LeafNode(0)) {
+            size_t leaf = n - LeafNode(0);
+            for (size_t s = leaf * LEAF_SIZE; s < std::min(mSpheres.size(), (leaf + 1) * LEAF_SIZE); ++s) {
+                auto const& sphere = mSpheres[s];
+                float dx = sphere.x - p.x, dy = sphere.y - p.y, dz = sphere.z - p.z;
+                auto candidate = std::make_pair(std::sqrt(dx * dx + dy * dy + dz * dz) - sphere.w, (unsigned int)s);
+                if (best.size() < k) {
+                    best.push_back(candidate);
+                    std::push_heap(best.begin(), best.end());
+                } else if (candidate < best.front()) {
+                    std::pop_heap(best.begin(), best.end());
+                    best.back() = candidate;
+                    std::push_heap(best.begin(), best.end());
+                }
+            }
+            continue;
+        }
+
+        // Nearer box center on top; boxes around the point all bound at -FLT_MAX, so the
+        // bounds alone don't say which child to try first
+        float b0 = lowerBound(mNodes[2 * n + 1]);
+        float b1 = lowerBound(mNodes[2 * n + 2]);
+        size_t near = 2 * n + 1, far = 2 * n + 2;
+        if (CenterDistanceSq(p, mNodes[far]) < CenterDistanceSq(p, mNodes[near])) {
+            std::swap(near, far);
+            std::swap(b0, b1);
+        }
+        stack[depth] = far;
+        stackBound[depth++] = b1;
+        stack[depth] = near;
+        stackBound[depth++] = b0;
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    for (auto& entry : best) {
+        entry.second = (unsigned int)mKeys[entry.second];
+    }
+}
@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "job_system.h"
+
+// Bounding volume hierarchy over spheres, such as the asteroids' bounding spheres, for ray,
+// overlap and nearest-neighbor queries. Spheres are sorted along a Morton curve and cut into
+// leaves of LEAF_SIZE consecutive spheres, and the tree over the leaves is a complete binary
+// tree stored as a heap, so the topology is implicit and building is just the sort.
+//
+// Refit moves the spheres and recomputes every box, the leaves in parallel and then each level
+// of the tree in parallel, keeping the order. The boxes grow as neighbors in the order drift
+// apart; Degradation tells when a new Build would pay off.
+//
+// Queries only read the tree, so any number can run in parallel between Builds and Refits.
+class SphereBvh
+{
+public:
+    // Sorts the spheres and fits the tree to them. The radii stay fixed until the next Build.
+    void Build(size_t count, const DirectX::XMFLOAT3* centers, const float* radius, JobSystem& jobSystem);
+
+    // Moves the spheres to new centers, in the order given to Build, and refits the boxes
+    void Refit(const DirectX::XMFLOAT3* centers, JobSystem& jobSystem);
+
+    size_t Count() const { return mSpheres.size(); }
+
+    // Surface area of the leaf boxes relative to right after the last Build
+    float Degradation() const { return mBuildLeafArea > 0.0f ? mLeafArea / mBuildLeafArea : 1.0f; }
+
+    // Nearest sphere hit by origin + t * direction (direction normalized) for t in [0, maxDistance],
+    // or false if none is. A ray starting inside a sphere hits it at 0.
+    bool Raycast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance,
+                 unsigned int* hit, float* distance) const;
+
+    // Appends every sphere overlapping the one given
+    void Overlap(DirectX::FXMVECTOR center, float radius, std::vector<unsigned int>* result) const;
+
+    // Replaces result with the k spheres whose surfaces are nearest the point (center distance
+    // minus radius, so negative inside), nearest first, as (distance, sphere) pairs. Ties go to
+    // the earlier sphere in Morton order.
+    void Nearest(DirectX::FXMVECTOR point, unsigned int k, std::vector<std::pair<float, unsigned int>>* result) const;
+
+private:
+    enum { LEAF_SIZE = 8 };
+    enum { MORTON_BITS = 10 }; // Per axis
+    enum { REFIT_CHUNK = 1024 }; // Leaves, or nodes of a level, per refit job
+
+    struct Box
+    {
+        DirectX::XMFLOAT3 lo;
+        DirectX::XMFLOAT3 hi;
+    };
+
+    // Node n's children are 2n + 1 and 2n + 2; leaf l is node mLeafCapacity - 1 + l
+    size_t LeafNode(size_t leaf) const { return mLeafCapacity - 1 + leaf; }
+    static float SurfaceArea(const Box& box);
+    static float DistanceSq(const DirectX::XMFLOAT3& point, const Box& box); // 0 inside
+    static float CenterDistanceSq(const DirectX::XMFLOAT3& point, const Box& box);
+
+    std::vector<uint64_t> mKeys;   // Morton code << 32 | sphere, sorted
+    std::vector<uint64_t> mScratch;
+    std::vector<DirectX::XMFLOAT4> mSpheres; // Center and radius, in Morton order
+    std::vector<Box> mNodes;       // Leaves past mLeafCount are empty (lo > hi) and never hit
+    std::vector<float> mChunkArea; // Leaf area per refit job, summed in order
+    size_t mLeafCount = 0;
+    size_t mLeafCapacity = 0;      // Leaf count rounded up to a power of 2
+    float mLeafArea = 0.0f;
+    float mBuildLeafArea = 0.0f;
+};
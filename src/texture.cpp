@@ -16,7 +16,6 @@
 
 #include "texture.h"
 #include "util.h"
-#include "noise.h"
 #include "DDSTextureLoader.h"
 
 #include <stdint.h>
@@ -39,66 +38,15 @@ static void WaitForAll(ID3D12Device* device, ID3D12CommandQueue* queue)
 }
 
 
-void GenerateMips2D_XXXX8(D3D11_SUBRESOURCE_DATA* subresources, size_t widthLevel0, size_t heightLevel0, size_t mipLevels)
+std::vector<D3D11_SUBRESOURCE_DATA> D3D11SubresourceData(const TextureSubresource* subresources, size_t count)
 {
-    for (size_t m = 1; m < mipLevels; ++m) {
-        auto rowPitchSrc = subresources[m - 1].SysMemPitch;
-        const BYTE* dataSrc = (BYTE*)subresources[m - 1].pSysMem;
-
-        auto rowPitchDst = subresources[m].SysMemPitch;
-        BYTE* dataDst = (BYTE*)subresources[m].pSysMem;
-        
-        auto width = widthLevel0 >> m;
-        auto height = heightLevel0 >> m;
-
-        // Iterating byte-wise is simpler in this case (pulls apart color nicely)
-        // Not optimized at all, obviously...
-        for (size_t y = 0; y < height; ++y) {
-            auto rowSrc0 = (dataSrc + (y*2+0)*rowPitchSrc);
-            auto rowSrc1 = (dataSrc + (y*2+1)*rowPitchSrc);
-            auto rowDst  = (dataDst + (y    )*rowPitchDst);
-            for (size_t x = 0; x < width; ++x) {
-                for (size_t comp = 0; comp < 4; ++comp) {
-                    uint32_t c = rowSrc0[x*8+comp+0];
-                    c +=         rowSrc0[x*8+comp+4];
-                    c +=         rowSrc1[x*8+comp+0];
-                    c +=         rowSrc1[x*8+comp+4];
-                    c = c / 4;
-                    assert(c < 256);
-                    rowDst[4*x+comp] = (byte)c;
-                }
-            }
-        }
-    }
-}
-
-
-void FillNoise2D_RGBA8(D3D11_SUBRESOURCE_DATA* subresources, size_t width, size_t height, size_t mipLevels,
-                       float seed, float persistence, float noiseScale, float noiseStrength,
-					   float redScale, float greenScale, float blueScale)
-{
-    NoiseOctaves<4> textureNoise(persistence);
-    
-    // Level 0
-    for (size_t y = 0; y < height; ++y) {
-        uint32_t* row = (uint32_t*)((BYTE*)subresources[0].pSysMem + y*subresources[0].SysMemPitch);
-        for (size_t x = 0; x < width; ++x) {
-            auto c = textureNoise((float)x*noiseScale, (float)y*noiseScale, seed);
-            c = std::max(0.0f, std::min(1.0f, (c - 0.5f) * noiseStrength + 0.5f));
-
-            int32_t cr = (int32_t)(c * redScale);
-			int32_t cg = (int32_t)(c * greenScale);
-			int32_t cb = (int32_t)(c * blueScale);
-			assert(cr >= 0 && cr < 256);
-			assert(cg >= 0 && cg < 256);
-            assert(cb >= 0 && cb < 256);
-
-            row[x] = (cr) << 16 | (cg) <<  8 | (cb) << 0;
-        }
+    std::vector<D3D11_SUBRESOURCE_DATA> data(count);
+    for (size_t i = 0; i < count; ++i) {
+        data[i].pSysMem = subresources[i].data;
+        data[i].SysMemPitch = subresources[i].rowPitch;
+        data[i].SysMemSlicePitch = subresources[i].slicePitch;
     }
-
-    if (mipLevels > 1)
-        GenerateMips2D_XXXX8(subresources, width, height, mipLevels);
+    return data;
 }
 
 
@@ -19,14 +19,12 @@
 #include <d3d12.h>
 #include <d3dx12.h>
 #include <d3d11.h>
+#include <vector>
 
-void GenerateMips2D_XXXX8(D3D11_SUBRESOURCE_DATA* subresources, size_t widthLevel0, size_t heightLevel0, size_t mipLevels);
-
-// Will generate mips (into subresources array) is mipLevels > 0
-void FillNoise2D_RGBA8(D3D11_SUBRESOURCE_DATA* subresources, size_t width, size_t height, size_t mipLevels,
-                       float seed, float persistence, float noiseScale, float noiseStrength,
-					   float redScale = 255.0f, float greenScale = 255.0f, float blueScale = 255.0f);
+#include "texture_data.h"
 
+// D3D11_SUBRESOURCE_DATA for each of count subresources, pointing at the same memory
+std::vector<D3D11_SUBRESOURCE_DATA> D3D11SubresourceData(const TextureSubresource* subresources, size_t count);
 
 // Helper for uploading initial texture data in D3D12; as with D3D11, one initialData structure per subresource
 // Creates temporary resources internally and syncs with GPU... this is a convenience function for init time!
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "texture_data.h"
+#include "noise.h"
+
+#include <algorithm>
+#include <assert.h>
+
+
+void GenerateMips2D_XXXX8(TextureSubresource* subresources, size_t widthLevel0, size_t heightLevel0, size_t mipLevels)
+{
+    for (size_t m = 1; m < mipLevels; ++m) {
+        auto rowPitchSrc = subresources[m - 1].rowPitch;
+        const uint8_t* dataSrc = (const uint8_t*)subresources[m - 1].data;
+
+        auto rowPitchDst = subresources[m].rowPitch;
+        uint8_t* dataDst = (uint8_t*)subresources[m].data;
+        
+        auto width = widthLevel0 >> m;
+        auto height = heightLevel0 >> m;
+
+        // Iterating byte-wise is simpler in this case (pulls apart color nicely)
+        // Not optimized at all, obviously...
+        for (size_t y = 0; y < height; ++y) {
+            auto rowSrc0 = (dataSrc + (y*2+0)*rowPitchSrc);
+            auto rowSrc1 = (dataSrc + (y*2+1)*rowPitchSrc);
+            auto rowDst  = (dataDst + (y    )*rowPitchDst);
+            for (size_t x = 0; x < width; ++x) {
+                for (size_t comp = 0; comp < 4; ++comp) {
+                    uint32_t c = rowSrc0[x*8+comp+0];
+                    c +=         rowSrc0[x*8+comp+4];
+                    c +=         rowSrc1[x*8+comp+0];
+                    c +=         rowSrc1[x*8+comp+4];
+                    c = c / 4;
+                    assert(c < 256);
+                    rowDst[4*x+comp] = (uint8_t)c;
+                }
+            }
+        }
+    }
+}
+
+
+void FillNoise2D_RGBA8(TextureSubresource* subresources, size_t width, size_t height, size_t mipLevels,
+                       float seed, float persistence, float noiseScale, float noiseStrength,
+					   float redScale, float greenScale, float blueScale)
+{
+    NoiseOctaves<4> textureNoise(persistence);
+    
+    // Level 0
+    for (size_t y = 0; y < height; ++y) {
+        uint32_t* row = (uint32_t*)((uint8_t*)subresources[0].data + y*subresources[0].rowPitch);
+        for (size_t x = 0; x < width; ++x) {
+            auto c = textureNoise((float)x*noiseScale, (float)y*noiseScale, seed);
+            c = std::max(0.0f, std::min(1.0f, (c - 0.5f) * noiseStrength + 0.5f));
+
+            int32_t cr = (int32_t)(c * redScale);
+			int32_t cg = (int32_t)(c * greenScale);
+			int32_t cb = (int32_t)(c * blueScale);
+			assert(cr >= 0 && cr < 256);
+			assert(cg >= 0 && cg < 256);
+            assert(cb >= 0 && cb < 256);
+
+            row[x] = (cr) << 16 | (cg) <<  8 | (cb) << 0;
+        }
+    }
+
+    if (mipLevels > 1)
+        GenerateMips2D_XXXX8(subresources, width, height, mipLevels);
+}
@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One mip level of one array slice of a texture in system memory; laid out and used like
+// D3D11_SUBRESOURCE_DATA but without needing the D3D headers
+struct TextureSubresource
+{
+    void* data;
+    unsigned int rowPitch;
+    unsigned int slicePitch;
+};
+
+void GenerateMips2D_XXXX8(TextureSubresource* subresources, size_t widthLevel0, size_t heightLevel0, size_t mipLevels);
+
+// Will generate mips (into subresources array) is mipLevels > 0
+void FillNoise2D_RGBA8(TextureSubresource* subresources, size_t width, size_t height, size_t mipLevels,
+                       float seed, float persistence, float noiseScale, float noiseStrength,
+                       float redScale = 255.0f, float greenScale = 255.0f, float blueScale = 255.0f);
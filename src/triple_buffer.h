@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <atomic>
+
+// Single-producer, single-consumer handoff of the newest value without locks. The producer fills
+// WriteBuffer() and publishes it; the consumer picks up the newest published value, if any, and
+// keeps reading it until it picks up another. Neither side ever waits; unread values are dropped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : mReady(1) {}
+
+    // Producer side
+    T* WriteBuffer() { return &mBuffers[mWrite]; }
+
+    void Publish()
+    {
+        mWrite = mReady.exchange(mWrite | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer side: switches ReadBuffer to the newest published value; false if there is none
+    // newer than the current one
+    bool Acquire()
+    {
+        if ((mReady.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        mRead = mReady.exchange(mRead, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& ReadBuffer() const { return mBuffers[mRead]; }
+
+private:
+    enum { INDEX_MASK = 3, FRESH = 4 };
+
+    T mBuffers[3];
+    unsigned int mWrite = 0;             // Producer-owned
+    unsigned int mRead = 2;              // Consumer-owned
+    std::atomic<unsigned int> mReady;    // Index of the middle buffer, plus FRESH if not yet read
+};
@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include "vertex_cache.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+enum : uint32_t { NO_VERTEX = 0xFFFFFFFF };
+
+
+// Tipsify: fan out all remaining triangles around one vertex, then move to the candidate vertex
+// (one just output) that entered the cache earliest but will still be cached after its own
+// remaining triangles are emitted. Dead ends fall back to the most recently output vertex with
+// triangles left, then to the lowest numbered one.
+void OptimizeVertexCache(IndexType* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+    assert(indexCount % 3 == 0); // trilist
+    size_t triangleCount = indexCount / 3;
+
+    // Triangles using each vertex, as one range per vertex
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        assert(indices[i] < vertexCount);
+        ++adjacencyStart[indices[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    }
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        auto v = indices[i];
+        adjacency[adjacencyStart[v] + liveTriangles[v]++] = (uint32_t)(i / 3);
+    }
+
+    // Simulated FIFO: a vertex is cached while its timestamp is within cacheSize of the clock
+    std::vector<uint32_t> cachedAt(vertexCount, 0);
+    uint32_t clock = cacheSize + 1;
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<IndexType> output;
+    output.reserve(indexCount);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    size_t nextInOrder = 0;
+
+    uint32_t fan = vertexCount > 0 ? 0 : NO_VERTEX;
+    while (fan != NO_VERTEX) {
+        candidates.clear();
+        for (uint32_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a) {
+            auto t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (size_t k = 0; k < 3; ++k) {
+                auto v = indices[t*3+k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if (clock - cachedAt[v] > cacheSize) {
+                    cachedAt[v] = clock++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        fan = NO_VERTEX;
+        int64_t bestAge = -1;
+        for (auto v : candidates) {
+            if (liveTriangles[v] == 0) continue;
+
+            // Fanning v pushes at most 2 new vertices per triangle; prefer the oldest that
+            // survives that, otherwise any with work left
+            int64_t age = 0;
+            if ((int64_t)(clock - cachedAt[v]) + 2 * (int64_t)liveTriangles[v] <= (int64_t)cacheSize) {
+                age = clock - cachedAt[v];
+            }
+            if (age > bestAge) {
+                bestAge = age;
+                fan = v;
+            }
+        }
+
+        while (fan == NO_VERTEX && !deadEnds.empty()) {
+            auto v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) fan = v;
+        }
+        for (; fan == NO_VERTEX && nextInOrder < vertexCount; ++nextInOrder) {
+            if (liveTriangles[nextInOrder] > 0) fan = (uint32_t)nextInOrder;
+        }
+    }
+
+    assert(output.size() == indexCount);
+    std::copy(output.begin(), output.end(), indices);
+}
+
+
+void OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, IndexType* indices, size_t indexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, NO_VERTEX);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        auto v = indices[i];
+        if (remap[v] == NO_VERTEX) {
+            remap[v] = next++;
+        }
+        indices[i] = (IndexType)remap[v];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        if (remap[v] == NO_VERTEX) {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<Vertex> reordered(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        reordered[remap[v]] = vertices[v];
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+
+VertexCacheStats AnalyzeVertexCache(const IndexType* indices, size_t indexCount, size_t vertexCount,
+                                    unsigned int cacheSize)
+{
+    // A vertex is cached while fewer than cacheSize transforms have happened since its own;
+    // 0 means never transformed
+    std::vector<uint32_t> transformedAt(vertexCount, 0);
+    uint32_t transforms = 0;
+    size_t usedVertices = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        auto v = indices[i];
+        if (transformedAt[v] == 0) {
+            ++usedVertices;
+        }
+        if (transformedAt[v] == 0 || transforms - transformedAt[v] >= cacheSize) {
+            transformedAt[v] = ++transforms;
+        }
+    }
+
+    VertexCacheStats stats = {};
+    if (indexCount > 0) {
+        stats.acmr = (float)transforms / (float)(indexCount / 3);
+        stats.atvr = (float)transforms / (float)usedVertices;
+    }
+    return stats;
+}
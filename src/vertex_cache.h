@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+// Copyright 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not
+// use this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include "mesh.h"
+
+// Reorders a triangle list for reuse in a FIFO post-transform cache of cacheSize entries, with
+// the vertex cache pass of Sander et al.'s Tipsify ("Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw"). Triangles keep their winding; indices must be below vertexCount.
+void OptimizeVertexCache(IndexType* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize);
+
+// Renumbers vertices in the order the indices first use them, so vertex fetch walks memory
+// forward. Vertices the indices never use keep their order after the rest.
+void OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, IndexType* indices, size_t indexCount);
+
+struct VertexCacheStats
+{
+    float acmr; // Average cache miss ratio: transforms per triangle, ~0.5 at best for big meshes
+    float atvr; // Average transform to vertex ratio: transforms per vertex used, 1.0 at best
+};
+
+// Replays the indices through a FIFO post-transform cache of cacheSize entries
+VertexCacheStats AnalyzeVertexCache(const IndexType* indices, size_t indexCount, size_t vertexCount,
+                                    unsigned int cacheSize);